@@ -2,12 +2,60 @@
 #include <SDL_image.h>
 #include <SDL_ttf.h>
 #include <stdio.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
 #include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
 #define main SDL_main
 
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <signal.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+class LSpriteAtlas;
+class LArchive;
+struct ArchiveEntry;
+
 class LTexture
 {
     public:
@@ -18,6 +66,15 @@ class LTexture
 
         //Loads image
         bool loadFromFile(std::string path);
+
+        //Loads pre-decoded pixels from an asset archive
+        bool loadFromFile(LArchive& archive, const ArchiveEntry* entry);
+
+        //Uploads an already decoded image
+        bool loadFromSurface(SDL_Surface* surface);
+
+        //Uses a sub-rect of a sprite atlas instead of an own texture
+        bool loadFromAtlas(LSpriteAtlas& atlas, std::string name);
         
         //Dealloc texture
         void free();
@@ -33,6 +90,10 @@ class LTexture
         //The actual hardware texture
         SDL_Texture* mTexture;
 
+        //Atlas and sub-rect when loaded from an atlas, the atlas owns the texture
+        LSpriteAtlas* mAtlas;
+        SDL_Rect mClip;
+
         //Image dimensions
         int mWidth;
         int mHeight;
@@ -49,6 +110,9 @@ class LText
         //Create text
         bool createText(std::string fontPath, SDL_Color color, int size, std::string text);
 
+        //Uploads already rasterized text
+        bool createFromSurface(SDL_Surface* surface);
+
         void free();
 
         //Renders font at given point
@@ -64,409 +128,10586 @@ class LText
         int mHeight;
 };
 
+class LGlyphAtlas
+{
+    public:
+        //Init variables
+        LGlyphAtlas();
+        //Dealloc memory
+        ~LGlyphAtlas();
 
+        //Rasterizes the printable ASCII glyphs of a font into one texture
+        bool create(std::string fontPath, int size);
 
-//Starts SDL and creates window
-bool init();
-//Loads media
-bool loadMedia();
-//Frees media and shuts down SDL
-void close();
+        //Rasterizes the glyphs into an atlas surface, safe to call off the render thread
+        SDL_Surface* rasterize(TTF_Font* font);
 
-//The window to render to
-SDL_Window* gWindow = NULL;
-//The window renderer
-SDL_Renderer* gRenderer = NULL;
+        //Uploads a surface made by rasterize
+        bool upload(SDL_Surface* atlas);
 
-//Image textures
-LTexture gRockTexture;
-LTexture gPaperTexture;
-LTexture gScissorsTexture;
+        void free();
 
-//Text textures
-LText gWelcome;
-LText gWin;
-LText gLoss;
-LText gDraw;
-LText gRetry;
+        //Draws text at given point as a single batch of quads
+        void render(int x, int y, const char* text, SDL_Color color);
 
+        //Gets the width of text in pixels
+        int measure(const char* text);
+        int getHeight();
 
-//
-//LText funcitons
-//
+    private:
+        //First and last glyph in the atlas
+        static const int FIRST_GLYPH = 32;
+        static const int LAST_GLYPH = 126;
+
+        struct Glyph
+        {
+            //Glyph cell in the atlas
+            SDL_Rect src;
+            //Pen advance after the glyph
+            int advance;
+        };
 
+        //The atlas texture
+        SDL_Texture* mAtlas;
+        int mAtlasWidth;
+        int mAtlasHeight;
+        int mHeight;
+        Glyph mGlyphs[LAST_GLYPH - FIRST_GLYPH + 1];
 
-LText::LText()
+        //Batch buffers, reused so drawing doesn't allocate
+        std::vector<SDL_Vertex> mVertices;
+        std::vector<int> mIndices;
+};
+
+class LSpriteAtlas
 {
-    //Init
-    mText = NULL;
-    mWidth = 0;
-    mHeight = 0;
-}
+    public:
+        //Init variables
+        LSpriteAtlas();
+        //Dealloc memory
+        ~LSpriteAtlas();
 
-LText::~LText()
+        //Packs decoded images into one texture, keyed by name
+        bool pack(std::vector<std::pair<std::string, SDL_Surface*> >& images);
+
+        void free();
+
+        //Gets the sub-rect of a packed image by file name
+        bool getRect(std::string name, SDL_Rect& rect);
+
+        //Queues a sub-rect to be drawn at given point
+        void draw(const SDL_Rect& clip, int x, int y);
+
+        //Submits all queued draws as one batch
+        void flush();
+
+    private:
+        //The atlas texture
+        SDL_Texture* mTexture;
+        int mWidth;
+        int mHeight;
+
+        //Sub-rect table keyed by file name
+        std::map<std::string, SDL_Rect> mRects;
+
+        //Batch buffers, reused so drawing doesn't allocate
+        std::vector<SDL_Vertex> mVertices;
+        std::vector<int> mIndices;
+};
+
+//Render loop sections timed by the profiler
+enum ProfileSection
 {
-    //Dealloc
-    free();
-}
+    PROFILE_EVENTS,
+    PROFILE_CLEAR,
+    PROFILE_SPRITES,
+    PROFILE_TEXT,
+    PROFILE_PRESENT,
+    PROFILE_FRAME,
+    PROFILE_SECTION_COUNT
+};
 
-bool LText::createText(std::string fontPath, SDL_Color color, int size, std::string text)
+//Per-section frame timings over a fixed window of recent frames
+class LProfiler
 {
-    free();
+    public:
+        //Init variables
+        LProfiler();
 
-    SDL_Texture* finalTexture = NULL;
-    TTF_Font* gFont = TTF_OpenFont(fontPath.c_str(), size);
+        //Starts timing a section, a section may be timed several times per frame
+        void begin(int section);
+        void end(int section);
 
-    if (gFont == NULL)
-    {
-        printf("Font could not be opened from %s. SDL_ttf Error: %s\n", fontPath.c_str(), TTF_GetError());
-    }
-    else
-    {
-        SDL_Surface* fontSurface = TTF_RenderText_Solid(gFont, text.c_str(), color);
-        if (fontSurface == NULL)
+        //Stores this frame's section times in the ring
+        void endFrame();
+
+        //Gets percentiles in milliseconds over the frames in the ring that timed the section
+        bool getStats(int section, double& p50, double& p99, double& max);
+
+        //Writes the frames in the ring to a CSV file
+        bool writeCsv(const char* path);
+
+    private:
+        static const int RING_SIZE = 512;
+
+        //Section times of the frame in progress, -1 if not timed
+        Sint64 mCurrent[PROFILE_SECTION_COUNT];
+        Uint64 mStart[PROFILE_SECTION_COUNT];
+
+        //Recent frames, oldest first from mNext once full
+        Sint64 mFrames[RING_SIZE][PROFILE_SECTION_COUNT];
+        int mNext;
+        int mCount;
+        Uint64 mFrameIndex;
+
+        //Sort space for percentiles so queries don't allocate
+        Sint64 mScratch[RING_SIZE];
+};
+
+//A read-only file mapped into memory
+class LMappedFile
+{
+    public:
+        //Init variables
+        LMappedFile();
+        //Unmaps the file
+        ~LMappedFile();
+
+        //Maps a whole file
+        bool open(std::string path);
+
+        void close();
+
+        const uint8_t* getData();
+        size_t getSize();
+
+    private:
+        const uint8_t* mData;
+        size_t mSize;
+#ifdef _WIN32
+        HANDLE mFile;
+        HANDLE mMapping;
+#endif
+};
+
+//Asset archive layout, little endian: header, entry table, then data aligned to ARCHIVE_ALIGN
+const char ARCHIVE_MAGIC[4] = { 'R', 'P', 'S', 'A' };
+const Uint32 ARCHIVE_VERSION = 1;
+const Uint32 ARCHIVE_ALIGN = 64;
+
+struct ArchiveHeader
+{
+    char magic[4];
+    Uint32 version;
+    Uint32 count;
+    Uint32 reserved;
+};
+
+enum ArchiveEntryType
+{
+    //Bytes of the source file as is
+    ARCHIVE_RAW,
+    //Decoded SDL_PIXELFORMAT_RGBA32 pixels
+    ARCHIVE_RGBA
+};
+
+struct ArchiveEntry
+{
+    char name[48];
+    Uint32 type;
+    Uint32 width;
+    Uint32 height;
+    Uint32 pitch;
+    Uint64 offset;
+    Uint64 size;
+};
+
+//Packed assets read straight from a memory mapping
+class LArchive
+{
+    public:
+        //Init variables
+        LArchive();
+
+        //Maps an archive and checks its index
+        bool open(std::string path);
+
+        void close();
+
+        bool isOpen();
+
+        //Gets an entry by file name, NULL if it's not in the archive
+        const ArchiveEntry* find(std::string name);
+
+        //Gets every entry of a type
+        std::vector<const ArchiveEntry*> list(Uint32 type);
+
+        //Wraps an RGBA entry's pixels in a surface without copying them
+        SDL_Surface* createSurface(const ArchiveEntry* entry);
+
+        //Opens a raw entry for reading without copying it
+        SDL_RWops* openRW(const ArchiveEntry* entry);
+
+    private:
+        LMappedFile mFile;
+        const ArchiveEntry* mEntries;
+        Uint32 mCount;
+};
+
+//A decode or rasterize step that runs off the render thread
+struct AssetJob
+{
+    //Image to decode when there's no font
+    std::string path;
+    //Archive entry to wrap instead of decoding path
+    const ArchiveEntry* entry;
+    //Font to rasterize text or the glyph atlas with
+    TTF_Font* font;
+    std::string text;
+    SDL_Color color;
+    LGlyphAtlas* glyphs;
+    //Result, owned by the job until it's uploaded
+    SDL_Surface* surface;
+};
+
+//Runs asset jobs on worker threads, jobs on the same lane run in order on one thread
+class LAssetLoader
+{
+    public:
+        //Init variables
+        LAssetLoader();
+        //Waits for workers
+        ~LAssetLoader();
+
+        //Queues a job before start, lanes keep jobs sharing a font off each other's threads
+        void add(int lane, AssetJob* job);
+
+        //Starts one thread per lane, or runs every job right away when threaded is false
+        void start(bool threaded);
+
+        //Waits for every lane to finish and forgets the jobs
+        void wait();
+
+        //Gets finished and queued job counts
+        int getDone();
+        int getTotal();
+
+    private:
+        struct Lane
         {
-            printf("Unable to create surface from font. SDL_ttf Error: %s\n", TTF_GetError());
-        }
-        else
+            LAssetLoader* loader;
+            std::vector<AssetJob*> jobs;
+            SDL_Thread* thread;
+        };
+
+        static int laneMain(void* data);
+        static void runJob(AssetJob& job);
+
+        std::vector<Lane> mLanes;
+        SDL_atomic_t mDone;
+        int mTotal;
+};
+
+//Outcome tables for N weapons, built at compile time, where a beats b when (a - b) mod N is odd
+template <int N>
+class LRules
+{
+    public:
+        static_assert(N >= 3 && N % 2 == 1, "Weapon count must be odd and at least 3");
+
+        //Row and column 0 are for invalid moves, then 1 when the row wins, 2 when it loses and 3 on a draw
+        struct Table
         {
-            finalTexture = SDL_CreateTextureFromSurface(gRenderer, fontSurface);
-            if (finalTexture == NULL)
-            {
-                printf("Unable to create texture from font surface. SDL Error: %s\n", SDL_GetError());
-            }
-            else
+            uint8_t outcome[N + 1][N + 1];
+        };
+
+        static constexpr Table build()
+        {
+            Table table = {};
+            for (int a = 1; a <= N; ++a)
             {
-                SDL_QueryTexture(finalTexture, NULL, NULL, &mWidth, &mHeight);
+                for (int b = 1; b <= N; ++b)
+                {
+                    table.outcome[a][b] = a == b ? 3 : ((a - b + N) % N % 2 == 1 ? 1 : 2);
+                }
             }
+            return table;
+        }
 
-            SDL_FreeSurface(fontSurface);
+        static constexpr Table TABLE = build();
+
+        //Gets the outcome of p against c with a single load, 0 for invalid moves
+        static int outcome(int p, int c)
+        {
+            return (unsigned)p <= N && (unsigned)c <= N ? TABLE.outcome[p][c] : 0;
         }
-    }
+};
 
-    mText = finalTexture;
-    return mText != NULL; 
-}
+template <int N>
+constexpr typename LRules<N>::Table LRules<N>::TABLE;
 
-void LText::free()
+//The rules in play, picked at runtime: compile-time tables for common sizes, a bit-packed matrix otherwise
+class LRuleSet
 {
-    if (mText != NULL)
-    {
-        SDL_DestroyTexture(mText);
-        mText = NULL;
-        mWidth = 0;
-        mHeight = 0;
-    }
-}
+    public:
+        //Moves have to fit in a byte
+        static const int MAX_WEAPONS = 255;
 
-void LText::render(int x, int y)
+        //Init to rock paper scissors
+        LRuleSet();
+
+        //Sets up N weapons, false unless N is odd and 3 to MAX_WEAPONS
+        bool create(int weapons);
+
+        //Gets the outcome of p against c like checkWin, 0 for invalid moves
+        int outcome(int p, int c);
+
+        int getCount();
+
+        //Gets a weapon's display name
+        const char* getName(int move);
+
+        //Gets a weapon's image under media, NULL when it's drawn as its name
+        const char* getImage(int move);
+
+        //Gets the move bound to a key, 0 if none
+        int getMove(SDL_Keycode key);
+
+    private:
+        int mCount;
+        //Compile-time table with rows of mCount + 1, NULL when using mBeats
+        const uint8_t* mTable;
+        //Bit (a - 1) * mCount + (b - 1) is set when a beats b
+        std::vector<Uint64> mBeats;
+        std::vector<std::string> mNames;
+        std::vector<SDL_Keycode> mKeys;
+};
+
+//Running totals shown on the scoreboard
+struct Scoreboard
 {
-    //Set rendering space and render to screen
-    SDL_Rect renderQuad = { x, y, mWidth, mHeight };
-    SDL_RenderCopy(gRenderer, mText, NULL, &renderQuad);
-}
+    int rounds;
+    int wins;
+    int losses;
+    int draws;
+    //Consecutive wins
+    int streak;
+};
 
-int LText::getWidth()
+//One game: the round on screen and the score so far
+struct GameSession
 {
-    return mWidth;
-}
+    //Moves of the round being shown, 0 before the player has picked
+    int pChoice;
+    int cChoice;
+    //checkWin result, 0 while the round is open
+    int winner;
+    Scoreboard score;
+};
 
-int LText::getHeight()
+//xoshiro256** generator, seedable and cheap enough to keep one per thread
+class LRandom
 {
-    return mHeight;
-}
+    public:
+        //Init state from a seed
+        LRandom(uint64_t seed = 0);
 
-//
-// LTexture functions
-//
+        //Resets the state from a seed through splitmix64
+        void seed(uint64_t seed);
 
+        //Advances 2^128 steps, giving a stream that never overlaps this one
+        void jump();
 
-LTexture::LTexture()
+        //Gets the next 64 random bits
+        uint64_t next();
+
+        //Gets an unbiased value in [0, range) by Lemire's method
+        uint32_t range(uint32_t range);
+
+        //Gets an unbiased move 1-3
+        int move();
+
+        //Fills out with unbiased moves 1-3
+        void fill(uint8_t* out, size_t n);
+
+    private:
+        uint64_t mState[4];
+};
+
+//A move strategy, used for the computer and for simulated players
+class LBot
 {
-    //Init
-    mTexture = NULL;
-    mWidth = 0;
-    mHeight = 0;
-}
+    public:
+        virtual ~LBot() {}
 
-LTexture::~LTexture()
+        //Forgets everything learned so far and reseeds any randomness
+        virtual void reset(uint64_t seed) {}
+
+        //Picks the next move, 1 - rock, 2 - paper, 3 - scissors
+        virtual int move() = 0;
+
+        //Learns the result of a round from this bot's point of view
+        virtual void observe(int mine, int theirs) {}
+
+        //Appends everything the bot has learned to out, false if it can't be saved
+        virtual bool save(std::vector<Uint8>& out) { return false; }
+
+        //Restores state written by save, false if it doesn't fit this bot
+        virtual bool load(const Uint8* data, size_t size) { return false; }
+};
+
+//Plays uniformly at random
+class LRandomBot : public LBot
 {
-    //Dealloc
-    free();
-}
+    public:
+        LRandomBot(int weapons = 3);
+        void reset(uint64_t seed);
+        int move();
+        bool save(std::vector<Uint8>& out);
+        bool load(const Uint8* data, size_t size);
 
-bool LTexture::loadFromFile(std::string path)
+    private:
+        int mWeapons;
+        LRandom mRandom;
+};
+
+//Always plays the same move
+class LConstantBot : public LBot
 {
-    //Get rid of preexisting texture
-    free();
-    //The final texture
-    SDL_Texture* newTexture = NULL;
+    public:
+        LConstantBot(int move);
+        int move();
+        bool save(std::vector<Uint8>& out);
+        bool load(const Uint8* data, size_t size);
 
-    //Load image at specified path
-    SDL_Surface* loadedSurface = IMG_Load(path.c_str());
-    if (loadedSurface == NULL)
-    {
-        printf("Unable to load image %s. SDL_image Error: %s\n", path.c_str(), IMG_GetError());
-    }
-    else
+    private:
+        int mMove;
+};
+
+//Plays rock, paper, scissors in turn
+class LCycleBot : public LBot
+{
+    public:
+        LCycleBot();
+        void reset(uint64_t seed);
+        int move();
+        bool save(std::vector<Uint8>& out);
+        bool load(const Uint8* data, size_t size);
+
+    private:
+        int mNext;
+};
+
+//Repeats the opponent's last move
+class LCopyBot : public LBot
+{
+    public:
+        LCopyBot();
+        void reset(uint64_t seed);
+        int move();
+        void observe(int mine, int theirs);
+        bool save(std::vector<Uint8>& out);
+        bool load(const Uint8* data, size_t size);
+
+    private:
+        int mLast;
+};
+
+//Plays what would have beaten the opponent's last move
+class LBeatLastBot : public LBot
+{
+    public:
+        LBeatLastBot();
+        void reset(uint64_t seed);
+        int move();
+        void observe(int mine, int theirs);
+        bool save(std::vector<Uint8>& out);
+        bool load(const Uint8* data, size_t size);
+
+    private:
+        int mLast;
+};
+
+//Predicts the opponent's next move from their last k moves and plays what beats it
+class LMarkovBot : public LBot
+{
+    public:
+        //Longest history the model can condition on
+        static const int MAX_ORDER = 12;
+
+        LMarkovBot(int order);
+        void reset(uint64_t seed);
+        int move();
+        void observe(int mine, int theirs);
+        bool save(std::vector<Uint8>& out);
+        bool load(const Uint8* data, size_t size);
+
+        //Gets the opponent's most likely next move, 0 if this context was never seen
+        int predict();
+
+    private:
+        int mOrder;
+        //3^order, the number of distinct histories
+        Uint32 mContexts;
+        //The opponent's last order moves as a base 3 number
+        Uint32 mContext;
+        //Next move counts, four per context so each context is one 8 byte load
+        std::vector<Uint16> mCounts;
+        //Breaks ties and plays before anything's been learned
+        LRandom mRandom;
+};
+
+//Finds the longest earlier repeat of the recent rounds and plays against what the opponent did next
+class LHistoryBot : public LBot
+{
+    public:
+        //Rounds kept before the oldest half of the log is dropped and the index rebuilt
+        static const int WINDOW = 1 << 19;
+
+        LHistoryBot(int window = WINDOW);
+        void reset(uint64_t seed);
+        int move();
+        void observe(int mine, int theirs);
+
+        //Gets the length of the current match, 0 if the recent rounds never happened before
+        int getMatchLength();
+
+        //Gets what the opponent played after the match last time, 0 if there's no match
+        int predict();
+
+    private:
+        //Suffix automaton state over round symbols (mine - 1) * 3 + (theirs - 1)
+        struct State
+        {
+            int len;
+            int link;
+            //End of this state's first occurrence in the log
+            int firstPos;
+            int next[9];
+        };
+
+        //Appends a symbol to the automaton, amortized O(1)
+        void extend(int symbol);
+
+        //Rebuilds the automaton over the newest half of the log
+        void rebuild();
+
+        int mWindow;
+        std::vector<uint8_t> mLog;
+        std::vector<State> mStates;
+        int mLast;
+        //State of the longest suffix seen before, 0 is the empty root
+        int mMatch;
+        LRandom mRandom;
+};
+
+//Runs frequency, markov and history predictors on both players' moves and plays the best scoring guess
+class LEnsembleBot : public LBot
+{
+    public:
+        //Predictors per side: frequency, markov orders 1, 2 and 4, history
+        static const int PREDICTORS = 5;
+        //History window of the sub-predictors, small enough that both indexes stay in cache
+        static const int HISTORY_WINDOW = 1 << 15;
+        //Each prediction is tried at three rotations, padded to a multiple of the SIMD width
+        static const int CANDIDATES = 32;
+
+        LEnsembleBot();
+        void reset(uint64_t seed);
+        int move();
+        void observe(int mine, int theirs);
+
+    private:
+        //Fills mMoves from the predictors' current guesses
+        void prepare();
+
+        //Opponent's move counts, [0] for predicting them and [1] for predicting us
+        Uint32 mFrequency[2][3];
+        //Markov orders 1, 2 and 4 per side
+        std::vector<LMarkovBot> mMarkov;
+        LHistoryBot mHistory[2];
+
+        //Structure of arrays: candidate c plays mMoves[c] (0 when it has no guess) and has score mScores[c]
+        alignas(16) Sint32 mMoves[CANDIDATES];
+        alignas(16) float mScores[CANDIDATES];
+
+        LRandom mRandom;
+};
+
+//Regret tables of a policy conditioned on the last rounds, as trained and checkpointed
+struct PolicyTables
+{
+    //Policies can look back at most this many rounds
+    static const int MAX_ORDER = 4;
+
+    //Rounds of history each decision looks at
+    int order;
+    //9^order, one per combination of both players' recent moves
+    Uint32 contexts;
+    //Self-play rounds and batches trained so far
+    Uint64 rounds;
+    Uint64 batches;
+    //Positive regrets and summed strategies, three per context
+    std::vector<float> regrets;
+    std::vector<double> sums;
+};
+
+//Plays the average strategy of a trained policy for the current context
+class LPolicyBot : public LBot
+{
+    public:
+        //Strategy holds four probabilities per context, the last is padding
+        LPolicyBot(int order, const std::vector<float>& strategy);
+        void reset(uint64_t seed);
+        int move();
+        void observe(int mine, int theirs);
+        bool save(std::vector<Uint8>& out);
+        bool load(const Uint8* data, size_t size);
+
+    private:
+        Uint32 mContexts;
+        Uint32 mContext;
+        const std::vector<float>* mStrategy;
+        LRandom mRandom;
+};
+
+//Samples moves from a fixed mixed strategy
+class LEquilibriumBot : public LBot
+{
+    public:
+        //Plays move i + 1 with probability strategy[i]
+        LEquilibriumBot(const std::vector<float>& strategy);
+        void reset(uint64_t seed);
+        int move();
+        bool save(std::vector<Uint8>& out);
+        bool load(const Uint8* data, size_t size);
+
+    private:
+        //Running sums of the strategy for sampling by binary search
+        std::vector<float> mCumulative;
+        LRandom mRandom;
+};
+
+//Named bot constructors
+struct BotEntry
+{
+    const char* name;
+    LBot* (*create)();
+    //Weapon count the bot understands, 0 for any rules
+    int weapons;
+};
+
+//Persistent worker threads that run batches of indexed tasks
+class LThreadPool
+{
+    public:
+        //Task body, worker is in [0, getThreadCount())
+        typedef void (*Task)(int index, int worker, void* data);
+
+        //Init variables
+        LThreadPool();
+        //Stops workers
+        ~LThreadPool();
+
+        //Starts threads - 1 workers, the thread calling run() is worker 0
+        bool start(int threads);
+
+        void stop();
+
+        //Runs task for every index in [0, count) and waits for all of them
+        void run(int count, Task task, void* data);
+
+        int getThreadCount();
+
+    private:
+        //Each worker's share of indices, others steal from it once theirs run dry
+        struct Queue
+        {
+            SDL_atomic_t next;
+            int end;
+            char pad[64 - sizeof(SDL_atomic_t) - sizeof(int)];
+        };
+
+        struct WorkerArgs
+        {
+            LThreadPool* pool;
+            int worker;
+        };
+
+        static int workerMain(void* data);
+        void work(int worker);
+
+        std::vector<SDL_Thread*> mThreads;
+        std::vector<WorkerArgs> mArgs;
+        std::vector<Queue> mQueues;
+
+        //Batch hand-off, guarded by mLock
+        SDL_mutex* mLock;
+        SDL_cond* mWake;
+        SDL_cond* mDone;
+        int mGeneration;
+        int mPending;
+        bool mQuit;
+        Task mTask;
+        void* mData;
+};
+
+//Finds optimal mixed strategies of a zero-sum matrix game by regret matching+
+class LSolver
+{
+    public:
+        //Init variables
+        LSolver();
+
+        //Sets the row player's payoffs, rows x cols values in row-major order
+        void setPayoffs(int rows, int cols, const float* payoffs);
+
+        //Sets payoffs from the rules, 1 for a win and -1 for a loss
+        void setRules(LRuleSet& rules);
+
+        //Reads "rows cols" followed by the row player's payoffs from a text file
+        bool load(const char* path);
+
+        //Runs until exploitability is under tolerance or for maxIterations, returns the iterations run
+        int solve(float tolerance, int maxIterations, int threads);
+
+        int getRows();
+        int getCols();
+
+        //Average strategies, which converge to an equilibrium
+        std::vector<float> getRowStrategy();
+        std::vector<float> getColStrategy();
+
+        //Row player's expected payoff under the average strategies
+        float getValue();
+
+        //Best response gain summed over both players, 0 at equilibrium
+        float getExploitability();
+
+    private:
+        //Rows or padded columns handed to each pool task
+        static const int BLOCK = 256;
+
+        //Fills out with A y (one entry per row) or x A (one per padded column)
+        void rowPayoffs(const float* y, float* out);
+        void colPayoffs(const float* x, float* out);
+        static void rowTask(int index, int worker, void* data);
+        static void colTask(int index, int worker, void* data);
+
+        //Measures the average strategies against best responses
+        void evaluate();
+
+        int mRows;
+        int mCols;
+        //Payoff rows are padded with zeros to a multiple of 8 floats for the SIMD kernels
+        int mStride;
+        std::vector<float> mPayoffs;
+
+        //Current strategies, positive regrets and iteration weighted strategy sums
+        std::vector<float> mRowStrategy;
+        std::vector<float> mColStrategy;
+        std::vector<float> mRowRegrets;
+        std::vector<float> mColRegrets;
+        std::vector<float> mRowSum;
+        std::vector<float> mColSum;
+        std::vector<float> mRowPayoffs;
+        std::vector<float> mColPayoffs;
+
+        float mValue;
+        float mExploitability;
+
+        //Mat-vec work is split over the pool for big games
+        LThreadPool mPool;
+        bool mParallel;
+        const float* mTaskIn;
+        float* mTaskOut;
+};
+
+
+
+//Replay log layout, little endian: header, one ReplayRound per round, then the keyframe index
+//Version 1 logs have no index
+const char REPLAY_MAGIC[4] = { 'R', 'P', 'S', 'R' };
+const Uint32 REPLAY_VERSION = 2;
+const char REPLAY_INDEX_MAGIC[4] = { 'R', 'P', 'S', 'K' };
+
+struct ReplayHeader
+{
+    char magic[4];
+    Uint32 version;
+    Uint64 seed;
+    //Weapon count of the rules played
+    Uint32 weapons;
+    //Unix time recording started, 0 when unknown
+    Uint32 startTime;
+    //Computer strategy name
+    char ai[24];
+};
+
+struct ReplayRound
+{
+    Uint8 player;
+    Uint8 computer;
+    //checkWin result from the player's side
+    Uint8 winner;
+    Uint8 reserved;
+    //Microseconds since the previous round, or since recording started
+    Uint32 dtMicros;
+};
+
+//State before a round, every interval rounds
+struct ReplayKeyframe
+{
+    Uint64 round;
+    //File offset of that round
+    Uint64 offset;
+    Uint32 wins;
+    Uint32 losses;
+    Uint32 draws;
+    Uint32 streak;
+    //Computer's saved state within the snapshot block, size 0 when it can't be saved
+    Uint64 snapshotOffset;
+    Uint32 snapshotSize;
+    Uint32 reserved;
+};
+
+//Last bytes of an indexed log: keyframe table, then snapshot block, then this
+struct ReplayTrailer
+{
+    char magic[4];
+    Uint32 interval;
+    Uint64 keyframes;
+    Uint64 indexOffset;
+    Uint64 snapshotOffset;
+};
+
+#ifdef HAVE_IO_URING
+//io_uring straight over the system calls: submissions are queued in memory shared with the kernel and go in
+//batches, one io_uring_enter for everything queued
+class LRing
+{
+    public:
+        //Init variables
+        LRing();
+        //Unmaps the queues and closes the ring
+        ~LRing();
+
+        //Sets up room for entries queued submissions and completions unread completions, retrying without flags if the kernel rejects them
+        bool open(unsigned entries, unsigned completions, unsigned flags);
+
+        void close();
+
+        bool isOpen();
+
+        //Whether the kernel has io_uring and every operation the server and replay writer use
+        static bool isSupported();
+
+        //Pins buffers for READ_FIXED and WRITE_FIXED, indexed in the order given
+        bool registerBuffers(const iovec* buffers, unsigned count);
+
+        bool hasRegisteredBuffers();
+
+        //Returns a cleared submission, submitting the queue first if it's full, NULL if that fails
+        io_uring_sqe* getSqe();
+
+        //Submits everything queued and waits for at least wait completions, returns the count submitted or -errno
+        int submit(unsigned wait);
+
+        //Returns the oldest completion not yet seen, NULL if there is none
+        io_uring_cqe* peek();
+
+        //Hands the completion from peek back to the kernel
+        void seen();
+
+    private:
+        int mFd;
+        void* mSqRing;
+        size_t mSqRingSize;
+        void* mCqRing;
+        size_t mCqRingSize;
+        io_uring_sqe* mSqes;
+        size_t mSqesSize;
+
+        unsigned* mSqHead;
+        unsigned* mSqTail;
+        unsigned mSqMask;
+        unsigned mSqEntries;
+        unsigned* mCqHead;
+        unsigned* mCqTail;
+        unsigned mCqMask;
+        io_uring_cqe* mCqes;
+
+        //Our tail, published to the kernel on submit, and how many entries it hasn't taken yet
+        unsigned mTail;
+        unsigned mQueued;
+        bool mRegistered;
+};
+#endif
+
+//Appends rounds into preallocated buffers that a background thread writes out
+class LReplayWriter
+{
+    public:
+        //Rounds per buffer, each hand-off is one sequential write of this many
+        static const int CAPACITY = 1 << 16;
+
+        //Bot snapshots bigger than this are left out of keyframes
+        static const Uint32 MAX_SNAPSHOT = 1 << 20;
+
+        //Snapshot bytes held before they're handed to the writer thread without waiting for a full buffer of rounds
+        static const size_t SNAPSHOT_FLUSH = 4 << 20;
+
+        //Init variables
+        LReplayWriter();
+        //Flushes and closes
+        ~LReplayWriter();
+
+        //Creates the file, writes the header and starts the writer thread, keyframes every interval rounds unless 0
+        bool open(const char* path, const ReplayHeader& header, Uint32 interval);
+
+        //Writes what's buffered and stops the writer thread, false if any write failed
+        bool close();
+
+        bool isOpen();
+
+        //How the writer thread writes rounds out, io_uring or stdio
+        const char* getBackend();
+
+        //Adds a round without allocating, only blocks if the writer falls a whole buffer behind
+        void append(const ReplayRound& round)
+        {
+            mBuffers[mActive][mFill] = round;
+            if (++mFill == CAPACITY)
+            {
+                submit();
+            }
+        }
+
+        Uint64 getCount();
+
+        //Whether the next keyframe is due, checked after each append
+        bool needsKeyframe()
+        {
+            return mCount + mFill == mNextKeyframe;
+        }
+
+        //Records the score and the computer's state before the next round
+        void addKeyframe(const Scoreboard& score, LBot* bot);
+
+    private:
+        //Hands the active buffer to the writer thread and switches to the other one
+        void submit();
+
+        static int writerMain(void* data);
+
+        //Writes the keyframe index after the rounds
+        bool writeIndex();
+
+        //Writes fill rounds from a buffer after the ones already written
+        bool writeBuffer(int buffer, int fill);
+
+        //Appends the snapshots taken with a buffer's rounds to the snapshot file
+        bool writeSnapshots(int buffer);
+
+        FILE* mFile;
+        Uint32 mInterval;
+        Uint64 mNextKeyframe;
+        std::vector<ReplayKeyframe> mKeyframes;
+        std::vector<ReplayRound> mBuffers[2];
+        //Snapshots taken while each buffer was active, written out with its rounds
+        std::vector<Uint8> mSnapshots[2];
+        //Snapshots go to a temp file next to the replay while recording and are copied in after the index
+        FILE* mSnapshotFile;
+        std::string mSnapshotPath;
+        Uint64 mSnapshotBytes;
+        int mActive;
+        int mFill;
+        Uint64 mCount;
+
+        //Buffer hand-off, guarded by mLock
+        SDL_Thread* mThread;
+        SDL_mutex* mLock;
+        SDL_cond* mWake;
+        SDL_cond* mIdle;
+        int mPending;
+        int mPendingFill;
+        bool mQuit;
+        bool mFailed;
+
+#ifdef HAVE_IO_URING
+        //Used by the writer thread in place of fwrite when io_uring is available, with both buffers registered
+        LRing mRing;
+        Uint64 mOffset;
+#endif
+};
+
+//Reads a replay log through a memory mapping
+class LReplayReader
+{
+    public:
+        //Init variables
+        LReplayReader();
+
+        //Maps a replay and checks its header, a torn last round from a crash is ignored
+        bool open(const char* path);
+
+        void close();
+
+        bool isOpen();
+
+        const ReplayHeader& getHeader();
+
+        Uint64 getCount();
+
+        const ReplayRound& getRound(Uint64 index);
+
+        //Whether keyframes came from the log, rather than a scan of an unindexed one
+        bool hasIndex();
+        int getKeyframeCount();
+
+        //Finds the last keyframe at or before a round by binary search
+        const ReplayKeyframe& findKeyframe(Uint64 round);
+
+        //Rebuilds the score, and the bot if it's given, as they were before a round by replaying from
+        //the nearest keyframe, returns false if the bot couldn't be restored
+        bool seek(Uint64 round, Scoreboard& score, LBot* bot);
+
+    private:
+        //Builds keyframes for a log without an index
+        void buildIndex(Uint32 interval);
+
+        LMappedFile mFile;
+        const ReplayHeader* mHeader;
+        const ReplayRound* mRounds;
+        Uint64 mCount;
+        std::vector<ReplayKeyframe> mKeyframes;
+        const Uint8* mSnapshots;
+        Uint64 mSnapshotSize;
+        bool mIndexed;
+};
+
+//Moves 1-3 packed five to a byte as base 3 digits, log2(3) bits each give or take 1%. Whole blocks of 80 moves
+//are planar: byte j holds moves j, j + 16, j + 32, j + 48 and j + 64 of its block, so a kernel turns 16 bytes
+//straight into five runs of 16 moves. Moves after the last whole block are packed five to a byte in order
+const int TRIT_BLOCK_MOVES = 80;
+const int TRIT_BLOCK_BYTES = 16;
+
+//Bytes that count moves pack into
+size_t packedMoveSize(size_t count);
+//Packs moves, every one must be 1 to 3
+void packMoves(const Uint8* moves, size_t count, Uint8* out);
+//Unpacks count moves
+void unpackMoves(const Uint8* packed, size_t count, Uint8* moves);
+
+//Adaptive range coder for move histories: each move is coded with frequencies learned for the two moves before it,
+//so predictable players cost far less than log2(3) bits a move
+class LMoveCoder
+{
+    public:
+        //Appends the coded moves, every one must be 1 to 3
+        static void encode(const Uint8* moves, size_t count, std::vector<Uint8>& out);
+
+        //Decodes count moves, false if the data ends first
+        static bool decode(const Uint8* data, size_t size, size_t count, Uint8* moves);
+
+    private:
+        //Frequencies are halved past this so the model keeps up with players who change
+        static const int MAX_TOTAL = 1 << 13;
+        static const int INCREMENT = 24;
+
+        //Counts for each move after each pair of moves
+        struct Model
+        {
+            Uint16 freq[9][3];
+            Uint16 total[9];
+
+            Model();
+            void update(int context, int symbol);
+        };
+
+        //Moves the top byte of low to the output
+        static void shiftLow(Uint64& low, Uint8& cache, Uint64& cacheSize, std::vector<Uint8>& out);
+};
+
+//Columnar round store: a directory with one file per column and a manifest. Column files are little endian: a header,
+//then chunks appended an import at a time, each a summary followed by its values, both padded to COLUMN_ALIGN.
+//manifest.txt commits the store: its first line has the version, rows, chunks and each column file's committed
+//length, then each session's computer strategy, seed and source follow one a line
+const char COLUMN_MAGIC[4] = { 'R', 'P', 'S', 'S' };
+const Uint32 COLUMN_VERSION = 2;
+const Uint32 COLUMN_CHUNK_ROWS = 1 << 16;
+const Uint32 COLUMN_ALIGN = 64;
+//First chunk of a column file, just past the padded header
+const Uint32 COLUMN_DATA_START = COLUMN_ALIGN;
+
+struct ColumnHeader
+{
+    char magic[4];
+    Uint32 version;
+    //Bytes per value
+    Uint32 width;
+    Uint32 chunkRows;
+};
+
+//Rounds a size up to COLUMN_ALIGN
+inline Uint64 alignColumn(Uint64 size)
+{
+    return (size + COLUMN_ALIGN - 1) / COLUMN_ALIGN * COLUMN_ALIGN;
+}
+
+//Range of one chunk's values, so queries can rule it out without reading them
+struct ColumnChunk
+{
+    Uint64 min;
+    Uint64 max;
+    Uint64 count;
+    Uint64 reserved;
+};
+
+enum StoreColumn
+{
+    STORE_PLAYER,
+    STORE_COMPUTER,
+    STORE_OUTCOME,
+    STORE_TIME,
+    STORE_SESSION,
+    STORE_STREAK,
+    STORE_COLUMN_COUNT
+};
+
+struct StoreColumnInfo
+{
+    const char* name;
+    Uint32 width;
+};
+
+//Time is microseconds since the Unix epoch, streak is the player's wins in a row before the round, capped at 255
+const StoreColumnInfo STORE_COLUMNS[STORE_COLUMN_COUNT] = {
+    { "player", 1 },
+    { "computer", 1 },
+    { "outcome", 1 },
+    { "time", 8 },
+    { "session", 4 },
+    { "streak", 1 },
+};
+
+//What a store's manifest committed
+struct StoreManifest
+{
+    bool found;
+    Uint64 rows;
+    Uint64 chunks;
+    //Bytes of each column file that belong to the store
+    Uint64 lengths[STORE_COLUMN_COUNT];
+    std::vector<std::string> sessions;
+};
+
+class LColumnStore
+{
+    public:
+        //Init variables
+        LColumnStore();
+
+        //Maps every column of the store in dir
+        bool open(const char* dir);
+
+        void close();
+
+        Uint64 getRows();
+        Uint64 getChunks();
+
+        const ColumnChunk& getChunk(int column, Uint64 chunk);
+
+        //First value of a chunk
+        const Uint8* getValues(int column, Uint64 chunk);
+
+        int getSessionCount();
+
+        //Computer strategy a session was played against
+        const std::string& getSessionAi(int session);
+
+        //Appends rows as new chunks after the committed ones and adds sessions, creating the store if there's none,
+        //then commits it all by renaming the manifest into place
+        static bool append(const char* dir, const std::vector<Uint8> columns[STORE_COLUMN_COUNT], const std::vector<std::string>& sessions);
+
+        //Adds a replay's rounds as a new session
+        static bool importReplay(const char* dir, const char* path);
+
+    private:
+        //Reads the manifest, an empty one with found false if there's no store, false if it's damaged
+        static bool readManifest(const char* dir, StoreManifest& manifest);
+
+        LMappedFile mFiles[STORE_COLUMN_COUNT];
+        //Each chunk's summary and values, found by walking the column file
+        std::vector<const ColumnChunk*> mChunkTables[STORE_COLUMN_COUNT];
+        std::vector<const Uint8*> mValues[STORE_COLUMN_COUNT];
+        Uint64 mRows;
+        Uint64 mChunks;
+        std::vector<std::string> mSessions;
+        std::vector<std::string> mSessionAi;
+};
+
+//Keeps rows with min <= value <= max
+struct StoreFilter
+{
+    int column;
+    Uint64 min;
+    Uint64 max;
+};
+
+//Session server protocol, little endian: fixed size requests, each answered by one response in the order sent
+enum ServerOp
+{
+    //Starts a session, move is the computer's index in the bot registry
+    SERVER_CREATE = 1,
+    //Plays move in session
+    SERVER_PLAY = 2,
+    //Ends session
+    SERVER_CLOSE = 3
+};
+
+enum ServerStatus
+{
+    SERVER_OK = 0,
+    SERVER_BAD_REQUEST = 1,
+    //The session doesn't exist or belongs to another connection
+    SERVER_NO_SESSION = 2,
+    SERVER_FULL = 3
+};
+
+struct ServerRequest
+{
+    Uint8 op;
+    Uint8 move;
+    Uint16 reserved;
+    Uint32 session;
+};
+
+struct ServerResponse
+{
+    Uint8 op;
+    Uint8 status;
+    //The computer's move and the winner of a played round
+    Uint8 computer;
+    Uint8 winner;
+    Uint32 session;
+    //Session score after the request
+    Uint32 rounds;
+    Uint32 wins;
+    Uint32 losses;
+    Uint32 draws;
+};
+
+//Sessions hosted by the server, one array per field so a round only touches the fields it needs
+class LSessionTable
+{
+    public:
+        //Init variables
+        LSessionTable();
+        //Deletes every session's bot
+        ~LSessionTable();
+
+        //Applies a request from the connection owner and fills in its response
+        void handle(const ServerRequest& request, int owner, ServerResponse& response);
+
+        //Ends every session a connection started
+        void closeOwner(int owner);
+
+        int getCount();
+
+        //Copies a session out of the table
+        GameSession get(Uint32 id);
+
+        static const Uint32 MAX_SESSIONS = 1 << 20;
+
+    private:
+        //Returns the new session's id, or -1 when the table is full
+        int create(int bot, int owner);
+        void close(Uint32 id);
+
+        //Connection that owns each session, -1 for free slots
+        std::vector<int> mOwner;
+        //Sessions each connection owns, indexed by owner, and each session's place in its owner's list
+        std::vector<std::vector<Uint32> > mOwned;
+        std::vector<Uint32> mOwnedIndex;
+        std::vector<LBot*> mBots;
+        std::vector<Uint8> mPlayer;
+        std::vector<Uint8> mComputer;
+        std::vector<Uint8> mWinner;
+        std::vector<Uint32> mRounds;
+        std::vector<Uint32> mWins;
+        std::vector<Uint32> mLosses;
+        std::vector<Uint32> mDraws;
+        std::vector<Uint32> mStreak;
+        std::vector<Uint32> mFree;
+        int mCount;
+};
+
+//Starts SDL and creates window
+bool init();
+//Loads media
+bool loadMedia();
+//Starts decoding media on worker threads
+bool startLoadMedia();
+//Waits for the workers and uploads their results
+bool finishLoadMedia();
+//Draws loading progress while media is decoded
+void renderLoading();
+//Frees media and shuts down SDL
+void close();
+//Returns the shared font face for path and size, opening it on first use
+TTF_Font* getFont(std::string path, int size);
+//Closes every cached font face
+void closeFonts();
+//Parses command line options
+bool parseArgs(int argc, char* args[]);
+//Returns 1 if p beats c, 2 if c beats p, 3 on a draw
+int checkWin(int p, int c);
+//Runs checkWin over n move pairs with the fastest kernel the CPU supports
+void checkWinBatch(const uint8_t* p, const uint8_t* c, uint8_t* out, size_t n);
+//Runs a named benchmark
+int runBenchmark(const char* name);
+//Gets this thread's random stream, derived from gSeed
+LRandom& threadRandom();
+//Creates a registered bot by name, NULL if there's none
+LBot* createBot(const char* name);
+//Plays one round of pChoice against the computer, returns the winner
+int playRound(int pChoice, int& cChoice, LBot& computer, Scoreboard& score);
+//Plays pChoice as the session's next round against the computer, returns the winner
+int playRound(GameSession& session, int pChoice, LBot& computer);
+//Adds a round's result to a scoreboard
+void scoreRound(int winner, Scoreboard& score);
+//Appends a round to the replay log when recording, score already includes it
+void recordRound(const GameSession& session);
+//Shows the next replayed round, false at the end of the replay
+bool stepReplay(GameSession& session);
+//Jumps the replay so round is the next one shown, with the score and computer rebuilt to match
+void seekReplay(Uint64 round, GameSession& session);
+//Draws the replay position bar
+void renderScrubber();
+//Summarizes a replay without a window
+int runReplaySummary();
+//Clears the last round so a new one can be played
+void resetRound(GameSession& session);
+//Plays rounds between a player strategy and the computer without a window
+int runHeadless();
+//Plays every registered bot against every other one across all cores
+int runTournament();
+//Packs media into an asset archive
+int packArchive(const char* path);
+//Prints the equilibrium of the payoffs in play
+int runSolve();
+//Trains a policy by regret matching over self-play on all cores
+int runTrain();
+//Prints win, loss and draw rates from the column store, grouped and filtered by the query options
+int runQuery();
+//Hosts sessions for clients on a Unix socket or loopback TCP port until interrupted
+int runServer();
+//Plays sessions against a running server from many connections and reports latency and throughput
+int runLoadgen();
+//Runs the load generator against the server on each I/O backend and compares system calls and throughput
+int benchServer();
+//Reads a policy checkpoint
+bool loadPolicy(const char* path, PolicyTables& policy);
+//Writes a policy checkpoint under a temp name and renames it into place
+bool savePolicy(const char* path, const PolicyTables& policy);
+//Decodes an image, through the decoded texture cache when it's enabled
+SDL_Surface* loadImage(std::string path);
+//Draws the current game state
+void renderScene(const GameSession& session);
+//Draws the current game state through the frame cache
+void drawFrame(const GameSession& session);
+//Draws a weapon's sprite, or its name when it has none
+void drawWeapon(int move, int x, int y);
+//Fills the welcome text with the keys for the rules in play
+void buildWelcomeMessage();
+//Forces the next drawFrame to redraw the scene
+void invalidateFrameCache();
+//Draws profiler percentiles over the frame
+void renderProfiler();
+//Applies an event to the game state, returns true if a redraw is needed
+bool handleEvent(SDL_Event& e, bool& quit, GameSession& session);
+
+//Loop options
+//Busy-poll events and redraw every iteration instead of waiting for events
+bool gPollLoop = false;
+//Sync presents to the display refresh
+bool gVsync = false;
+//Frame rate cap, 0 for uncapped
+int gTargetFps = 0;
+//Print performance stats to stdout
+bool gShowStats = false;
+//Simulate without a window
+bool gHeadless = false;
+//Rounds per headless run or per tournament pairing, 0 for the mode's default
+int gRounds = 0;
+//Run a bot round-robin instead of the game
+bool gTournament = false;
+//Also rerun the tournament from 1 thread up to gThreads
+bool gScaling = false;
+//Worker threads, 0 for one per CPU
+int gThreads = 0;
+const char* gPlayerBot = "random";
+//The computer's strategy
+const char* gComputerBot = "random";
+//History length of the markov bot
+int gMarkovOrder = 3;
+//Payoff matrix for the equilibrium solver, NULL to use the rules
+const char* gPayoffPath = NULL;
+//Print the equilibrium instead of playing
+bool gSolve = false;
+//Replay log to write rounds to
+const char* gRecordPath = NULL;
+//Replay log to play back instead of playing
+const char* gReplayPath = NULL;
+//Rounds between replay keyframes
+int gKeyframeInterval = 4096;
+
+//Statistics options
+//Column store directory
+const char* gStorePath = "stats";
+//Replay to add to the store
+const char* gImportPath = NULL;
+//Grouping to query the store by, NULL to play
+const char* gQueryGroup = NULL;
+std::vector<StoreFilter> gQueryFilters;
+
+//Session server options
+//Host sessions instead of playing
+bool gServe = false;
+//Unix socket the server listens on, unless a port is given
+const char* gSocketPath = "rps.sock";
+//Loopback TCP port, 0 for the Unix socket
+int gServerPort = 0;
+//Sessions for the load generator to play, 0 to play the game
+int gLoadgenSessions = 0;
+//Load generator connections, and sessions in flight on each
+int gLoadgenConnections = 256;
+int gLoadgenPipeline = 8;
+//I/O backend for the server and replay writer: auto (io_uring when the kernel has it), uring or epoll
+const char* gIoBackend = "auto";
+//System calls made by this thread's I/O loop, counted for the server benchmark
+static thread_local Uint64 gThreadSyscalls = 0;
+//Replay round to start from
+Uint64 gReplayStart = 0;
+//Trained policy checkpoint, read by the policy bot and written by training
+const char* gPolicyPath = "policy.rpp";
+bool gPolicyGiven = false;
+//Rounds of history a newly trained policy looks at
+int gPolicyOrder = 2;
+//Training batches to run, 0 to play instead
+int gTrainBatches = 0;
+//Bot to train against, NULL for self-play
+const char* gTrainOpponent = NULL;
+//Benchmark to run instead of the game
+const char* gBenchmark = NULL;
+//Seed for every random stream, picked at startup unless given
+uint64_t gSeed = 0;
+bool gSeedGiven = false;
+//Random streams handed out to threads so far
+SDL_atomic_t gRandomStreams;
+//Compose frames into a cached render target
+bool gUseFrameCache = true;
+//Draw the profiler overlay, toggled with F3
+bool gShowProfiler = false;
+//Where to write profiler samples at exit
+const char* gProfileCsv = NULL;
+//Draw sprites from one packed atlas texture
+bool gUseAtlas = true;
+//Decode media on the render thread instead of worker threads
+bool gSyncLoad = false;
+//Packed assets, loose files under media are used when it's missing
+const char* gArchivePath = "assets.rpa";
+//Pack media into an archive instead of playing
+const char* gPackArchive = NULL;
+//Directory of decoded images keyed by source hash and mtime, NULL to always decode
+const char* gTextureCache = "cache";
+//Cache temp files made by this process so far
+SDL_atomic_t gTextureCacheWrites;
+//Process start, for time to first frame
+Uint64 gLaunchTicks = 0;
+
+//The window to render to
+SDL_Window* gWindow = NULL;
+//The window renderer
+SDL_Renderer* gRenderer = NULL;
+
+//Font faces shared by all LText instances, keyed by (path, size)
+std::map<std::pair<std::string, int>, TTF_Font*> gFonts;
+//Font cache counters for the startup report
+int gFontRequests = 0;
+Sint64 gFontBytes = 0;
+Uint64 gFontOpenTicks = 0;
+
+//Last composed frame and the session's (pChoice, cChoice, winner, round) it was drawn for
+SDL_Texture* gFrameCache = NULL;
+int gCachedFrame[4] = { -1, -1, -1, -1 };
+//Frame section timings
+LProfiler gProfiler;
+//Render calls submitted since the last stats report
+int gDrawCalls = 0;
+//Frame cache hits and rebuilds since the last stats report
+int gFrameCacheHits = 0;
+int gFrameCacheMisses = 0;
+
+//Named weapons in move order, later ones in bigger rule sets are numbered
+struct Weapon
+{
+    const char* name;
+    //Sprite under media, NULL to draw the name instead
+    const char* image;
+    SDL_Keycode key;
+};
+
+const Weapon WEAPONS[] = {
+    { "Rock", "rock.png", SDLK_1 },
+    { "Paper", "paper.png", SDLK_2 },
+    { "Scissors", "scissors.png", SDLK_3 },
+    { "Spock", NULL, SDLK_4 },
+    { "Lizard", NULL, SDLK_5 }
+};
+const int WEAPON_COUNT = sizeof(WEAPONS) / sizeof(WEAPONS[0]);
+
+//Weapon sprites are drawn in a box this size
+const int WEAPON_SIZE = 160;
+
+//Rules in play
+LRuleSet gRules;
+
+//Replay being recorded
+LReplayWriter gRecorder;
+Uint64 gLastRoundTicks = 0;
+
+//Replay being played back, next round to show and when
+LReplayReader gReplay;
+Uint64 gReplayNext = 0;
+Uint64 gReplayDue = 0;
+bool gReplayPaused = false;
+//Dragging the scrubber
+bool gScrubbing = false;
+
+//Scrubber bar, the hit area is taller than the drawn bar
+const SDL_Rect REPLAY_SCRUBBER = { 40, SCREEN_HEIGHT - 70, SCREEN_WIDTH - 80, 8 };
+
+//Image textures, one per named weapon with an image
+LTexture gWeaponTextures[WEAPON_COUNT];
+
+//Text textures
+LText gWelcome;
+//Welcome text listing the keys for the rules in play
+char gWelcomeMessage[256] = "Use your keyboard: 1 - rock,  2 - paper, 3 - scissors.";
+//Digits of the weapon number typed so far, when there are more weapons than keys 1-9
+int gTypedMove = 0;
+LText gWin;
+LText gLoss;
+LText gDraw;
+LText gRetry;
+
+//Packed sprite images
+LSpriteAtlas gSprites;
+
+//Packed assets when the archive exists
+LArchive gArchive;
+
+//Media decoding in flight
+LAssetLoader gAssets;
+std::vector<AssetJob> gImageJobs;
+std::vector<AssetJob> gTextJobs;
+AssetJob gGlyphJob;
+Uint64 gLoadStart = 0;
+
+//Dynamic text
+LGlyphAtlas gHudText;
+
+//The computer opponent
+LBot* gComputer = NULL;
+
+
+//
+//LText funcitons
+//
+
+
+LText::LText()
+{
+    //Init
+    mText = NULL;
+    mWidth = 0;
+    mHeight = 0;
+}
+
+LText::~LText()
+{
+    //Dealloc
+    free();
+}
+
+bool LText::createText(std::string fontPath, SDL_Color color, int size, std::string text)
+{
+    free();
+
+    TTF_Font* gFont = getFont(fontPath, size);
+
+    if (gFont != NULL)
+    {
+        SDL_Surface* fontSurface = TTF_RenderText_Solid(gFont, text.c_str(), color);
+        if (fontSurface == NULL)
+        {
+            printf("Unable to create surface from font. SDL_ttf Error: %s\n", TTF_GetError());
+        }
+        else
+        {
+            createFromSurface(fontSurface);
+            SDL_FreeSurface(fontSurface);
+        }
+    }
+
+    return mText != NULL; 
+}
+
+bool LText::createFromSurface(SDL_Surface* surface)
+{
+    free();
+
+    mText = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (mText == NULL)
+    {
+        printf("Unable to create texture from font surface. SDL Error: %s\n", SDL_GetError());
+    }
+    else
+    {
+        SDL_QueryTexture(mText, NULL, NULL, &mWidth, &mHeight);
+    }
+
+    return mText != NULL;
+}
+
+void LText::free()
+{
+    if (mText != NULL)
+    {
+        SDL_DestroyTexture(mText);
+        mText = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+}
+
+void LText::render(int x, int y)
+{
+    //Set rendering space and render to screen
+    SDL_Rect renderQuad = { x, y, mWidth, mHeight };
+    SDL_RenderCopy(gRenderer, mText, NULL, &renderQuad);
+    ++gDrawCalls;
+}
+
+int LText::getWidth()
+{
+    return mWidth;
+}
+
+int LText::getHeight()
+{
+    return mHeight;
+}
+
+//
+// LProfiler functions
+//
+
+
+static const char* PROFILE_SECTION_NAMES[PROFILE_SECTION_COUNT] = { "events", "clear", "sprites", "text", "present", "frame" };
+
+LProfiler::LProfiler()
+{
+    //Init
+    for (int s = 0; s < PROFILE_SECTION_COUNT; ++s)
+    {
+        mCurrent[s] = -1;
+        mStart[s] = 0;
+    }
+    mNext = 0;
+    mCount = 0;
+    mFrameIndex = 0;
+}
+
+void LProfiler::begin(int section)
+{
+    mStart[section] = SDL_GetPerformanceCounter();
+}
+
+void LProfiler::end(int section)
+{
+    Sint64 ticks = (Sint64)(SDL_GetPerformanceCounter() - mStart[section]);
+    mCurrent[section] = mCurrent[section] < 0 ? ticks : mCurrent[section] + ticks;
+}
+
+void LProfiler::endFrame()
+{
+    for (int s = 0; s < PROFILE_SECTION_COUNT; ++s)
+    {
+        mFrames[mNext][s] = mCurrent[s];
+        mCurrent[s] = -1;
+    }
+
+    mNext = (mNext + 1) % RING_SIZE;
+    if (mCount < RING_SIZE)
+    {
+        ++mCount;
+    }
+    ++mFrameIndex;
+}
+
+bool LProfiler::getStats(int section, double& p50, double& p99, double& max)
+{
+    int n = 0;
+    for (int i = 0; i < mCount; ++i)
+    {
+        if (mFrames[i][section] >= 0)
+        {
+            mScratch[n++] = mFrames[i][section];
+        }
+    }
+
+    if (n == 0)
+    {
+        return false;
+    }
+
+    double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+    std::nth_element(mScratch, mScratch + n / 2, mScratch + n);
+    p50 = mScratch[n / 2] * toMs;
+    std::nth_element(mScratch, mScratch + n * 99 / 100, mScratch + n);
+    p99 = mScratch[n * 99 / 100] * toMs;
+    max = *std::max_element(mScratch, mScratch + n) * toMs;
+    return true;
+}
+
+bool LProfiler::writeCsv(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Unable to open %s for writing.\n", path);
+        return false;
+    }
+
+    fprintf(file, "frame");
+    for (int s = 0; s < PROFILE_SECTION_COUNT; ++s)
+    {
+        fprintf(file, ",%s_ms", PROFILE_SECTION_NAMES[s]);
+    }
+    fprintf(file, "\n");
+
+    //Oldest frame first, sections that weren't timed are left empty
+    double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+    int first = mCount < RING_SIZE ? 0 : mNext;
+    for (int i = 0; i < mCount; ++i)
+    {
+        const Sint64* frame = mFrames[(first + i) % RING_SIZE];
+        fprintf(file, "%llu", (unsigned long long)(mFrameIndex - mCount + i));
+        for (int s = 0; s < PROFILE_SECTION_COUNT; ++s)
+        {
+            if (frame[s] >= 0)
+            {
+                fprintf(file, ",%.4f", frame[s] * toMs);
+            }
+            else
+            {
+                fprintf(file, ",");
+            }
+        }
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+    return true;
+}
+
+//
+// LGlyphAtlas functions
+//
+
+
+LGlyphAtlas::LGlyphAtlas()
+{
+    //Init
+    mAtlas = NULL;
+    mAtlasWidth = 0;
+    mAtlasHeight = 0;
+    mHeight = 0;
+    memset(mGlyphs, 0, sizeof(mGlyphs));
+}
+
+LGlyphAtlas::~LGlyphAtlas()
+{
+    //Dealloc
+    free();
+}
+
+bool LGlyphAtlas::create(std::string fontPath, int size)
+{
+    free();
+
+    TTF_Font* font = getFont(fontPath, size);
+    if (font == NULL)
+    {
+        return false;
+    }
+
+    SDL_Surface* atlas = rasterize(font);
+    if (atlas == NULL)
+    {
+        return false;
+    }
+
+    bool success = upload(atlas);
+    SDL_FreeSurface(atlas);
+    return success;
+}
+
+SDL_Surface* LGlyphAtlas::rasterize(TTF_Font* font)
+{
+    //Rasterize every glyph in white so render can tint it
+    SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+    SDL_Surface* glyphs[LAST_GLYPH - FIRST_GLYPH + 1];
+    const int atlasWidth = 512;
+    int penX = 1;
+    int penY = 1;
+    int rowHeight = 0;
+    bool success = true;
+
+    for (int c = FIRST_GLYPH; c <= LAST_GLYPH; ++c)
+    {
+        Glyph& glyph = mGlyphs[c - FIRST_GLYPH];
+        glyphs[c - FIRST_GLYPH] = TTF_RenderGlyph_Blended(font, (Uint16)c, white);
+        SDL_Surface* surface = glyphs[c - FIRST_GLYPH];
+        if (surface == NULL)
+        {
+            printf("Unable to render glyph %d. SDL_ttf Error: %s\n", c, TTF_GetError());
+            success = false;
+            continue;
+        }
+
+        int minx, maxx, miny, maxy;
+        TTF_GlyphMetrics(font, (Uint16)c, &minx, &maxx, &miny, &maxy, &glyph.advance);
+
+        //Shelf pack with a pixel of padding so filtering doesn't bleed
+        if (penX + surface->w + 1 > atlasWidth)
+        {
+            penX = 1;
+            penY += rowHeight + 1;
+            rowHeight = 0;
+        }
+        glyph.src.x = penX;
+        glyph.src.y = penY;
+        glyph.src.w = surface->w;
+        glyph.src.h = surface->h;
+        penX += surface->w + 1;
+        if (surface->h > rowHeight)
+        {
+            rowHeight = surface->h;
+        }
+    }
+
+    SDL_Surface* atlas = NULL;
+    if (success)
+    {
+        atlas = SDL_CreateRGBSurfaceWithFormat(0, atlasWidth, penY + rowHeight + 1, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (atlas == NULL)
+        {
+            printf("Unable to create glyph atlas surface. SDL Error: %s\n", SDL_GetError());
+        }
+    }
+
+    if (atlas != NULL)
+    {
+        SDL_FillRect(atlas, NULL, 0);
+        for (int i = 0; i <= LAST_GLYPH - FIRST_GLYPH; ++i)
+        {
+            SDL_SetSurfaceBlendMode(glyphs[i], SDL_BLENDMODE_NONE);
+            SDL_BlitSurface(glyphs[i], NULL, atlas, &mGlyphs[i].src);
+        }
+        mHeight = TTF_FontHeight(font);
+    }
+
+    for (int i = 0; i <= LAST_GLYPH - FIRST_GLYPH; ++i)
+    {
+        SDL_FreeSurface(glyphs[i]);
+    }
+
+    return atlas;
+}
+
+bool LGlyphAtlas::upload(SDL_Surface* atlas)
+{
+    if (mAtlas != NULL)
+    {
+        SDL_DestroyTexture(mAtlas);
+    }
+
+    mAtlas = SDL_CreateTextureFromSurface(gRenderer, atlas);
+    if (mAtlas == NULL)
+    {
+        printf("Unable to create texture from glyph atlas. SDL Error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_SetTextureBlendMode(mAtlas, SDL_BLENDMODE_BLEND);
+    mAtlasWidth = atlas->w;
+    mAtlasHeight = atlas->h;
+    return true;
+}
+
+void LGlyphAtlas::free()
+{
+    if (mAtlas != NULL)
+    {
+        SDL_DestroyTexture(mAtlas);
+        mAtlas = NULL;
+        mAtlasWidth = 0;
+        mAtlasHeight = 0;
+        mHeight = 0;
+    }
+}
+
+void LGlyphAtlas::render(int x, int y, const char* text, SDL_Color color)
+{
+    if (mAtlas == NULL)
+    {
+        return;
+    }
+
+    mVertices.clear();
+    mIndices.clear();
+
+    float u = 1.0f / mAtlasWidth;
+    float v = 1.0f / mAtlasHeight;
+    int penX = x;
+    for (const char* p = text; *p != '\0'; ++p)
+    {
+        int c = (unsigned char)*p;
+        if (c < FIRST_GLYPH || c > LAST_GLYPH)
+        {
+            continue;
+        }
+
+        //Two triangles per glyph, tinted through the vertex color
+        const Glyph& glyph = mGlyphs[c - FIRST_GLYPH];
+        int base = (int)mVertices.size();
+        float x0 = (float)penX;
+        float y0 = (float)y;
+        float x1 = x0 + glyph.src.w;
+        float y1 = y0 + glyph.src.h;
+        float u0 = glyph.src.x * u;
+        float v0 = glyph.src.y * v;
+        float u1 = (glyph.src.x + glyph.src.w) * u;
+        float v1 = (glyph.src.y + glyph.src.h) * v;
+
+        SDL_Vertex quad[4] = {
+            { { x0, y0 }, color, { u0, v0 } },
+            { { x1, y0 }, color, { u1, v0 } },
+            { { x0, y1 }, color, { u0, v1 } },
+            { { x1, y1 }, color, { u1, v1 } }
+        };
+        mVertices.insert(mVertices.end(), quad, quad + 4);
+
+        int indices[6] = { base, base + 1, base + 2, base + 2, base + 1, base + 3 };
+        mIndices.insert(mIndices.end(), indices, indices + 6);
+
+        penX += glyph.advance;
+    }
+
+    if (!mIndices.empty())
+    {
+        SDL_RenderGeometry(gRenderer, mAtlas, &mVertices[0], (int)mVertices.size(), &mIndices[0], (int)mIndices.size());
+        ++gDrawCalls;
+    }
+}
+
+int LGlyphAtlas::measure(const char* text)
+{
+    int width = 0;
+    for (const char* p = text; *p != '\0'; ++p)
+    {
+        int c = (unsigned char)*p;
+        if (c >= FIRST_GLYPH && c <= LAST_GLYPH)
+        {
+            width += mGlyphs[c - FIRST_GLYPH].advance;
+        }
+    }
+
+    return width;
+}
+
+int LGlyphAtlas::getHeight()
+{
+    return mHeight;
+}
+
+//
+// LSpriteAtlas functions
+//
+
+
+LSpriteAtlas::LSpriteAtlas()
+{
+    //Init
+    mTexture = NULL;
+    mWidth = 0;
+    mHeight = 0;
+}
+
+LSpriteAtlas::~LSpriteAtlas()
+{
+    //Dealloc
+    free();
+}
+
+//Orders images tallest first for shelf packing
+static bool tallerSurface(const std::pair<std::string, SDL_Surface*>& a, const std::pair<std::string, SDL_Surface*>& b)
+{
+    return a.second->h > b.second->h;
+}
+
+bool LSpriteAtlas::pack(std::vector<std::pair<std::string, SDL_Surface*> >& images)
+{
+    free();
+
+    //Shelf pack with a pixel of padding so filtering doesn't bleed
+    std::vector<std::pair<std::string, SDL_Surface*> > sorted = images;
+    std::sort(sorted.begin(), sorted.end(), tallerSurface);
+    int width = 512;
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        if (sorted[i].second->w + 2 > width)
+        {
+            width = sorted[i].second->w + 2;
+        }
+    }
+
+    int penX = 1;
+    int penY = 1;
+    int rowHeight = 0;
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        SDL_Surface* image = sorted[i].second;
+        if (penX + image->w + 1 > width)
+        {
+            penX = 1;
+            penY += rowHeight + 1;
+            rowHeight = 0;
+        }
+
+        SDL_Rect rect = { penX, penY, image->w, image->h };
+        mRects[sorted[i].first] = rect;
+        penX += image->w + 1;
+        if (image->h > rowHeight)
+        {
+            rowHeight = image->h;
+        }
+    }
+
+    if (sorted.empty())
+    {
+        printf("No images to pack into the sprite atlas.\n");
+        return false;
+    }
+
+    SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, width, penY + rowHeight + 1, 32, SDL_PIXELFORMAT_RGBA32);
+    if (atlas == NULL)
+    {
+        printf("Unable to create sprite atlas surface. SDL Error: %s\n", SDL_GetError());
+        mRects.clear();
+        return false;
+    }
+
+    SDL_FillRect(atlas, NULL, 0);
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        SDL_SetSurfaceBlendMode(sorted[i].second, SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(sorted[i].second, NULL, atlas, &mRects[sorted[i].first]);
+    }
+
+    mTexture = SDL_CreateTextureFromSurface(gRenderer, atlas);
+    if (mTexture == NULL)
+    {
+        printf("Unable to create texture from sprite atlas. SDL Error: %s\n", SDL_GetError());
+        mRects.clear();
+    }
+    else
+    {
+        SDL_SetTextureBlendMode(mTexture, SDL_BLENDMODE_BLEND);
+        mWidth = atlas->w;
+        mHeight = atlas->h;
+    }
+    SDL_FreeSurface(atlas);
+
+    return mTexture != NULL;
+}
+
+void LSpriteAtlas::free()
+{
+    if (mTexture != NULL)
+    {
+        SDL_DestroyTexture(mTexture);
+        mTexture = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+    mRects.clear();
+    mVertices.clear();
+    mIndices.clear();
+}
+
+bool LSpriteAtlas::getRect(std::string name, SDL_Rect& rect)
+{
+    std::map<std::string, SDL_Rect>::iterator it = mRects.find(name);
+    if (it == mRects.end())
+    {
+        return false;
+    }
+
+    rect = it->second;
+    return true;
+}
+
+void LSpriteAtlas::draw(const SDL_Rect& clip, int x, int y)
+{
+    SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+    int base = (int)mVertices.size();
+    float x0 = (float)x;
+    float y0 = (float)y;
+    float x1 = x0 + clip.w;
+    float y1 = y0 + clip.h;
+    float u0 = (float)clip.x / mWidth;
+    float v0 = (float)clip.y / mHeight;
+    float u1 = (float)(clip.x + clip.w) / mWidth;
+    float v1 = (float)(clip.y + clip.h) / mHeight;
+
+    SDL_Vertex quad[4] = {
+        { { x0, y0 }, white, { u0, v0 } },
+        { { x1, y0 }, white, { u1, v0 } },
+        { { x0, y1 }, white, { u0, v1 } },
+        { { x1, y1 }, white, { u1, v1 } }
+    };
+    mVertices.insert(mVertices.end(), quad, quad + 4);
+
+    int indices[6] = { base, base + 1, base + 2, base + 2, base + 1, base + 3 };
+    mIndices.insert(mIndices.end(), indices, indices + 6);
+}
+
+void LSpriteAtlas::flush()
+{
+    if (!mIndices.empty())
+    {
+        SDL_RenderGeometry(gRenderer, mTexture, &mVertices[0], (int)mVertices.size(), &mIndices[0], (int)mIndices.size());
+        ++gDrawCalls;
+    }
+
+    mVertices.clear();
+    mIndices.clear();
+}
+
+//
+// LMappedFile functions
+//
+
+
+LMappedFile::LMappedFile()
+{
+    //Init
+    mData = NULL;
+    mSize = 0;
+#ifdef _WIN32
+    mFile = INVALID_HANDLE_VALUE;
+    mMapping = NULL;
+#endif
+}
+
+LMappedFile::~LMappedFile()
+{
+    //Dealloc
+    close();
+}
+
+bool LMappedFile::open(std::string path)
+{
+    close();
+
+#ifdef _WIN32
+    mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+
+    mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mMapping == NULL)
+    {
+        close();
+        return false;
+    }
+
+    mData = (const uint8_t*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+    mSize = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data != MAP_FAILED)
+    {
+        mData = (const uint8_t*)data;
+        mSize = (size_t)info.st_size;
+    }
+#endif
+
+    if (mData == NULL)
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void LMappedFile::close()
+{
+#ifdef _WIN32
+    if (mData != NULL)
+    {
+        UnmapViewOfFile(mData);
+    }
+    if (mMapping != NULL)
+    {
+        CloseHandle(mMapping);
+        mMapping = NULL;
+    }
+    if (mFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(mFile);
+        mFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mData != NULL)
+    {
+        munmap((void*)mData, mSize);
+    }
+#endif
+
+    mData = NULL;
+    mSize = 0;
+}
+
+const uint8_t* LMappedFile::getData()
+{
+    return mData;
+}
+
+size_t LMappedFile::getSize()
+{
+    return mSize;
+}
+
+//
+// LArchive functions
+//
+
+
+LArchive::LArchive()
+{
+    //Init
+    mEntries = NULL;
+    mCount = 0;
+}
+
+bool LArchive::open(std::string path)
+{
+    close();
+
+    if (!mFile.open(path))
+    {
+        return false;
+    }
+
+    //Check the header and that every entry lies inside the file
+    const ArchiveHeader* header = (const ArchiveHeader*)mFile.getData();
+    size_t size = mFile.getSize();
+    if (size < sizeof(ArchiveHeader) || memcmp(header->magic, ARCHIVE_MAGIC, 4) != 0 || header->version != ARCHIVE_VERSION || (size - sizeof(ArchiveHeader)) / sizeof(ArchiveEntry) < header->count)
+    {
+        printf("%s is not a valid asset archive.\n", path.c_str());
+        close();
+        return false;
+    }
+
+    const ArchiveEntry* entries = (const ArchiveEntry*)(mFile.getData() + sizeof(ArchiveHeader));
+    for (Uint32 i = 0; i < header->count; ++i)
+    {
+        //Surfaces read (height - 1) * pitch + width * 4 bytes and take int sizes
+        const ArchiveEntry& entry = entries[i];
+        bool pixels = entry.width <= INT_MAX / 4 && entry.height <= INT_MAX && entry.pitch <= INT_MAX && entry.pitch >= entry.width * 4 &&
+            (Uint64)entry.pitch * entry.height <= entry.size;
+        if (entry.offset > size || entry.size > size - entry.offset || entry.name[sizeof(entry.name) - 1] != '\0' || (entry.type == ARCHIVE_RGBA && !pixels))
+        {
+            printf("%s has a corrupt entry.\n", path.c_str());
+            close();
+            return false;
+        }
+    }
+
+    mEntries = entries;
+    mCount = header->count;
+    return true;
+}
+
+void LArchive::close()
+{
+    mFile.close();
+    mEntries = NULL;
+    mCount = 0;
+}
+
+bool LArchive::isOpen()
+{
+    return mEntries != NULL;
+}
+
+const ArchiveEntry* LArchive::find(std::string name)
+{
+    for (Uint32 i = 0; i < mCount; ++i)
+    {
+        if (name == mEntries[i].name)
+        {
+            return &mEntries[i];
+        }
+    }
+
+    return NULL;
+}
+
+std::vector<const ArchiveEntry*> LArchive::list(Uint32 type)
+{
+    std::vector<const ArchiveEntry*> entries;
+    for (Uint32 i = 0; i < mCount; ++i)
+    {
+        if (mEntries[i].type == type)
+        {
+            entries.push_back(&mEntries[i]);
+        }
+    }
+
+    return entries;
+}
+
+SDL_Surface* LArchive::createSurface(const ArchiveEntry* entry)
+{
+    //The surface points into the read-only mapping, it must never be written to
+    void* pixels = (void*)(mFile.getData() + entry->offset);
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom(pixels, entry->width, entry->height, 32, entry->pitch, SDL_PIXELFORMAT_RGBA32);
+    if (surface == NULL)
+    {
+        printf("Unable to create surface for %s. SDL Error: %s\n", entry->name, SDL_GetError());
+    }
+
+    return surface;
+}
+
+SDL_RWops* LArchive::openRW(const ArchiveEntry* entry)
+{
+    return SDL_RWFromConstMem(mFile.getData() + entry->offset, (int)entry->size);
+}
+
+//
+// Decoded texture cache
+//
+
+
+//Cache file layout, little endian: header then RGBA32 rows of width * 4 bytes
+const char TEXTURE_CACHE_MAGIC[4] = { 'R', 'P', 'S', 'C' };
+const Uint32 TEXTURE_CACHE_VERSION = 1;
+
+struct TextureCacheHeader
+{
+    char magic[4];
+    Uint32 version;
+    Uint64 hash;
+    Sint64 mtime;
+    Uint32 width;
+    Uint32 height;
+};
+
+//FNV-1a over the source file's bytes
+static Uint64 hashBytes(const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    Uint64 hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+//Reads a cache entry, NULL if it's missing, from another source or incomplete
+static SDL_Surface* readCachedImage(const char* path, Uint64 hash, Sint64 mtime)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    TextureCacheHeader header;
+    SDL_Surface* surface = NULL;
+    if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, TEXTURE_CACHE_MAGIC, 4) == 0 && header.version == TEXTURE_CACHE_VERSION && header.hash == hash && header.mtime == mtime && header.width > 0 && header.width <= 16384 && header.height > 0 && header.height <= 16384)
+    {
+        surface = SDL_CreateRGBSurfaceWithFormat(0, header.width, header.height, 32, SDL_PIXELFORMAT_RGBA32);
+    }
+
+    //Read straight into the surface, a short read means a bad entry
+    bool complete = surface != NULL;
+    for (int y = 0; complete && y < (int)header.height; ++y)
+    {
+        complete = fread((uint8_t*)surface->pixels + y * surface->pitch, (size_t)header.width * 4, 1, file) == 1;
+    }
+    fclose(file);
+
+    if (!complete)
+    {
+        SDL_FreeSurface(surface);
+        return NULL;
+    }
+
+    return surface;
+}
+
+//Writes a cache entry under a temp name and renames it into place, so readers never see it half written
+static void writeCachedImage(const char* path, Uint64 hash, Sint64 mtime, SDL_Surface* rgba)
+{
+#ifdef _WIN32
+    _mkdir(gTextureCache);
+    int pid = _getpid();
+#else
+    mkdir(gTextureCache, 0755);
+    int pid = (int)getpid();
+#endif
+
+    //Entries whose temp name doesn't fit just go uncached
+    char temp[512];
+    int length = snprintf(temp, sizeof(temp), "%s.%d.%d.tmp", path, pid, SDL_AtomicAdd(&gTextureCacheWrites, 1));
+    if (length < 0 || (size_t)length >= sizeof(temp))
+    {
+        return;
+    }
+    FILE* file = fopen(temp, "wb");
+    if (file == NULL)
+    {
+        return;
+    }
+
+    TextureCacheHeader header;
+    memcpy(header.magic, TEXTURE_CACHE_MAGIC, 4);
+    header.version = TEXTURE_CACHE_VERSION;
+    header.hash = hash;
+    header.mtime = mtime;
+    header.width = rgba->w;
+    header.height = rgba->h;
+
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int y = 0; success && y < rgba->h; ++y)
+    {
+        success = fwrite((const uint8_t*)rgba->pixels + y * rgba->pitch, (size_t)rgba->w * 4, 1, file) == 1;
+    }
+    success = fclose(file) == 0 && success;
+
+    //Another process may have renamed the same entry in first, which is just as good
+    if (!success || rename(temp, path) != 0)
+    {
+        remove(temp);
+    }
+}
+
+SDL_Surface* loadImage(std::string path)
+{
+    if (gTextureCache == NULL)
+    {
+        SDL_Surface* surface = IMG_Load(path.c_str());
+        if (surface == NULL)
+        {
+            printf("Unable to load image %s. SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        }
+        return surface;
+    }
+
+    //Key on the source's content and mtime
+    size_t size = 0;
+    void* data = SDL_LoadFile(path.c_str(), &size);
+    struct stat info;
+    if (data == NULL || stat(path.c_str(), &info) != 0)
+    {
+        printf("Unable to read image %s. SDL Error: %s\n", path.c_str(), SDL_GetError());
+        SDL_free(data);
+        return NULL;
+    }
+
+    Uint64 hash = hashBytes(data, size);
+    Sint64 mtime = (Sint64)info.st_mtime;
+    char cachePath[512];
+    snprintf(cachePath, sizeof(cachePath), "%s/%016llx_%llx.rgba", gTextureCache, (unsigned long long)hash, (unsigned long long)mtime);
+
+    SDL_Surface* surface = readCachedImage(cachePath, hash, mtime);
+    if (surface != NULL)
+    {
+        SDL_free(data);
+        return surface;
+    }
+
+    //Miss, decode the bytes already in memory and store the result
+    SDL_Surface* loaded = IMG_Load_RW(SDL_RWFromConstMem(data, (int)size), 1);
+    SDL_free(data);
+    if (loaded == NULL)
+    {
+        printf("Unable to load image %s. SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        return NULL;
+    }
+
+    surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+    if (surface == NULL)
+    {
+        printf("Unable to convert image %s. SDL Error: %s\n", path.c_str(), SDL_GetError());
+        return NULL;
+    }
+
+    writeCachedImage(cachePath, hash, mtime, surface);
+    return surface;
+}
+
+//
+// LAssetLoader functions
+//
+
+
+LAssetLoader::LAssetLoader()
+{
+    //Init
+    SDL_AtomicSet(&mDone, 0);
+    mTotal = 0;
+}
+
+LAssetLoader::~LAssetLoader()
+{
+    //Dealloc
+    wait();
+}
+
+void LAssetLoader::add(int lane, AssetJob* job)
+{
+    if (lane >= (int)mLanes.size())
+    {
+        mLanes.resize(lane + 1);
+    }
+
+    job->surface = NULL;
+    mLanes[lane].jobs.push_back(job);
+    ++mTotal;
+}
+
+void LAssetLoader::start(bool threaded)
+{
+    SDL_AtomicSet(&mDone, 0);
+
+    for (size_t i = 0; i < mLanes.size(); ++i)
+    {
+        Lane& lane = mLanes[i];
+        lane.loader = this;
+        lane.thread = NULL;
+        if (threaded)
+        {
+            lane.thread = SDL_CreateThread(laneMain, "assets", &lane);
+            if (lane.thread == NULL)
+            {
+                printf("Unable to create asset thread, loading on this one. SDL Error: %s\n", SDL_GetError());
+            }
+        }
+
+        //Run the lane here if there's no thread for it
+        if (lane.thread == NULL)
+        {
+            laneMain(&lane);
+        }
+    }
+}
+
+void LAssetLoader::wait()
+{
+    for (size_t i = 0; i < mLanes.size(); ++i)
+    {
+        if (mLanes[i].thread != NULL)
+        {
+            SDL_WaitThread(mLanes[i].thread, NULL);
+            mLanes[i].thread = NULL;
+        }
+    }
+
+    mLanes.clear();
+    mTotal = 0;
+}
+
+int LAssetLoader::getDone()
+{
+    return SDL_AtomicGet(&mDone);
+}
+
+int LAssetLoader::getTotal()
+{
+    return mTotal;
+}
+
+int LAssetLoader::laneMain(void* data)
+{
+    Lane* lane = (Lane*)data;
+    for (size_t i = 0; i < lane->jobs.size(); ++i)
+    {
+        runJob(*lane->jobs[i]);
+        SDL_AtomicAdd(&lane->loader->mDone, 1);
+    }
+
+    return 0;
+}
+
+void LAssetLoader::runJob(AssetJob& job)
+{
+    if (job.glyphs != NULL)
+    {
+        job.surface = job.glyphs->rasterize(job.font);
+    }
+    else if (job.entry != NULL)
+    {
+        job.surface = gArchive.createSurface(job.entry);
+    }
+    else if (job.font != NULL)
+    {
+        job.surface = TTF_RenderText_Solid(job.font, job.text.c_str(), job.color);
+        if (job.surface == NULL)
+        {
+            printf("Unable to create surface from font. SDL_ttf Error: %s\n", TTF_GetError());
+        }
+    }
+    else
+    {
+        job.surface = loadImage(job.path);
+    }
+}
+
+//
+// LTexture functions
+//
+
+
+LTexture::LTexture()
+{
+    //Init
+    mTexture = NULL;
+    mAtlas = NULL;
+    mWidth = 0;
+    mHeight = 0;
+}
+
+LTexture::~LTexture()
+{
+    //Dealloc
+    free();
+}
+
+bool LTexture::loadFromFile(std::string path)
+{
+    //Get rid of preexisting texture
+    free();
+
+    //Load image at specified path
+    SDL_Surface* loadedSurface = loadImage(path);
+    if (loadedSurface != NULL)
+    {
+        if (!loadFromSurface(loadedSurface))
+        {
+            printf("Unable to create texture from %s.\n", path.c_str());
+        }
+
+        //Get rid of old loaded surface
+        SDL_FreeSurface(loadedSurface);
+    }
+
+    //Return success
+    return mTexture != NULL;
+}
+
+bool LTexture::loadFromFile(LArchive& archive, const ArchiveEntry* entry)
+{
+    free();
+
+    if (entry == NULL || entry->type != ARCHIVE_RGBA)
+    {
+        printf("Archive entry is not an image.\n");
+        return false;
+    }
+
+    SDL_Surface* surface = archive.createSurface(entry);
+    if (surface != NULL)
+    {
+        loadFromSurface(surface);
+        SDL_FreeSurface(surface);
+    }
+
+    return mTexture != NULL;
+}
+
+bool LTexture::loadFromSurface(SDL_Surface* surface)
+{
+    free();
+
+    //Create texture from surface pixels
+    mTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (mTexture == NULL)
+    {
+        printf("Unable to create texture from surface. SDL Error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    //Get image dimensions
+    mWidth = surface->w;
+    mHeight = surface->h;
+    return true;
+}
+
+bool LTexture::loadFromAtlas(LSpriteAtlas& atlas, std::string name)
+{
+    free();
+
+    if (!atlas.getRect(name, mClip))
+    {
+        printf("Image %s is not in the sprite atlas.\n", name.c_str());
+        return false;
+    }
+
+    mAtlas = &atlas;
+    mWidth = mClip.w;
+    mHeight = mClip.h;
+    return true;
+}
+
+void LTexture::free()
+{
+    //Free texture if it exists
+    if (mTexture != NULL)
+    {
+        SDL_DestroyTexture(mTexture);
+        mTexture = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+
+    //Atlas sprites only drop the reference
+    if (mAtlas != NULL)
+    {
+        mAtlas = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+}
+
+void LTexture::render(int x, int y)
+{
+    //Atlas sprites are batched until the atlas is flushed
+    if (mAtlas != NULL)
+    {
+        mAtlas->draw(mClip, x, y);
+        return;
+    }
+
+    //Set rendering space and render to screen
+    SDL_Rect renderQuad = { x, y, mWidth, mHeight };
+    SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
+    ++gDrawCalls;
+}
+
+int LTexture::getWidth()
+{
+    return mWidth;
+}
+
+int LTexture::getHeight()
+{
+    return mHeight;
+}
+
+TTF_Font* getFont(std::string path, int size)
+{
+    ++gFontRequests;
+
+    //Reuse the face if this path and size were opened before
+    std::pair<std::string, int> key(path, size);
+    std::map<std::pair<std::string, int>, TTF_Font*>::iterator it = gFonts.find(key);
+    if (it != gFonts.end())
+    {
+        return it->second;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    TTF_Font* font = NULL;
+    SDL_RWops* file = NULL;
+
+    //Read the font out of the archive mapping when it's packed
+    const ArchiveEntry* entry = gArchive.isOpen() ? gArchive.find(path.substr(path.find_last_of('/') + 1)) : NULL;
+    if (entry != NULL && entry->type == ARCHIVE_RAW)
+    {
+        file = gArchive.openRW(entry);
+    }
+    else
+    {
+        file = SDL_RWFromFile(path.c_str(), "rb");
+    }
+
+    if (file == NULL)
+    {
+        printf("Font could not be opened from %s. SDL Error: %s\n", path.c_str(), SDL_GetError());
+        return NULL;
+    }
+
+    gFontBytes += SDL_RWsize(file);
+    font = TTF_OpenFontRW(file, 1, size);
+    gFontOpenTicks += SDL_GetPerformanceCounter() - start;
+    if (font == NULL)
+    {
+        printf("Font could not be opened from %s. SDL_ttf Error: %s\n", path.c_str(), TTF_GetError());
+        return NULL;
+    }
+
+    gFonts[key] = font;
+    return font;
+}
+
+void closeFonts()
+{
+    for (std::map<std::pair<std::string, int>, TTF_Font*>::iterator it = gFonts.begin(); it != gFonts.end(); ++it)
+    {
+        TTF_CloseFont(it->second);
+    }
+    gFonts.clear();
+}
+
+bool init()
+{
+    //Init flag
+    bool success = true;
+    //Init SDL
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        printf("SDL could not initialize. SDL Error: %s\n", SDL_GetError());
+        success = false;
+    }
+    else
+    {
+        //Set texture filtering to linear
+        if (!SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1"))
+        {
+            printf("Warning: Linear texture filtering not enabled.\n");
+        }
+
+        //Create window
+        gWindow = SDL_CreateWindow("Epic Rock Paper Scissors", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+        if (gWindow == NULL)
+        {
+            printf("Wdinwo could not be created. SDL Error: %s\n", SDL_GetError());
+            success = false;
+        }
+        else
+        {
+            //Create renderer for window
+            Uint32 rendererFlags = SDL_RENDERER_ACCELERATED;
+            if (gVsync)
+            {
+                rendererFlags |= SDL_RENDERER_PRESENTVSYNC;
+            }
+            gRenderer = SDL_CreateRenderer(gWindow, -1, rendererFlags);
+            if (gRenderer == NULL)
+            {
+                printf("Renderer could not be created. SDL Error: %s\n", SDL_GetError());
+                success = false;
+            }
+            else
+            {
+                //Init renderer color
+                SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
+
+                //Create frame cache target, falls back to direct drawing if unsupported
+                if (gUseFrameCache && SDL_RenderTargetSupported(gRenderer))
+                {
+                    gFrameCache = SDL_CreateTexture(gRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT);
+                    if (gFrameCache == NULL)
+                    {
+                        printf("Warning: Frame cache could not be created. SDL Error: %s\n", SDL_GetError());
+                    }
+                    else
+                    {
+                        SDL_SetTextureBlendMode(gFrameCache, SDL_BLENDMODE_NONE);
+                    }
+                }
+
+                //Init PNG loading
+                int imgFlags = IMG_INIT_PNG;
+                if (!(IMG_Init(imgFlags) & imgFlags))
+                {
+                    printf("SDL_image could not initialize. SDL_image Error: %s\n", IMG_GetError());
+                    success = false;
+                }
+
+                //Initialize SDL_ttf
+                if(TTF_Init() == -1)
+                {
+                    printf( "SDL_ttf could not initialize! SDL_ttf Error: %s\n", TTF_GetError() );
+                    success = false;
+                }
+            }
+        }
+    }
+
+    return success;
+}
+
+//Fixed messages rasterized at startup
+struct TextAsset
+{
+    LText* text;
+    int size;
+    const char* message;
+    const char* name;
+};
+
+const TextAsset TEXT_ASSETS[] = {
+    { &gWelcome, 20, gWelcomeMessage, "welcome" },
+    { &gWin, 30, "You win!", "win" },
+    { &gLoss, 30, "You lose!", "loss" },
+    { &gDraw, 30, "It's a draw!", "draw" },
+    { &gRetry, 20, "Press Space to play again.", "retry" }
+};
+const int TEXT_ASSET_COUNT = sizeof(TEXT_ASSETS) / sizeof(TEXT_ASSETS[0]);
+
+//Gets the names of the files in a directory ending in suffix
+static std::vector<std::string> listFiles(std::string directory, std::string suffix)
+{
+    std::vector<std::string> names;
+    DIR* dir = opendir(directory.c_str());
+    if (dir == NULL)
+    {
+        printf("Unable to open directory %s.\n", directory.c_str());
+        return names;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        std::string name = entry->d_name;
+        if (name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+//Moves a finished temp file over path in one step, so path is always either the old file or the new one
+static bool replaceFile(const char* temp, const char* path)
+{
+#ifdef _WIN32
+    return MoveFileExA(temp, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(temp, path) == 0;
+#endif
+}
+
+//Seeks to an offset that may be past 2 GB
+static bool seekFile(FILE* file, Uint64 offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+bool loadMedia()
+{
+    bool success = startLoadMedia();
+    return finishLoadMedia() && success;
+}
+
+bool startLoadMedia()
+{
+    //Loading success flag
+    bool success = true;
+    gLoadStart = SDL_GetPerformanceCounter();
+
+    //Prefer pre-decoded images from the archive, falling back to loose files
+    if (!gArchive.isOpen() && gArchive.open(gArchivePath) && gShowStats)
+    {
+        printf("Using asset archive %s\n", gArchivePath);
+    }
+
+    //The atlas takes every image in media, otherwise only the three hands are needed
+    std::vector<std::string> images;
+    if (gUseAtlas && gArchive.isOpen())
+    {
+        std::vector<const ArchiveEntry*> entries = gArchive.list(ARCHIVE_RGBA);
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            images.push_back(entries[i]->name);
+        }
+    }
+    else if (gUseAtlas)
+    {
+        images = listFiles("media", ".png");
+    }
+    else
+    {
+        for (int i = 0; i < WEAPON_COUNT; ++i)
+        {
+            if (WEAPONS[i].image != NULL)
+            {
+                images.push_back(WEAPONS[i].image);
+            }
+        }
+    }
+
+    //Jobs are filled in before they're queued so the vectors don't move under the loader
+    gImageJobs.resize(images.size());
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        AssetJob& job = gImageJobs[i];
+        job.path = "media/" + images[i];
+        job.entry = gArchive.isOpen() ? gArchive.find(images[i]) : NULL;
+        job.font = NULL;
+        job.glyphs = NULL;
+        job.surface = NULL;
+    }
+
+    //Fonts are opened here since the cache isn't thread safe
+    SDL_Color black = { 0, 0, 0, 0xFF };
+    gTextJobs.resize(TEXT_ASSET_COUNT);
+    for (int i = 0; i < TEXT_ASSET_COUNT; ++i)
+    {
+        AssetJob& job = gTextJobs[i];
+        job.font = getFont("media/ComicSansMS.ttf", TEXT_ASSETS[i].size);
+        job.text = TEXT_ASSETS[i].message;
+        job.entry = NULL;
+        job.color = black;
+        job.glyphs = NULL;
+        job.surface = NULL;
+        if (job.font == NULL)
+        {
+            success = false;
+        }
+    }
+
+    gGlyphJob.font = getFont("media/ComicSansMS.ttf", 18);
+    gGlyphJob.entry = NULL;
+    gGlyphJob.glyphs = &gHudText;
+    if (gGlyphJob.font == NULL)
+    {
+        success = false;
+    }
+
+    //Every image gets its own lane, text shares a lane per font face
+    int lanes = 0;
+    for (size_t i = 0; i < gImageJobs.size(); ++i)
+    {
+        gAssets.add(lanes++, &gImageJobs[i]);
+    }
+
+    std::map<TTF_Font*, int> fontLanes;
+    for (int i = 0; i < TEXT_ASSET_COUNT; ++i)
+    {
+        if (gTextJobs[i].font != NULL)
+        {
+            if (fontLanes.find(gTextJobs[i].font) == fontLanes.end())
+            {
+                fontLanes[gTextJobs[i].font] = lanes++;
+            }
+            gAssets.add(fontLanes[gTextJobs[i].font], &gTextJobs[i]);
+        }
+    }
+
+    if (gGlyphJob.font != NULL)
+    {
+        if (fontLanes.find(gGlyphJob.font) == fontLanes.end())
+        {
+            fontLanes[gGlyphJob.font] = lanes++;
+        }
+        gAssets.add(fontLanes[gGlyphJob.font], &gGlyphJob);
+    }
+
+    gAssets.start(!gSyncLoad);
+    return success;
+}
+
+bool finishLoadMedia()
+{
+    bool success = true;
+    gAssets.wait();
+
+    //Upload sprites, packed into one atlas or as separate textures
+    if (gUseAtlas)
+    {
+        std::vector<std::pair<std::string, SDL_Surface*> > images;
+        for (size_t i = 0; i < gImageJobs.size(); ++i)
+        {
+            if (gImageJobs[i].surface == NULL)
+            {
+                success = false;
+            }
+            else
+            {
+                images.push_back(std::make_pair(gImageJobs[i].path.substr(6), gImageJobs[i].surface));
+            }
+        }
+
+        if (!gSprites.pack(images))
+        {
+            printf("Failed to build sprite atlas.\n");
+            success = false;
+        }
+        else
+        {
+            for (int i = 0; i < WEAPON_COUNT; ++i)
+            {
+                if (WEAPONS[i].image != NULL && !gWeaponTextures[i].loadFromAtlas(gSprites, WEAPONS[i].image))
+                {
+                    printf("Failed to load %s from atlas.\n", WEAPONS[i].image);
+                    success = false;
+                }
+            }
+        }
+    }
+    else
+    {
+        //Jobs were queued in weapon order, skipping weapons without images
+        size_t job = 0;
+        for (int i = 0; i < WEAPON_COUNT && job < gImageJobs.size(); ++i)
+        {
+            if (WEAPONS[i].image == NULL)
+            {
+                continue;
+            }
+
+            if (gImageJobs[job].surface == NULL || !gWeaponTextures[i].loadFromSurface(gImageJobs[job].surface))
+            {
+                printf("Failed to load %s texture.\n", gImageJobs[job].path.c_str());
+                success = false;
+            }
+            ++job;
+        }
+    }
+
+    for (int i = 0; i < TEXT_ASSET_COUNT; ++i)
+    {
+        if (gTextJobs[i].surface == NULL || !TEXT_ASSETS[i].text->createFromSurface(gTextJobs[i].surface))
+        {
+            printf("Failed to create %s message texture.\n", TEXT_ASSETS[i].name);
+            success = false;
+        }
+    }
+
+    if (gGlyphJob.surface == NULL || !gHudText.upload(gGlyphJob.surface))
+    {
+        printf("Failed to create scoreboard glyph atlas.\n");
+        success = false;
+    }
+
+    //Decoded surfaces aren't needed once uploaded
+    for (size_t i = 0; i < gImageJobs.size(); ++i)
+    {
+        SDL_FreeSurface(gImageJobs[i].surface);
+    }
+    for (size_t i = 0; i < gTextJobs.size(); ++i)
+    {
+        SDL_FreeSurface(gTextJobs[i].surface);
+    }
+    SDL_FreeSurface(gGlyphJob.surface);
+    gImageJobs.clear();
+    gTextJobs.clear();
+    gGlyphJob.surface = NULL;
+
+    if (gShowStats)
+    {
+        //Every request past the first per face would have reopened and reparsed the file
+        Uint64 frequency = SDL_GetPerformanceFrequency();
+        int opened = (int)gFonts.size();
+        int reused = gFontRequests - opened;
+        double openMs = gFontOpenTicks * 1000.0 / frequency;
+        printf("Media loaded in %.1f ms (%s)\n", (SDL_GetPerformanceCounter() - gLoadStart) * 1000.0 / frequency, gSyncLoad ? "render thread" : "worker threads");
+        if (opened > 0)
+        {
+            printf("Font cache: %d requests, %d faces opened, %d reused (saved ~%.1f ms and %lld bytes of font data)\n", gFontRequests, opened, reused, openMs / opened * reused, (long long)(gFontBytes / opened * reused));
+        }
+    }
+
+    return success;
+}
+
+void renderLoading()
+{
+    //Background with a progress bar while workers decode
+    SDL_SetRenderDrawColor(gRenderer, 172, 202, 250, 0xFF);
+    SDL_RenderClear(gRenderer);
+
+    int total = gAssets.getTotal() > 0 ? gAssets.getTotal() : 1;
+    SDL_Rect outline = { SCREEN_WIDTH / 4, SCREEN_HEIGHT / 2 - 10, SCREEN_WIDTH / 2, 20 };
+    SDL_Rect bar = { outline.x + 2, outline.y + 2, (outline.w - 4) * gAssets.getDone() / total, outline.h - 4 };
+    SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0xFF);
+    SDL_RenderDrawRect(gRenderer, &outline);
+    SDL_RenderFillRect(gRenderer, &bar);
+    gDrawCalls += 3;
+}
+
+void close()
+{
+    for (int i = 0; i < WEAPON_COUNT; ++i)
+    {
+        gWeaponTextures[i].free();
+    }
+    gSprites.free();
+    gWelcome.free();
+    gHudText.free();
+
+    if (gFrameCache != NULL)
+    {
+        SDL_DestroyTexture(gFrameCache);
+        gFrameCache = NULL;
+    }
+
+    SDL_DestroyRenderer(gRenderer);
+    gRenderer = NULL;
+    SDL_DestroyWindow(gWindow);
+    gWindow = NULL;
+
+    closeFonts();
+    gArchive.close();
+
+    TTF_Quit();
+    IMG_Quit();
+    SDL_Quit();
+}
+
+//Outcome of p against c, row and column 0 are for invalid moves
+constexpr const uint8_t (&WIN_TABLE)[4][4] = LRules<3>::TABLE.outcome;
+static_assert(WIN_TABLE[1][3] == 1 && WIN_TABLE[3][1] == 2 && WIN_TABLE[2][2] == 3, "Rock beats scissors");
+
+int checkWin(int p, int c)
+{
+    //Moves outside 0-3 index row 0 and are masked to 0 without branching
+    int valid = ((unsigned)p <= 3) & ((unsigned)c <= 3);
+    return WIN_TABLE[p & 3][c & 3] & -valid;
+}
+
+typedef void (*CheckWinKernel)(const uint8_t* p, const uint8_t* c, uint8_t* out, size_t n);
+
+static void checkWinScalar(const uint8_t* p, const uint8_t* c, uint8_t* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        int valid = (p[i] <= 3) & (c[i] <= 3);
+        out[i] = WIN_TABLE[p[i] & 3][c[i] & 3] & -valid;
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+//Moves 1-3 win on a difference of 1 or -2, draw on 0 and lose otherwise
+__attribute__((target("sse2")))
+static void checkWinSSE2(const uint8_t* p, const uint8_t* c, uint8_t* out, size_t n)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi8(2);
+    const __m128i minusTwo = _mm_set1_epi8(-2);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i pv = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i cv = _mm_loadu_si128((const __m128i*)(c + i));
+
+        //Valid when move - 1 doesn't wrap past 2
+        __m128i pm = _mm_sub_epi8(pv, one);
+        __m128i cm = _mm_sub_epi8(cv, one);
+        __m128i valid = _mm_and_si128(_mm_cmpeq_epi8(_mm_min_epu8(pm, two), pm), _mm_cmpeq_epi8(_mm_min_epu8(cm, two), cm));
+
+        __m128i d = _mm_sub_epi8(pv, cv);
+        __m128i draw = _mm_cmpeq_epi8(d, zero);
+        __m128i win = _mm_or_si128(_mm_cmpeq_epi8(d, one), _mm_cmpeq_epi8(d, minusTwo));
+        __m128i result = _mm_sub_epi8(_mm_add_epi8(two, _mm_and_si128(draw, one)), _mm_and_si128(win, one));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_and_si128(result, valid));
+    }
+
+    checkWinScalar(p + i, c + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void checkWinAVX2(const uint8_t* p, const uint8_t* c, uint8_t* out, size_t n)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi8(2);
+    const __m256i minusTwo = _mm256_set1_epi8(-2);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i pv = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i cv = _mm256_loadu_si256((const __m256i*)(c + i));
+
+        __m256i pm = _mm256_sub_epi8(pv, one);
+        __m256i cm = _mm256_sub_epi8(cv, one);
+        __m256i valid = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(pm, two), pm), _mm256_cmpeq_epi8(_mm256_min_epu8(cm, two), cm));
+
+        __m256i d = _mm256_sub_epi8(pv, cv);
+        __m256i draw = _mm256_cmpeq_epi8(d, zero);
+        __m256i win = _mm256_or_si256(_mm256_cmpeq_epi8(d, one), _mm256_cmpeq_epi8(d, minusTwo));
+        __m256i result = _mm256_sub_epi8(_mm256_add_epi8(two, _mm256_and_si256(draw, one)), _mm256_and_si256(win, one));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_and_si256(result, valid));
+    }
+
+    checkWinSSE2(p + i, c + i, out + i, n - i);
+}
+#endif
+
+//Batch kernels from slowest to fastest
+struct CheckWinKernelEntry
+{
+    const char* name;
+    CheckWinKernel kernel;
+    SDL_bool (*supported)();
+};
+
+static SDL_bool alwaysSupported()
+{
+    return SDL_TRUE;
+}
+
+const CheckWinKernelEntry gCheckWinKernels[] = {
+    { "scalar", checkWinScalar, alwaysSupported },
+#ifdef HAVE_X86_KERNELS
+    { "sse2", checkWinSSE2, SDL_HasSSE2 },
+    { "avx2", checkWinAVX2, SDL_HasAVX2 },
+#endif
+};
+const int CHECKWIN_KERNEL_COUNT = sizeof(gCheckWinKernels) / sizeof(gCheckWinKernels[0]);
+
+//Gets the fastest supported batch kernel
+static CheckWinKernel pickCheckWinKernel()
+{
+    CheckWinKernel kernel = NULL;
+    for (int i = 0; i < CHECKWIN_KERNEL_COUNT; ++i)
+    {
+        if (gCheckWinKernels[i].supported())
+        {
+            kernel = gCheckWinKernels[i].kernel;
+        }
+    }
+    return kernel;
+}
+
+void checkWinBatch(const uint8_t* p, const uint8_t* c, uint8_t* out, size_t n)
+{
+    //Picked on first use, tournament workers can get here at the same time and static init is thread safe
+    static const CheckWinKernel kernel = pickCheckWinKernel();
+    kernel(p, c, out, n);
+}
+
+bool parseArgs(int argc, char* args[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(args[i], "--poll") == 0)
+        {
+            gPollLoop = true;
+        }
+        else if (strcmp(args[i], "--vsync") == 0)
+        {
+            gVsync = true;
+        }
+        else if (strcmp(args[i], "--fps") == 0 && i + 1 < argc)
+        {
+            gTargetFps = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "--stats") == 0)
+        {
+            gShowStats = true;
+        }
+        else if (strcmp(args[i], "--no-frame-cache") == 0)
+        {
+            gUseFrameCache = false;
+        }
+        else if (strcmp(args[i], "--no-atlas") == 0)
+        {
+            gUseAtlas = false;
+        }
+        else if (strcmp(args[i], "--archive") == 0 && i + 1 < argc)
+        {
+            gArchivePath = args[++i];
+        }
+        else if (strcmp(args[i], "--pack-archive") == 0 && i + 1 < argc)
+        {
+            gPackArchive = args[++i];
+        }
+        else if (strcmp(args[i], "--texture-cache") == 0 && i + 1 < argc)
+        {
+            gTextureCache = args[++i];
+        }
+        else if (strcmp(args[i], "--no-texture-cache") == 0)
+        {
+            gTextureCache = NULL;
+        }
+        else if (strcmp(args[i], "--sync-load") == 0)
+        {
+            gSyncLoad = true;
+        }
+        else if (strcmp(args[i], "--profile-csv") == 0 && i + 1 < argc)
+        {
+            gProfileCsv = args[++i];
+        }
+        else if (strcmp(args[i], "--headless") == 0)
+        {
+            gHeadless = true;
+        }
+        else if (strcmp(args[i], "--rounds") == 0 && i + 1 < argc)
+        {
+            gRounds = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "--player") == 0 && i + 1 < argc)
+        {
+            gPlayerBot = args[++i];
+        }
+        else if (strcmp(args[i], "--rules") == 0 && i + 1 < argc)
+        {
+            const char* rules = args[++i];
+            int weapons = strcmp(rules, "rps") == 0 ? 3 : (strcmp(rules, "rpsls") == 0 ? 5 : atoi(rules));
+            if (!gRules.create(weapons))
+            {
+                printf("Rules must be rps, rpsls or an odd weapon count from 3 to %d.\n", LRuleSet::MAX_WEAPONS);
+                return false;
+            }
+        }
+        else if (strcmp(args[i], "--payoff") == 0 && i + 1 < argc)
+        {
+            gPayoffPath = args[++i];
+        }
+        else if (strcmp(args[i], "--train") == 0 && i + 1 < argc)
+        {
+            gTrainBatches = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "--train-against") == 0 && i + 1 < argc)
+        {
+            gTrainOpponent = args[++i];
+        }
+        else if (strcmp(args[i], "--policy") == 0 && i + 1 < argc)
+        {
+            gPolicyPath = args[++i];
+            gPolicyGiven = true;
+        }
+        else if (strcmp(args[i], "--policy-order") == 0 && i + 1 < argc)
+        {
+            gPolicyOrder = atoi(args[++i]);
+            if (gPolicyOrder < 0 || gPolicyOrder > PolicyTables::MAX_ORDER)
+            {
+                printf("Policy order must be 0 to %d.\n", PolicyTables::MAX_ORDER);
+                return false;
+            }
+        }
+        else if (strcmp(args[i], "--record") == 0 && i + 1 < argc)
+        {
+            gRecordPath = args[++i];
+        }
+        else if (strcmp(args[i], "--replay") == 0 && i + 1 < argc)
+        {
+            gReplayPath = args[++i];
+        }
+        else if (strcmp(args[i], "--keyframe-every") == 0 && i + 1 < argc)
+        {
+            gKeyframeInterval = atoi(args[++i]);
+            if (gKeyframeInterval < 0)
+            {
+                printf("Keyframe interval can't be negative.\n");
+                return false;
+            }
+        }
+        else if (strcmp(args[i], "--store") == 0 && i + 1 < argc)
+        {
+            gStorePath = args[++i];
+        }
+        else if (strcmp(args[i], "--import") == 0 && i + 1 < argc)
+        {
+            gImportPath = args[++i];
+        }
+        else if (strcmp(args[i], "--query") == 0 && i + 1 < argc)
+        {
+            gQueryGroup = args[++i];
+        }
+        else if (strcmp(args[i], "--where") == 0 && i + 1 < argc)
+        {
+            //COLUMN:MIN:MAX, times in Unix seconds
+            char name[32];
+            unsigned long long low = 0;
+            unsigned long long high = 0;
+            StoreFilter filter = { -1, 0, 0 };
+            if (sscanf(args[++i], "%31[^:]:%llu:%llu", name, &low, &high) == 3)
+            {
+                for (int c = 0; c < STORE_COLUMN_COUNT; ++c)
+                {
+                    if (strcmp(name, STORE_COLUMNS[c].name) == 0)
+                    {
+                        filter.column = c;
+                    }
+                }
+            }
+            if (filter.column < 0 || low > high)
+            {
+                printf("Filters are COLUMN:MIN:MAX over player, computer, outcome, time, session or streak.\n");
+                return false;
+            }
+            filter.min = filter.column == STORE_TIME ? low * 1000000 : low;
+            filter.max = filter.column == STORE_TIME ? high * 1000000 + 999999 : high;
+            gQueryFilters.push_back(filter);
+        }
+        else if (strcmp(args[i], "--serve") == 0)
+        {
+            gServe = true;
+        }
+        else if (strcmp(args[i], "--socket") == 0 && i + 1 < argc)
+        {
+            gSocketPath = args[++i];
+        }
+        else if (strcmp(args[i], "--port") == 0 && i + 1 < argc)
+        {
+            gServerPort = atoi(args[++i]);
+            if (gServerPort < 0 || gServerPort > 65535)
+            {
+                printf("Port must be 0 to 65535.\n");
+                return false;
+            }
+        }
+        else if (strcmp(args[i], "--io") == 0 && i + 1 < argc)
+        {
+            gIoBackend = args[++i];
+            if (strcmp(gIoBackend, "auto") != 0 && strcmp(gIoBackend, "uring") != 0 && strcmp(gIoBackend, "epoll") != 0)
+            {
+                printf("I/O backend must be auto, uring or epoll.\n");
+                return false;
+            }
+        }
+        else if (strcmp(args[i], "--loadgen") == 0 && i + 1 < argc)
+        {
+            gLoadgenSessions = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "--connections") == 0 && i + 1 < argc)
+        {
+            gLoadgenConnections = atoi(args[++i]);
+            if (gLoadgenConnections < 1)
+            {
+                printf("Connections must be at least 1.\n");
+                return false;
+            }
+        }
+        else if (strcmp(args[i], "--pipeline") == 0 && i + 1 < argc)
+        {
+            gLoadgenPipeline = atoi(args[++i]);
+            if (gLoadgenPipeline < 1)
+            {
+                printf("Pipeline must be at least 1.\n");
+                return false;
+            }
+        }
+        else if (strcmp(args[i], "--seek") == 0 && i + 1 < argc)
+        {
+            gReplayStart = strtoull(args[++i], NULL, 10);
+        }
+        else if (strcmp(args[i], "--solve") == 0)
+        {
+            gSolve = true;
+        }
+        else if (strcmp(args[i], "--ai") == 0 && i + 1 < argc)
+        {
+            gComputerBot = args[++i];
+        }
+        else if (strcmp(args[i], "--markov-order") == 0 && i + 1 < argc)
+        {
+            gMarkovOrder = atoi(args[++i]);
+            if (gMarkovOrder < 1 || gMarkovOrder > LMarkovBot::MAX_ORDER)
+            {
+                printf("Markov order must be 1 to %d.\n", LMarkovBot::MAX_ORDER);
+                return false;
+            }
+        }
+        else if (strcmp(args[i], "--bench") == 0 && i + 1 < argc)
+        {
+            gBenchmark = args[++i];
+        }
+        else if (strcmp(args[i], "--tournament") == 0)
+        {
+            gTournament = true;
+        }
+        else if (strcmp(args[i], "--scaling") == 0)
+        {
+            gScaling = true;
+        }
+        else if (strcmp(args[i], "--threads") == 0 && i + 1 < argc)
+        {
+            gThreads = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "--seed") == 0 && i + 1 < argc)
+        {
+            gSeed = strtoull(args[++i], NULL, 0);
+            gSeedGiven = true;
+        }
+        else
+        {
+            printf("Unknown option %s.\n", args[i]);
+            printf("Usage: main [--poll] [--vsync] [--fps N] [--stats] [--no-frame-cache] [--no-atlas] [--archive FILE] [--texture-cache DIR] [--no-texture-cache] [--sync-load] [--profile-csv FILE] [--seed N]\n");
+            printf("            [--ai NAME] [--markov-order K] [--rules rps|rpsls|N] [--record FILE] [--keyframe-every K] [--io auto|uring|epoll]\n");
+            printf("       main --headless [--rounds N] [--player NAME] [--ai NAME] [--rules rps|rpsls|N] [--record FILE] [--keyframe-every K] [--io auto|uring|epoll] [--seed N]\n");
+            printf("       main --tournament [--rounds N] [--threads N] [--scaling] [--seed N]\n");
+            printf("       main --pack-archive FILE\n");
+            printf("       main --bench checkwin|rng|texture-cache|bots|solver|replay|codec|store|server\n");
+            printf("       main --replay FILE [--seek ROUND] [--headless]\n");
+            printf("       main --import REPLAY [--store DIR]\n");
+            printf("       main --serve [--socket PATH | --port N] [--io auto|uring|epoll] [--rules rps|rpsls|N]\n");
+            printf("       main --loadgen SESSIONS [--connections N] [--pipeline N] [--rounds N] [--ai NAME] [--threads N] [--socket PATH | --port N]\n");
+            printf("       main --query none|player|computer|outcome|streak|hour|session|ai [--where COLUMN:MIN:MAX]... [--store DIR]\n");
+            printf("       main --solve [--payoff FILE] [--rules rps|rpsls|N] [--threads N]\n");
+            printf("       main --train BATCHES [--policy FILE] [--policy-order K] [--train-against NAME] [--threads N] [--seed N]\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void renderScene(const GameSession& session)
+{
+    gProfiler.begin(PROFILE_CLEAR);
+
+    //Clear screen
+    SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
+    SDL_RenderClear(gRenderer);
+
+    //Fill background
+    SDL_Rect bgRect = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+    SDL_SetRenderDrawColor(gRenderer, 172, 202, 250, 0xFF);
+    SDL_RenderFillRect(gRenderer, &bgRect);
+    gDrawCalls += 2;
+
+    gProfiler.end(PROFILE_CLEAR);
+    gProfiler.begin(PROFILE_TEXT);
+    gWelcome.render(20, 20);
+    gProfiler.end(PROFILE_TEXT);
+    gProfiler.begin(PROFILE_SPRITES);
+
+    drawWeapon(session.pChoice, 80, 200);
+    drawWeapon(session.cChoice, 400, 200);
+
+    //Submit both hands as one batch
+    gSprites.flush();
+
+    gProfiler.end(PROFILE_SPRITES);
+    gProfiler.begin(PROFILE_TEXT);
+
+    switch (session.winner)
+    {
+    case 1:
+        gWin.render((SCREEN_WIDTH - gWin.getWidth()) / 2, 100);
+        break;
+
+    case 2:
+        gLoss.render((SCREEN_WIDTH - gLoss.getWidth()) / 2, 100);
+        break;
+    
+    case 3:
+        gDraw.render((SCREEN_WIDTH - gDraw.getWidth()) / 2, 100);
+        break;
+    
+    default:
+        break;
+    }
+
+    //Replays advance on their own
+    if (session.winner != 0 && !gReplay.isOpen())
+    {
+        gRetry.render((SCREEN_WIDTH - gRetry.getWidth()) / 2, 130);
+    }
+
+    if (gTypedMove > 0)
+    {
+        char typed[32];
+        SDL_Color black = { 0, 0, 0, 0xFF };
+        snprintf(typed, sizeof(typed), "Weapon %d_", gTypedMove);
+        gHudText.render((SCREEN_WIDTH - gHudText.measure(typed)) / 2, 130, typed, black);
+    }
+
+    //Scoreboard
+    char hud[128];
+    SDL_Color black = { 0, 0, 0, 0xFF };
+    const Scoreboard& score = session.score;
+    if (gReplay.isOpen())
+    {
+        snprintf(hud, sizeof(hud), "Replay %d / %llu    Wins %d    Losses %d    Draws %d", score.rounds, (unsigned long long)gReplay.getCount(), score.wins, score.losses, score.draws);
+    }
+    else
+    {
+        snprintf(hud, sizeof(hud), "Round %d    Wins %d    Losses %d    Draws %d    Streak %d", score.rounds, score.wins, score.losses, score.draws, score.streak);
+    }
+    gHudText.render((SCREEN_WIDTH - gHudText.measure(hud)) / 2, SCREEN_HEIGHT - 20 - gHudText.getHeight(), hud, black);
+
+    gProfiler.end(PROFILE_TEXT);
+
+    if (gReplay.isOpen())
+    {
+        renderScrubber();
+    }
+}
+
+void renderScrubber()
+{
+    //Track, then the played part, then the position handle
+    SDL_Rect bar = REPLAY_SCRUBBER;
+    SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
+    SDL_RenderFillRect(gRenderer, &bar);
+
+    Uint64 count = gReplay.getCount() > 0 ? gReplay.getCount() : 1;
+    bar.w = (int)(REPLAY_SCRUBBER.w * gReplayNext / count);
+    SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0xFF);
+    SDL_RenderFillRect(gRenderer, &bar);
+
+    SDL_Rect handle = { REPLAY_SCRUBBER.x + bar.w - 2, REPLAY_SCRUBBER.y - 4, 4, REPLAY_SCRUBBER.h + 8 };
+    SDL_RenderFillRect(gRenderer, &handle);
+}
+
+void drawWeapon(int move, int x, int y)
+{
+    if (move < 1 || move > gRules.getCount())
+    {
+        return;
+    }
+
+    if (gRules.getImage(move) != NULL)
+    {
+        gWeaponTextures[move - 1].render(x, y);
+        return;
+    }
+
+    const char* name = gRules.getName(move);
+    SDL_Color black = { 0, 0, 0, 0xFF };
+    gHudText.render(x + (WEAPON_SIZE - gHudText.measure(name)) / 2, y + (WEAPON_SIZE - gHudText.getHeight()) / 2, name, black);
+}
+
+void buildWelcomeMessage()
+{
+    //The default text already covers rock paper scissors
+    int weapons = gRules.getCount();
+    if (weapons == 3)
+    {
+        return;
+    }
+
+    //Named weapons fit on one line, bigger sets only get the key range
+    if (weapons > 9)
+    {
+        snprintf(gWelcomeMessage, sizeof(gWelcomeMessage), "Type a weapon number from 1 to %d, Enter plays it.", weapons);
+        return;
+    }
+
+    if (weapons > WEAPON_COUNT)
+    {
+        snprintf(gWelcomeMessage, sizeof(gWelcomeMessage), "Use keys 1-%d to pick one of %d weapons.", weapons < 9 ? weapons : 9, weapons);
+        return;
+    }
+
+    int length = snprintf(gWelcomeMessage, sizeof(gWelcomeMessage), "Keys:");
+    for (int move = 1; move <= weapons; ++move)
+    {
+        length += snprintf(gWelcomeMessage + length, sizeof(gWelcomeMessage) - length, "%s %d %s", move > 1 ? "," : "", move, gRules.getName(move));
+    }
+    snprintf(gWelcomeMessage + length, sizeof(gWelcomeMessage) - length, ".");
+}
+
+void drawFrame(const GameSession& session)
+{
+    //Draw straight to the window when there's no cache target
+    if (gFrameCache == NULL)
+    {
+        renderScene(session);
+        return;
+    }
+
+    //Recompose only when the state changed since the cached frame
+    if (gCachedFrame[0] != session.pChoice || gCachedFrame[1] != session.cChoice || gCachedFrame[2] != session.winner || gCachedFrame[3] != session.score.rounds)
+    {
+        SDL_SetRenderTarget(gRenderer, gFrameCache);
+        renderScene(session);
+        SDL_SetRenderTarget(gRenderer, NULL);
+
+        gCachedFrame[0] = session.pChoice;
+        gCachedFrame[1] = session.cChoice;
+        gCachedFrame[2] = session.winner;
+        gCachedFrame[3] = session.score.rounds;
+        ++gFrameCacheMisses;
+    }
+    else
+    {
+        ++gFrameCacheHits;
+    }
+
+    SDL_RenderCopy(gRenderer, gFrameCache, NULL, NULL);
+    ++gDrawCalls;
+}
+
+void renderProfiler()
+{
+    //Dim a panel behind the numbers
+    SDL_Rect panel = { 10, 55, 330, 20 + PROFILE_SECTION_COUNT * gHudText.getHeight() + gHudText.getHeight() };
+    SDL_SetRenderDrawBlendMode(gRenderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0xB0);
+    SDL_RenderFillRect(gRenderer, &panel);
+    SDL_SetRenderDrawBlendMode(gRenderer, SDL_BLENDMODE_NONE);
+    ++gDrawCalls;
+
+    SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+    char line[96];
+    int y = panel.y + 10;
+    snprintf(line, sizeof(line), "%-8s %8s %8s %8s", "ms", "p50", "p99", "max");
+    gHudText.render(panel.x + 10, y, line, white);
+
+    for (int s = 0; s < PROFILE_SECTION_COUNT; ++s)
+    {
+        y += gHudText.getHeight();
+        double p50, p99, max;
+        if (gProfiler.getStats(s, p50, p99, max))
+        {
+            snprintf(line, sizeof(line), "%-8s %8.3f %8.3f %8.3f", PROFILE_SECTION_NAMES[s], p50, p99, max);
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "%-8s %8s %8s %8s", PROFILE_SECTION_NAMES[s], "-", "-", "-");
+        }
+        gHudText.render(panel.x + 10, y, line, white);
+    }
+}
+
+void invalidateFrameCache()
+{
+    gCachedFrame[0] = -1;
+    gCachedFrame[1] = -1;
+    gCachedFrame[2] = -1;
+    gCachedFrame[3] = -1;
+}
+
+//Builds a weapon number from digit keys when there are more weapons than keys 1-9, returns the move once no
+//further digit could follow or on Enter, otherwise 0. Backspace deletes the last digit.
+static int typeMove(SDL_Keycode key)
+{
+    if (key >= SDLK_0 && key <= SDLK_9)
+    {
+        int typed = gTypedMove * 10 + (int)(key - SDLK_0);
+        if (typed == 0 || typed > gRules.getCount())
+        {
+            return 0;
+        }
+
+        gTypedMove = typed;
+        if (typed * 10 > gRules.getCount())
+        {
+            gTypedMove = 0;
+            return typed;
+        }
+        return 0;
+    }
+
+    if ((key == SDLK_RETURN || key == SDLK_KP_ENTER) && gTypedMove > 0)
+    {
+        int typed = gTypedMove;
+        gTypedMove = 0;
+        return typed;
+    }
+
+    if (key == SDLK_BACKSPACE)
+    {
+        gTypedMove /= 10;
+    }
+    return 0;
+}
+
+bool handleEvent(SDL_Event& e, bool& quit, GameSession& session)
+{
+    //User requests quit
+    if (e.type == SDL_QUIT)
+    {
+        quit = true;
+        return false;
+    }
+
+    //Render targets lost their contents, the cached frame has to be redrawn
+    if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET)
+    {
+        invalidateFrameCache();
+        return true;
+    }
+
+    //Window contents were lost or resized
+    if (e.type == SDL_WINDOWEVENT)
+    {
+        switch (e.window.event)
+        {
+        case SDL_WINDOWEVENT_EXPOSED:
+        case SDL_WINDOWEVENT_SIZE_CHANGED:
+        case SDL_WINDOWEVENT_RESTORED:
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    //Clicking or dragging along the replay scrubber seeks
+    if (gReplay.isOpen() && (e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_MOUSEMOTION || e.type == SDL_MOUSEBUTTONUP))
+    {
+        if (e.type == SDL_MOUSEBUTTONUP)
+        {
+            gScrubbing = false;
+            return false;
+        }
+
+        int x = e.type == SDL_MOUSEMOTION ? e.motion.x : e.button.x;
+        int y = e.type == SDL_MOUSEMOTION ? e.motion.y : e.button.y;
+        if (e.type == SDL_MOUSEBUTTONDOWN)
+        {
+            gScrubbing = e.button.button == SDL_BUTTON_LEFT && x >= REPLAY_SCRUBBER.x - 4 && x < REPLAY_SCRUBBER.x + REPLAY_SCRUBBER.w + 4 &&
+                y >= REPLAY_SCRUBBER.y - 8 && y < REPLAY_SCRUBBER.y + REPLAY_SCRUBBER.h + 8;
+        }
+
+        if (!gScrubbing)
+        {
+            return false;
+        }
+
+        int offset = x - REPLAY_SCRUBBER.x;
+        offset = offset < 0 ? 0 : (offset > REPLAY_SCRUBBER.w ? REPLAY_SCRUBBER.w : offset);
+        Uint64 target = gReplay.getCount() * offset / REPLAY_SCRUBBER.w;
+        if (target == gReplayNext)
+        {
+            return false;
+        }
+
+        seekReplay(target, session);
+        return true;
+    }
+
+    if (e.type != SDL_KEYDOWN)
+    {
+        return false;
+    }
+
+    //Profiler overlay toggles at any time
+    if (e.key.keysym.sym == SDLK_F3)
+    {
+        gShowProfiler = !gShowProfiler;
+        return true;
+    }
+
+    //Replays only take playback keys: Space pauses, Right steps one round, Left steps back,
+    //Page Up and Page Down jump a tenth of the replay, Home and End go to either end
+    if (gReplay.isOpen())
+    {
+        if (e.key.keysym.sym == SDLK_SPACE)
+        {
+            gReplayPaused = !gReplayPaused;
+            gReplayDue = SDL_GetPerformanceCounter();
+            return false;
+        }
+
+        if (e.key.keysym.sym == SDLK_RIGHT)
+        {
+            return stepReplay(session);
+        }
+
+        Uint64 jump = gReplay.getCount() / 10 > 0 ? gReplay.getCount() / 10 : 1;
+        switch (e.key.keysym.sym)
+        {
+        case SDLK_LEFT:
+            seekReplay(gReplayNext > 0 ? gReplayNext - 1 : 0, session);
+            return true;
+
+        case SDLK_PAGEDOWN:
+            seekReplay(gReplayNext + jump, session);
+            return true;
+
+        case SDLK_PAGEUP:
+            seekReplay(gReplayNext > jump ? gReplayNext - jump : 0, session);
+            return true;
+
+        case SDLK_HOME:
+            seekReplay(0, session);
+            return true;
+
+        case SDLK_END:
+            seekReplay(gReplay.getCount(), session);
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    if (session.winner == 0)
+    {
+        int typed = gTypedMove;
+        int move = gRules.getCount() > 9 ? typeMove(e.key.keysym.sym) : gRules.getMove(e.key.keysym.sym);
+        if (move == 0)
+        {
+            //The digits typed so far are drawn over the board, which the frame cache doesn't know about
+            if (gTypedMove != typed)
+            {
+                invalidateFrameCache();
+                return true;
+            }
+            return false;
+        }
+
+        playRound(session, move, *gComputer);
+        recordRound(session);
+        return true;
+    }
+
+    if (e.key.keysym.sym == SDLK_SPACE)
+    {
+        resetRound(session);
+        return true;
+    }
+
+    return false;
+}
+
+//
+// LRuleSet functions
+//
+
+
+LRuleSet::LRuleSet()
+{
+    create(3);
+}
+
+bool LRuleSet::create(int weapons)
+{
+    if (weapons < 3 || weapons > MAX_WEAPONS || weapons % 2 == 0)
+    {
+        return false;
+    }
+
+    mCount = weapons;
+    mNames.clear();
+    mKeys.clear();
+    for (int i = 0; i < weapons; ++i)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "Weapon %d", i + 1);
+        mNames.push_back(i < WEAPON_COUNT ? WEAPONS[i].name : name);
+        mKeys.push_back(i < WEAPON_COUNT ? WEAPONS[i].key : (i < 9 ? SDLK_1 + i : SDLK_UNKNOWN));
+    }
+
+    //Common sizes get their constexpr table so an outcome is one load
+    mBeats.clear();
+    switch (weapons)
+    {
+    case 3:
+        mTable = &LRules<3>::TABLE.outcome[0][0];
+        return true;
+
+    case 5:
+        mTable = &LRules<5>::TABLE.outcome[0][0];
+        return true;
+
+    case 7:
+        mTable = &LRules<7>::TABLE.outcome[0][0];
+        return true;
+
+    default:
+        mTable = NULL;
+        break;
+    }
+
+    mBeats.assign(((size_t)weapons * weapons + 63) / 64, 0);
+    for (int a = 0; a < weapons; ++a)
+    {
+        for (int b = 0; b < weapons; ++b)
+        {
+            if ((a - b + weapons) % weapons % 2 == 1)
+            {
+                size_t bit = (size_t)a * weapons + b;
+                mBeats[bit >> 6] |= (Uint64)1 << (bit & 63);
+            }
+        }
+    }
+
+    return true;
+}
+
+int LRuleSet::outcome(int p, int c)
+{
+    if ((unsigned)p > (unsigned)mCount || (unsigned)c > (unsigned)mCount)
+    {
+        return 0;
+    }
+
+    if (mTable != NULL)
+    {
+        return mTable[p * (mCount + 1) + c];
+    }
+
+    if (p == 0 || c == 0)
+    {
+        return 0;
+    }
+
+    if (p == c)
+    {
+        return 3;
+    }
+
+    size_t bit = (size_t)(p - 1) * mCount + (c - 1);
+    return (mBeats[bit >> 6] >> (bit & 63)) & 1 ? 1 : 2;
+}
+
+int LRuleSet::getCount()
+{
+    return mCount;
+}
+
+const char* LRuleSet::getName(int move)
+{
+    return move >= 1 && move <= mCount ? mNames[move - 1].c_str() : "";
+}
+
+const char* LRuleSet::getImage(int move)
+{
+    return move >= 1 && move <= WEAPON_COUNT && move <= mCount ? WEAPONS[move - 1].image : NULL;
+}
+
+int LRuleSet::getMove(SDL_Keycode key)
+{
+    for (int i = 0; i < mCount; ++i)
+    {
+        if (mKeys[i] == key && key != SDLK_UNKNOWN)
+        {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+//
+// LRandom functions
+//
+
+
+LRandom::LRandom(uint64_t seed)
+{
+    this->seed(seed);
+}
+
+void LRandom::seed(uint64_t seed)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        seed += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        mState[i] = z ^ (z >> 31);
+    }
+}
+
+void LRandom::jump()
+{
+    static const uint64_t JUMP[4] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+
+    uint64_t state[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; ++i)
+    {
+        for (int b = 0; b < 64; ++b)
+        {
+            if (JUMP[i] & (1ULL << b))
+            {
+                for (int j = 0; j < 4; ++j)
+                {
+                    state[j] ^= mState[j];
+                }
+            }
+            next();
+        }
+    }
+
+    for (int j = 0; j < 4; ++j)
+    {
+        mState[j] = state[j];
+    }
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+uint64_t LRandom::next()
+{
+    uint64_t result = rotl(mState[1] * 5, 7) * 9;
+    uint64_t t = mState[1] << 17;
+
+    mState[2] ^= mState[0];
+    mState[3] ^= mState[1];
+    mState[1] ^= mState[2];
+    mState[0] ^= mState[3];
+    mState[2] ^= t;
+    mState[3] = rotl(mState[3], 45);
+
+    return result;
+}
+
+uint32_t LRandom::range(uint32_t range)
+{
+    //Multiply into the top 32 bits, rejecting the few low values that would bias it
+    uint64_t m = (next() >> 32) * range;
+    uint32_t low = (uint32_t)m;
+    if (low < range)
+    {
+        uint32_t threshold = (0U - range) % range;
+        while (low < threshold)
+        {
+            m = (next() >> 32) * range;
+            low = (uint32_t)m;
+        }
+    }
+
+    return (uint32_t)(m >> 32);
+}
+
+int LRandom::move()
+{
+    return (int)range(3) + 1;
+}
+
+void LRandom::fill(uint8_t* out, size_t n)
+{
+    //Bytes 0-254 split evenly into three, 255 is dropped
+    size_t i = 0;
+    while (i < n)
+    {
+        uint64_t bits = next();
+        for (int b = 0; b < 8 && i < n; ++b, bits >>= 8)
+        {
+            unsigned byte = (unsigned)(bits & 0xFF);
+            if (byte != 0xFF)
+            {
+                out[i++] = (uint8_t)(byte % 3 + 1);
+            }
+        }
+    }
+}
+
+LRandom& threadRandom()
+{
+    //Each thread takes the next stream the first time it asks
+    static thread_local LRandom random;
+    static thread_local bool seeded = false;
+    if (!seeded)
+    {
+        int stream = SDL_AtomicAdd(&gRandomStreams, 1);
+        random.seed(gSeed);
+        for (int i = 0; i < stream; ++i)
+        {
+            random.jump();
+        }
+        seeded = true;
+    }
+
+    return random;
+}
+
+//
+// Bot functions
+//
+
+
+//Appends a value's bytes to a bot snapshot
+template <typename T>
+static void saveValue(std::vector<Uint8>& out, const T& value)
+{
+    const Uint8* bytes = (const Uint8*)&value;
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+//Reads a value from a bot snapshot and moves past it, false if the snapshot is too short
+template <typename T>
+static bool loadValue(const Uint8*& data, const Uint8* end, T& value)
+{
+    if ((size_t)(end - data) < sizeof(T))
+    {
+        return false;
+    }
+
+    memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return true;
+}
+
+LRandomBot::LRandomBot(int weapons)
+{
+    mWeapons = weapons;
+    reset(threadRandom().next());
+}
+
+void LRandomBot::reset(uint64_t seed)
+{
+    mRandom.seed(seed);
+}
+
+int LRandomBot::move()
+{
+    return mWeapons == 3 ? mRandom.move() : (int)mRandom.range(mWeapons) + 1;
+}
+
+bool LRandomBot::save(std::vector<Uint8>& out)
+{
+    saveValue(out, mRandom);
+    return true;
+}
+
+bool LRandomBot::load(const Uint8* data, size_t size)
+{
+    const Uint8* end = data + size;
+    return loadValue(data, end, mRandom) && data == end;
+}
+
+LConstantBot::LConstantBot(int move)
+{
+    mMove = move;
+}
+
+int LConstantBot::move()
+{
+    return mMove;
+}
+
+bool LConstantBot::save(std::vector<Uint8>& out)
+{
+    return true;
+}
+
+bool LConstantBot::load(const Uint8* data, size_t size)
+{
+    return size == 0;
+}
+
+LCycleBot::LCycleBot()
+{
+    reset(0);
+}
+
+void LCycleBot::reset(uint64_t seed)
+{
+    mNext = 1;
+}
+
+int LCycleBot::move()
+{
+    int move = mNext;
+    mNext = mNext % 3 + 1;
+    return move;
+}
+
+bool LCycleBot::save(std::vector<Uint8>& out)
+{
+    saveValue(out, mNext);
+    return true;
+}
+
+bool LCycleBot::load(const Uint8* data, size_t size)
+{
+    const Uint8* end = data + size;
+    return loadValue(data, end, mNext) && data == end;
+}
+
+LCopyBot::LCopyBot()
+{
+    reset(0);
+}
+
+void LCopyBot::reset(uint64_t seed)
+{
+    mLast = 1;
+}
+
+int LCopyBot::move()
+{
+    return mLast;
+}
+
+void LCopyBot::observe(int mine, int theirs)
+{
+    mLast = theirs;
+}
+
+bool LCopyBot::save(std::vector<Uint8>& out)
+{
+    saveValue(out, mLast);
+    return true;
+}
+
+bool LCopyBot::load(const Uint8* data, size_t size)
+{
+    const Uint8* end = data + size;
+    return loadValue(data, end, mLast) && data == end;
+}
+
+LBeatLastBot::LBeatLastBot()
+{
+    reset(0);
+}
+
+void LBeatLastBot::reset(uint64_t seed)
+{
+    mLast = 1;
+}
+
+int LBeatLastBot::move()
+{
+    return mLast % 3 + 1;
+}
+
+void LBeatLastBot::observe(int mine, int theirs)
+{
+    mLast = theirs;
+}
+
+bool LBeatLastBot::save(std::vector<Uint8>& out)
+{
+    saveValue(out, mLast);
+    return true;
+}
+
+bool LBeatLastBot::load(const Uint8* data, size_t size)
+{
+    const Uint8* end = data + size;
+    return loadValue(data, end, mLast) && data == end;
+}
+
+LMarkovBot::LMarkovBot(int order)
+{
+    mOrder = order < 1 ? 1 : (order > MAX_ORDER ? MAX_ORDER : order);
+    mContexts = 1;
+    for (int i = 0; i < mOrder; ++i)
+    {
+        mContexts *= 3;
+    }
+    mCounts.resize(mContexts * 4);
+    reset(threadRandom().next());
+}
+
+void LMarkovBot::reset(uint64_t seed)
+{
+    std::fill(mCounts.begin(), mCounts.end(), 0);
+    mContext = 0;
+    mRandom.seed(seed);
+}
+
+int LMarkovBot::predict()
+{
+    const Uint16* counts = &mCounts[mContext * 4];
+    Uint16 best = counts[0] > counts[1] ? counts[0] : counts[1];
+    best = best > counts[2] ? best : counts[2];
+    if (best == 0)
+    {
+        return 0;
+    }
+
+    //Pick among the most frequent moves at random so ties can't be exploited
+    int candidates[3];
+    int n = 0;
+    for (int m = 0; m < 3; ++m)
+    {
+        if (counts[m] == best)
+        {
+            candidates[n++] = m + 1;
+        }
+    }
+
+    return n == 1 ? candidates[0] : candidates[mRandom.range(n)];
+}
+
+bool LMarkovBot::save(std::vector<Uint8>& out)
+{
+    saveValue(out, mContext);
+    saveValue(out, mRandom);
+    const Uint8* counts = (const Uint8*)&mCounts[0];
+    out.insert(out.end(), counts, counts + mCounts.size() * sizeof(Uint16));
+    return true;
+}
+
+bool LMarkovBot::load(const Uint8* data, size_t size)
+{
+    //Only fits a model of the same order
+    const Uint8* end = data + size;
+    Uint32 context;
+    LRandom random;
+    if (!loadValue(data, end, context) || !loadValue(data, end, random) || context >= mContexts || (size_t)(end - data) != mCounts.size() * sizeof(Uint16))
+    {
+        return false;
+    }
+
+    mContext = context;
+    mRandom = random;
+    memcpy(&mCounts[0], data, mCounts.size() * sizeof(Uint16));
+    return true;
+}
+
+int LMarkovBot::move()
+{
+    int predicted = predict();
+    return predicted == 0 ? mRandom.move() : predicted % 3 + 1;
+}
+
+void LMarkovBot::observe(int mine, int theirs)
+{
+    Uint16* counts = &mCounts[mContext * 4];
+    if (++counts[theirs - 1] == 0xFFFF)
+    {
+        //Halve on saturation, which also lets old habits fade
+        counts[0] >>= 1;
+        counts[1] >>= 1;
+        counts[2] >>= 1;
+    }
+
+    mContext = (mContext * 3 + (Uint32)(theirs - 1)) % mContexts;
+}
+
+LHistoryBot::LHistoryBot(int window)
+{
+    mWindow = window;
+    reset(threadRandom().next());
+}
+
+void LHistoryBot::reset(uint64_t seed)
+{
+    mLog.clear();
+    mStates.clear();
+
+    State root;
+    root.len = 0;
+    root.link = -1;
+    root.firstPos = -1;
+    std::fill(root.next, root.next + 9, -1);
+    mStates.push_back(root);
+
+    mLast = 0;
+    mMatch = 0;
+    mRandom.seed(seed);
+}
+
+void LHistoryBot::extend(int symbol)
+{
+    int pos = (int)mLog.size() - 1;
+    int cur = (int)mStates.size();
+    State state;
+    state.len = mStates[mLast].len + 1;
+    state.link = 0;
+    state.firstPos = pos;
+    std::fill(state.next, state.next + 9, -1);
+    mStates.push_back(state);
+
+    int p = mLast;
+    while (p != -1 && mStates[p].next[symbol] == -1)
+    {
+        mStates[p].next[symbol] = cur;
+        p = mStates[p].link;
+    }
+
+    if (p != -1)
+    {
+        int q = mStates[p].next[symbol];
+        if (mStates[p].len + 1 == mStates[q].len)
+        {
+            mStates[cur].link = q;
+        }
+        else
+        {
+            //Split q so the shorter suffix gets its own state
+            State clone = mStates[q];
+            clone.len = mStates[p].len + 1;
+            int cloned = (int)mStates.size();
+            mStates.push_back(clone);
+
+            while (p != -1 && mStates[p].next[symbol] == q)
+            {
+                mStates[p].next[symbol] = cloned;
+                p = mStates[p].link;
+            }
+            mStates[q].link = cloned;
+            mStates[cur].link = cloned;
+        }
+    }
+
+    mLast = cur;
+}
+
+void LHistoryBot::rebuild()
+{
+    std::vector<uint8_t> recent(mLog.end() - mWindow / 2, mLog.end());
+    mLog.clear();
+    mStates.resize(1);
+    std::fill(mStates[0].next, mStates[0].next + 9, -1);
+    mLast = 0;
+
+    for (size_t i = 0; i < recent.size(); ++i)
+    {
+        mLog.push_back(recent[i]);
+        extend(recent[i]);
+    }
+}
+
+int LHistoryBot::getMatchLength()
+{
+    return mStates[mMatch].len;
+}
+
+int LHistoryBot::predict()
+{
+    if (mMatch == 0)
+    {
+        return 0;
+    }
+
+    //The round after the earlier occurrence tells us what the opponent did in this spot last time
+    return mLog[mStates[mMatch].firstPos + 1] % 3 + 1;
+}
+
+int LHistoryBot::move()
+{
+    int predicted = predict();
+    return predicted == 0 ? mRandom.move() : predicted % 3 + 1;
+}
+
+void LHistoryBot::observe(int mine, int theirs)
+{
+    if ((int)mLog.size() == mWindow)
+    {
+        rebuild();
+    }
+
+    uint8_t symbol = (uint8_t)((mine - 1) * 3 + (theirs - 1));
+    mLog.push_back(symbol);
+    extend(symbol);
+
+    //The longest suffix of the log that also ended earlier is the last state's suffix link
+    mMatch = mStates[mLast].link;
+}
+
+LEnsembleBot::LEnsembleBot() : mHistory{ LHistoryBot(HISTORY_WINDOW), LHistoryBot(HISTORY_WINDOW) }
+{
+    const int orders[] = { 1, 2, 4 };
+    for (int side = 0; side < 2; ++side)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            mMarkov.push_back(LMarkovBot(orders[i]));
+        }
+    }
+
+    reset(threadRandom().next());
+}
+
+void LEnsembleBot::reset(uint64_t seed)
+{
+    mRandom.seed(seed);
+    memset(mFrequency, 0, sizeof(mFrequency));
+    for (size_t i = 0; i < mMarkov.size(); ++i)
+    {
+        mMarkov[i].reset(mRandom.next());
+    }
+    mHistory[0].reset(mRandom.next());
+    mHistory[1].reset(mRandom.next());
+
+    std::fill(mScores, mScores + CANDIDATES, 0.0f);
+    prepare();
+}
+
+void LEnsembleBot::prepare()
+{
+    std::fill(mMoves, mMoves + CANDIDATES, 0);
+
+    for (int side = 0; side < 2; ++side)
+    {
+        int guesses[PREDICTORS];
+        const Uint32* counts = mFrequency[side];
+        guesses[0] = counts[0] + counts[1] + counts[2] == 0 ? 0 :
+            (counts[0] >= counts[1] ? (counts[0] >= counts[2] ? 1 : 3) : (counts[1] >= counts[2] ? 2 : 3));
+        guesses[1] = mMarkov[side * 3].predict();
+        guesses[2] = mMarkov[side * 3 + 1].predict();
+        guesses[3] = mMarkov[side * 3 + 2].predict();
+        guesses[4] = mHistory[side].predict();
+
+        for (int i = 0; i < PREDICTORS; ++i)
+        {
+            int theirs = guesses[i];
+            if (theirs == 0)
+            {
+                continue;
+            }
+
+            //A guess at our own move means the opponent will play what beats it
+            if (side == 1)
+            {
+                theirs = theirs % 3 + 1;
+            }
+
+            //Rotation 0 beats the guess, 1 beats an opponent who saw that coming, 2 beats the next level up
+            Sint32* moves = &mMoves[(side * PREDICTORS + i) * 3];
+            moves[0] = theirs % 3 + 1;
+            moves[1] = moves[0] % 3 + 1;
+            moves[2] = moves[1] % 3 + 1;
+        }
+    }
+}
+
+int LEnsembleBot::move()
+{
+    int best = 0;
+    for (int c = 1; c < CANDIDATES; ++c)
+    {
+        if (mScores[c] > mScores[best])
+        {
+            best = c;
+        }
+    }
+
+    //Nobody's ahead, so nothing's been learned that beats chance
+    if (mScores[best] <= 0.0f || mMoves[best] == 0)
+    {
+        return mRandom.move();
+    }
+
+    return mMoves[best];
+}
+
+void LEnsembleBot::observe(int mine, int theirs)
+{
+    //Score every candidate against what the opponent actually played, decaying old results
+    const float DECAY = 0.95f;
+#if defined(HAVE_X86_KERNELS) && defined(__SSE2__)
+    //Candidate wins when move - theirs is 1 or -2 and loses when it's -1 or 2
+    const __m128i actual = _mm_set1_epi32(theirs);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    const __m128i minusOne = _mm_set1_epi32(-1);
+    const __m128i minusTwo = _mm_set1_epi32(-2);
+    const __m128 decay = _mm_set1_ps(DECAY);
+    const __m128 unit = _mm_set1_ps(1.0f);
+    for (int c = 0; c < CANDIDATES; c += 4)
+    {
+        __m128i moves = _mm_load_si128((const __m128i*)&mMoves[c]);
+        __m128i guessed = _mm_xor_si128(_mm_cmpeq_epi32(moves, zero), _mm_set1_epi32(-1));
+        __m128i d = _mm_sub_epi32(moves, actual);
+        __m128i win = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi32(d, one), _mm_cmpeq_epi32(d, minusTwo)), guessed);
+        __m128i loss = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi32(d, minusOne), _mm_cmpeq_epi32(d, two)), guessed);
+
+        __m128 result = _mm_sub_ps(_mm_and_ps(_mm_castsi128_ps(win), unit), _mm_and_ps(_mm_castsi128_ps(loss), unit));
+        __m128 scores = _mm_load_ps(&mScores[c]);
+        _mm_store_ps(&mScores[c], _mm_add_ps(_mm_mul_ps(scores, decay), result));
+    }
+#else
+    for (int c = 0; c < CANDIDATES; ++c)
+    {
+        float result = 0.0f;
+        if (mMoves[c] != 0)
+        {
+            int d = mMoves[c] - theirs;
+            result = (d == 1 || d == -2) ? 1.0f : ((d == -1 || d == 2) ? -1.0f : 0.0f);
+        }
+        mScores[c] = mScores[c] * DECAY + result;
+    }
+#endif
+
+    //Side 0 learns the opponent's habits, side 1 sees the game from their seat and learns ours
+    ++mFrequency[0][theirs - 1];
+    ++mFrequency[1][mine - 1];
+    for (int i = 0; i < 3; ++i)
+    {
+        mMarkov[i].observe(mine, theirs);
+        mMarkov[3 + i].observe(theirs, mine);
+    }
+    mHistory[0].observe(mine, theirs);
+    mHistory[1].observe(theirs, mine);
+
+    prepare();
+}
+
+LEquilibriumBot::LEquilibriumBot(const std::vector<float>& strategy)
+{
+    float total = 0.0f;
+    for (size_t i = 0; i < strategy.size(); ++i)
+    {
+        total += strategy[i];
+        mCumulative.push_back(total);
+    }
+    reset(threadRandom().next());
+}
+
+void LEquilibriumBot::reset(uint64_t seed)
+{
+    mRandom.seed(seed);
+}
+
+int LEquilibriumBot::move()
+{
+    if (mCumulative.empty())
+    {
+        return mRandom.move();
+    }
+
+    //24 random bits scaled to the total, then the first move whose running sum passes it
+    float u = (float)(mRandom.next() >> 40) * (1.0f / 16777216.0f) * mCumulative.back();
+    size_t move = std::upper_bound(mCumulative.begin(), mCumulative.end(), u) - mCumulative.begin();
+    return move < mCumulative.size() ? (int)move + 1 : (int)mCumulative.size();
+}
+
+bool LEquilibriumBot::save(std::vector<Uint8>& out)
+{
+    saveValue(out, mRandom);
+    return true;
+}
+
+bool LEquilibriumBot::load(const Uint8* data, size_t size)
+{
+    const Uint8* end = data + size;
+    return loadValue(data, end, mRandom) && data == end;
+}
+
+//Solves the payoffs in play, the rules' unless a usable matrix was given
+static std::vector<float> solveEquilibrium()
+{
+    LSolver solver;
+    int weapons = gRules.getCount();
+    //load prints why a matrix couldn't be read
+    bool loaded = gPayoffPath != NULL && solver.load(gPayoffPath);
+    if (loaded && (solver.getRows() != weapons || solver.getCols() != weapons))
+    {
+        printf("Payoff matrix %s is %dx%d but there are %d weapons, using the rules.\n", gPayoffPath, solver.getRows(), solver.getCols(), weapons);
+        solver.setRules(gRules);
+    }
+    else if (!loaded)
+    {
+        if (gPayoffPath != NULL)
+        {
+            printf("Using the rules instead of payoff matrix %s.\n", gPayoffPath);
+        }
+        solver.setRules(gRules);
+    }
+
+    std::vector<float> strategy;
+    if (solver.getRows() == weapons)
+    {
+        solver.solve(1e-4f, 100000, 1);
+        strategy = solver.getRowStrategy();
+    }
+    return strategy;
+}
+
+//Equilibrium of the payoffs in play, solved once on first use
+static const std::vector<float>& getEquilibrium()
+{
+    static const std::vector<float> strategy = solveEquilibrium();
+    return strategy;
+}
+
+LPolicyBot::LPolicyBot(int order, const std::vector<float>& strategy)
+{
+    mContexts = 1;
+    for (int i = 0; i < order; ++i)
+    {
+        mContexts *= 9;
+    }
+    mStrategy = &strategy;
+    reset(threadRandom().next());
+}
+
+void LPolicyBot::reset(uint64_t seed)
+{
+    mContext = 0;
+    mRandom.seed(seed);
+}
+
+int LPolicyBot::move()
+{
+    if (mStrategy->size() < (size_t)mContexts * 4)
+    {
+        return mRandom.move();
+    }
+
+    const float* strategy = &(*mStrategy)[mContext * 4];
+    float u = (float)(mRandom.next() >> 40) * (1.0f / 16777216.0f);
+    return u < strategy[0] ? 1 : (u < strategy[0] + strategy[1] ? 2 : 3);
+}
+
+void LPolicyBot::observe(int mine, int theirs)
+{
+    mContext = (mContext * 9 + (Uint32)((mine - 1) * 3 + (theirs - 1))) % mContexts;
+}
+
+bool LPolicyBot::save(std::vector<Uint8>& out)
+{
+    saveValue(out, mContext);
+    saveValue(out, mRandom);
+    return true;
+}
+
+bool LPolicyBot::load(const Uint8* data, size_t size)
+{
+    const Uint8* end = data + size;
+    Uint32 context;
+    LRandom random;
+    if (!loadValue(data, end, context) || !loadValue(data, end, random) || data != end || context >= mContexts)
+    {
+        return false;
+    }
+
+    mContext = context;
+    mRandom = random;
+    return true;
+}
+
+//A trained policy's average strategy, 4 floats per context, and its order
+struct PolicyStrategy
+{
+    int order;
+    std::vector<float> strategy;
+};
+
+//Averages the policy file's regret sums into a strategy, empty when there's no usable file
+static PolicyStrategy loadPolicyStrategy()
+{
+    PolicyStrategy result;
+    result.order = 0;
+    PolicyTables policy;
+    if (loadPolicy(gPolicyPath, policy))
+    {
+        result.order = policy.order;
+        result.strategy.assign((size_t)policy.contexts * 4, 0.0f);
+        for (Uint32 c = 0; c < policy.contexts; ++c)
+        {
+            const double* sums = &policy.sums[c * 3];
+            double total = sums[0] + sums[1] + sums[2];
+            for (int m = 0; m < 3; ++m)
+            {
+                result.strategy[c * 4 + m] = total > 0.0 ? (float)(sums[m] / total) : 1.0f / 3;
+            }
+        }
+    }
+    else if (gPolicyGiven)
+    {
+        printf("No usable policy in %s, playing randomly.\n", gPolicyPath);
+    }
+    return result;
+}
+
+//Average strategy of the trained policy, loaded once on first use
+static const std::vector<float>& getPolicy(int& order)
+{
+    static const PolicyStrategy policy = loadPolicyStrategy();
+    order = policy.order;
+    return policy.strategy;
+}
+
+static LBot* createRandomBot() { return new LRandomBot(gRules.getCount()); }
+static LBot* createRockBot() { return new LConstantBot(1); }
+static LBot* createPaperBot() { return new LConstantBot(2); }
+static LBot* createScissorsBot() { return new LConstantBot(3); }
+static LBot* createCycleBot() { return new LCycleBot(); }
+static LBot* createCopyBot() { return new LCopyBot(); }
+static LBot* createBeatLastBot() { return new LBeatLastBot(); }
+static LBot* createMarkovBot() { return new LMarkovBot(gMarkovOrder); }
+static LBot* createHistoryBot() { return new LHistoryBot(); }
+static LBot* createEnsembleBot() { return new LEnsembleBot(); }
+static LBot* createEquilibriumBot() { return new LEquilibriumBot(getEquilibrium()); }
+
+static LBot* createPolicyBot()
+{
+    int order = 0;
+    const std::vector<float>& strategy = getPolicy(order);
+    return new LPolicyBot(order, strategy);
+}
+
+//Every bot that can be picked by name
+const BotEntry gBots[] = {
+    { "random", createRandomBot, 0 },
+    { "rock", createRockBot, 0 },
+    { "paper", createPaperBot, 0 },
+    { "scissors", createScissorsBot, 0 },
+    { "cycle", createCycleBot, 0 },
+    { "copy", createCopyBot, 0 },
+    { "beatlast", createBeatLastBot, 3 },
+    { "markov", createMarkovBot, 3 },
+    { "history", createHistoryBot, 3 },
+    { "ensemble", createEnsembleBot, 3 },
+    { "equilibrium", createEquilibriumBot, 0 },
+    { "policy", createPolicyBot, 3 }
+};
+const int BOT_COUNT = sizeof(gBots) / sizeof(gBots[0]);
+
+LBot* createBot(const char* name)
+{
+    for (int i = 0; i < BOT_COUNT; ++i)
+    {
+        if (strcmp(gBots[i].name, name) == 0)
+        {
+            //Predictors only know rock paper scissors
+            if (gBots[i].weapons != 0 && gBots[i].weapons != gRules.getCount())
+            {
+                printf("%s only plays %d weapons, using random instead.\n", name, gBots[i].weapons);
+                return createRandomBot();
+            }
+            return gBots[i].create();
+        }
+    }
+
+    return NULL;
+}
+
+//
+// LThreadPool functions
+//
+
+
+LThreadPool::LThreadPool()
+{
+    //Init
+    mLock = NULL;
+    mWake = NULL;
+    mDone = NULL;
+    mGeneration = 0;
+    mPending = 0;
+    mQuit = false;
+    mTask = NULL;
+    mData = NULL;
+}
+
+LThreadPool::~LThreadPool()
+{
+    //Dealloc
+    stop();
+}
+
+bool LThreadPool::start(int threads)
+{
+    stop();
+
+    mLock = SDL_CreateMutex();
+    mWake = SDL_CreateCond();
+    mDone = SDL_CreateCond();
+    if (mLock == NULL || mWake == NULL || mDone == NULL)
+    {
+        printf("Unable to create thread pool sync objects. SDL Error: %s\n", SDL_GetError());
+        stop();
+        return false;
+    }
+
+    mQuit = false;
+    mGeneration = 0;
+    mQueues.resize(threads < 1 ? 1 : threads);
+
+    //Args must not move once threads hold pointers to them
+    mArgs.resize(mQueues.size());
+    for (size_t i = 1; i < mQueues.size(); ++i)
+    {
+        mArgs[i].pool = this;
+        mArgs[i].worker = (int)i;
+        SDL_Thread* thread = SDL_CreateThread(workerMain, "worker", &mArgs[i]);
+        if (thread == NULL)
+        {
+            printf("Unable to create worker thread. SDL Error: %s\n", SDL_GetError());
+            stop();
+            return false;
+        }
+        mThreads.push_back(thread);
+    }
+
+    return true;
+}
+
+void LThreadPool::stop()
+{
+    if (mLock != NULL)
+    {
+        SDL_LockMutex(mLock);
+        mQuit = true;
+        SDL_CondBroadcast(mWake);
+        SDL_UnlockMutex(mLock);
+    }
+
+    for (size_t i = 0; i < mThreads.size(); ++i)
+    {
+        SDL_WaitThread(mThreads[i], NULL);
+    }
+    mThreads.clear();
+    mQueues.clear();
+    mArgs.clear();
+
+    if (mDone != NULL)
+    {
+        SDL_DestroyCond(mDone);
+        mDone = NULL;
+    }
+    if (mWake != NULL)
+    {
+        SDL_DestroyCond(mWake);
+        mWake = NULL;
+    }
+    if (mLock != NULL)
+    {
+        SDL_DestroyMutex(mLock);
+        mLock = NULL;
+    }
+}
+
+void LThreadPool::run(int count, Task task, void* data)
+{
+    //Split the indices evenly, stealing evens out the rest
+    int workers = (int)mQueues.size();
+    for (int w = 0; w < workers; ++w)
+    {
+        SDL_AtomicSet(&mQueues[w].next, (int)((long long)count * w / workers));
+        mQueues[w].end = (int)((long long)count * (w + 1) / workers);
+    }
+
+    SDL_LockMutex(mLock);
+    mTask = task;
+    mData = data;
+    mPending = (int)mThreads.size();
+    ++mGeneration;
+    SDL_CondBroadcast(mWake);
+    SDL_UnlockMutex(mLock);
+
+    work(0);
+
+    SDL_LockMutex(mLock);
+    while (mPending > 0)
+    {
+        SDL_CondWait(mDone, mLock);
+    }
+    SDL_UnlockMutex(mLock);
+}
+
+int LThreadPool::getThreadCount()
+{
+    return (int)mQueues.size();
+}
+
+int LThreadPool::workerMain(void* data)
+{
+    WorkerArgs* args = (WorkerArgs*)data;
+    LThreadPool* pool = args->pool;
+    int generation = 0;
+
+    SDL_LockMutex(pool->mLock);
+    for (;;)
+    {
+        while (!pool->mQuit && pool->mGeneration == generation)
+        {
+            SDL_CondWait(pool->mWake, pool->mLock);
+        }
+        if (pool->mQuit)
+        {
+            break;
+        }
+        generation = pool->mGeneration;
+        SDL_UnlockMutex(pool->mLock);
+
+        pool->work(args->worker);
+
+        SDL_LockMutex(pool->mLock);
+        if (--pool->mPending == 0)
+        {
+            SDL_CondSignal(pool->mDone);
+        }
+    }
+    SDL_UnlockMutex(pool->mLock);
+
+    return 0;
+}
+
+void LThreadPool::work(int worker)
+{
+    //Drain own queue first, then steal from the others in turn
+    int workers = (int)mQueues.size();
+    for (int i = 0; i < workers; ++i)
+    {
+        Queue& queue = mQueues[(worker + i) % workers];
+        for (;;)
+        {
+            int index = SDL_AtomicAdd(&queue.next, 1);
+            if (index >= queue.end)
+            {
+                break;
+            }
+            mTask(index, worker, mData);
+        }
+    }
+}
+
+//
+// LSolver functions
+//
+
+
+typedef float (*DotKernel)(const float* a, const float* b, int n);
+typedef void (*AxpyKernel)(float* out, float scale, const float* a, int n);
+
+static float dotScalar(const float* a, const float* b, int n)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < n; ++i)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static void axpyScalar(float* out, float scale, const float* a, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        out[i] += scale * a[i];
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+//Lengths are multiples of 8 since payoff rows are padded
+__attribute__((target("sse2")))
+static float dotSSE2(const float* a, const float* b, int n)
+{
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for (int i = 0; i < n; i += 8)
+    {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(sum0, sum1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+__attribute__((target("sse2")))
+static void axpySSE2(float* out, float scale, const float* a, int n)
+{
+    __m128 s = _mm_set1_ps(scale);
+    for (int i = 0; i < n; i += 4)
+    {
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(s, _mm_loadu_ps(a + i))));
+    }
+}
+
+__attribute__((target("avx2")))
+static float dotAVX2(const float* a, const float* b, int n)
+{
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    if (i < n)
+    {
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(_mm256_add_ps(sum0, sum1)), _mm256_extractf128_ps(_mm256_add_ps(sum0, sum1), 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, sum);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+__attribute__((target("avx2")))
+static void axpyAVX2(float* out, float scale, const float* a, int n)
+{
+    __m256 s = _mm256_set1_ps(scale);
+    for (int i = 0; i < n; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(s, _mm256_loadu_ps(a + i))));
+    }
+}
+#endif
+
+//Mat-vec kernels from slowest to fastest
+struct SolverKernelEntry
+{
+    const char* name;
+    DotKernel dot;
+    AxpyKernel axpy;
+    SDL_bool (*supported)();
+};
+
+const SolverKernelEntry gSolverKernels[] = {
+    { "scalar", dotScalar, axpyScalar, alwaysSupported },
+#ifdef HAVE_X86_KERNELS
+    { "sse2", dotSSE2, axpySSE2, SDL_HasSSE2 },
+    { "avx2", dotAVX2, axpyAVX2, SDL_HasAVX2 },
+#endif
+};
+const int SOLVER_KERNEL_COUNT = sizeof(gSolverKernels) / sizeof(gSolverKernels[0]);
+
+//Index of the fastest supported mat-vec kernels
+static int pickSolverKernel()
+{
+    int best = 0;
+    for (int i = 0; i < SOLVER_KERNEL_COUNT; ++i)
+    {
+        if (gSolverKernels[i].supported())
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+//Gets the fastest supported mat-vec kernels, picked once even when solver tasks ask at the same time
+static const SolverKernelEntry& getSolverKernel()
+{
+    static const int best = pickSolverKernel();
+    return gSolverKernels[best];
+}
+
+LSolver::LSolver()
+{
+    mRows = 0;
+    mCols = 0;
+    mStride = 0;
+    mValue = 0.0f;
+    mExploitability = 0.0f;
+    mParallel = false;
+    mTaskIn = NULL;
+    mTaskOut = NULL;
+}
+
+void LSolver::setPayoffs(int rows, int cols, const float* payoffs)
+{
+    mRows = rows;
+    mCols = cols;
+    mStride = (cols + 7) & ~7;
+    mPayoffs.assign((size_t)rows * mStride, 0.0f);
+    for (int i = 0; i < rows; ++i)
+    {
+        memcpy(&mPayoffs[(size_t)i * mStride], payoffs + (size_t)i * cols, cols * sizeof(float));
+    }
+}
+
+void LSolver::setRules(LRuleSet& rules)
+{
+    int weapons = rules.getCount();
+    std::vector<float> payoffs((size_t)weapons * weapons);
+    for (int a = 0; a < weapons; ++a)
+    {
+        for (int b = 0; b < weapons; ++b)
+        {
+            int outcome = rules.outcome(a + 1, b + 1);
+            payoffs[(size_t)a * weapons + b] = outcome == 1 ? 1.0f : (outcome == 2 ? -1.0f : 0.0f);
+        }
+    }
+
+    setPayoffs(weapons, weapons, &payoffs[0]);
+}
+
+bool LSolver::load(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        printf("Unable to open payoff matrix %s.\n", path);
+        return false;
+    }
+
+    int rows = 0;
+    int cols = 0;
+    bool success = fscanf(file, "%d %d", &rows, &cols) == 2 && rows > 0 && cols > 0 && rows <= 1 << 15 && cols <= 1 << 15;
+    std::vector<float> payoffs;
+    if (success)
+    {
+        payoffs.resize((size_t)rows * cols);
+        for (size_t i = 0; i < payoffs.size() && success; ++i)
+        {
+            success = fscanf(file, "%f", &payoffs[i]) == 1;
+        }
+    }
+    fclose(file);
+
+    if (!success)
+    {
+        printf("Payoff matrix %s should be \"rows cols\" followed by rows x cols numbers.\n", path);
+        return false;
+    }
+
+    setPayoffs(rows, cols, &payoffs[0]);
+    return true;
+}
+
+void LSolver::rowTask(int index, int worker, void* data)
+{
+    LSolver* solver = (LSolver*)data;
+    DotKernel dot = getSolverKernel().dot;
+    int end = (index + 1) * BLOCK < solver->mRows ? (index + 1) * BLOCK : solver->mRows;
+    for (int i = index * BLOCK; i < end; ++i)
+    {
+        solver->mTaskOut[i] = dot(&solver->mPayoffs[(size_t)i * solver->mStride], solver->mTaskIn, solver->mStride);
+    }
+}
+
+void LSolver::colTask(int index, int worker, void* data)
+{
+    //Each task owns a slice of columns and sweeps every row, so no reduction is needed
+    LSolver* solver = (LSolver*)data;
+    AxpyKernel axpy = getSolverKernel().axpy;
+    int begin = index * BLOCK;
+    int width = begin + BLOCK < solver->mStride ? BLOCK : solver->mStride - begin;
+    float* out = solver->mTaskOut + begin;
+    std::fill(out, out + width, 0.0f);
+    for (int i = 0; i < solver->mRows; ++i)
+    {
+        //Regret matching zeroes most rows of a sparse equilibrium, skip them
+        float weight = solver->mTaskIn[i];
+        if (weight != 0.0f)
+        {
+            axpy(out, weight, &solver->mPayoffs[(size_t)i * solver->mStride + begin], width);
+        }
+    }
+}
+
+void LSolver::rowPayoffs(const float* y, float* out)
+{
+    mTaskIn = y;
+    mTaskOut = out;
+    int blocks = (mRows + BLOCK - 1) / BLOCK;
+    if (mParallel)
+    {
+        mPool.run(blocks, rowTask, this);
+    }
+    else
+    {
+        for (int b = 0; b < blocks; ++b)
+        {
+            rowTask(b, 0, this);
+        }
+    }
+}
+
+void LSolver::colPayoffs(const float* x, float* out)
+{
+    mTaskIn = x;
+    mTaskOut = out;
+    int blocks = (mStride + BLOCK - 1) / BLOCK;
+    if (mParallel)
+    {
+        mPool.run(blocks, colTask, this);
+    }
+    else
+    {
+        for (int b = 0; b < blocks; ++b)
+        {
+            colTask(b, 0, this);
+        }
+    }
+}
+
+//Moves a strategy toward the actions with positive regret against payoffs, uniform when there are none
+static void matchRegrets(const float* payoffs, float* regrets, float* strategy, int n)
+{
+    float expected = 0.0f;
+    for (int i = 0; i < n; ++i)
+    {
+        expected += strategy[i] * payoffs[i];
+    }
+
+    float total = 0.0f;
+    for (int i = 0; i < n; ++i)
+    {
+        float regret = regrets[i] + payoffs[i] - expected;
+        regrets[i] = regret > 0.0f ? regret : 0.0f;
+        total += regrets[i];
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        strategy[i] = total > 0.0f ? regrets[i] / total : 1.0f / n;
+    }
+}
+
+void LSolver::evaluate()
+{
+    std::vector<float> x = getRowStrategy();
+    std::vector<float> y = getColStrategy();
+    y.resize(mStride, 0.0f);
+
+    rowPayoffs(&y[0], &mRowPayoffs[0]);
+    colPayoffs(&x[0], &mColPayoffs[0]);
+
+    float best = mRowPayoffs[0];
+    float value = 0.0f;
+    for (int i = 0; i < mRows; ++i)
+    {
+        best = mRowPayoffs[i] > best ? mRowPayoffs[i] : best;
+        value += x[i] * mRowPayoffs[i];
+    }
+
+    float worst = mColPayoffs[0];
+    for (int j = 1; j < mCols; ++j)
+    {
+        worst = mColPayoffs[j] < worst ? mColPayoffs[j] : worst;
+    }
+
+    mValue = value;
+    mExploitability = best - worst;
+}
+
+int LSolver::solve(float tolerance, int maxIterations, int threads)
+{
+    if (mRows == 0)
+    {
+        return 0;
+    }
+
+    mRowStrategy.assign(mRows, 1.0f / mRows);
+    mColStrategy.assign(mStride, 0.0f);
+    std::fill(mColStrategy.begin(), mColStrategy.begin() + mCols, 1.0f / mCols);
+    mRowRegrets.assign(mRows, 0.0f);
+    mColRegrets.assign(mCols, 0.0f);
+    mRowSum.assign(mRows, 0.0f);
+    mColSum.assign(mCols, 0.0f);
+    mRowPayoffs.assign(mRows, 0.0f);
+    mColPayoffs.assign(mStride, 0.0f);
+
+    //Small games finish before a pool would pay for itself
+    mParallel = threads > 1 && (size_t)mRows * mStride >= 1 << 16 && mPool.start(threads);
+
+    int iteration = 0;
+    while (iteration < maxIterations)
+    {
+        ++iteration;
+
+        //Alternating updates: the row player answers the column strategy, then the column player answers the new rows
+        rowPayoffs(&mColStrategy[0], &mRowPayoffs[0]);
+        matchRegrets(&mRowPayoffs[0], &mRowRegrets[0], &mRowStrategy[0], mRows);
+
+        colPayoffs(&mRowStrategy[0], &mColPayoffs[0]);
+        for (int j = 0; j < mCols; ++j)
+        {
+            mColPayoffs[j] = -mColPayoffs[j];
+        }
+        matchRegrets(&mColPayoffs[0], &mColRegrets[0], &mColStrategy[0], mCols);
+
+        //Later iterations weigh more in the average
+        for (int i = 0; i < mRows; ++i)
+        {
+            mRowSum[i] += iteration * mRowStrategy[i];
+        }
+        for (int j = 0; j < mCols; ++j)
+        {
+            mColSum[j] += iteration * mColStrategy[j];
+        }
+
+        if (iteration % 16 == 0 || iteration == maxIterations)
+        {
+            evaluate();
+            if (mExploitability <= tolerance)
+            {
+                break;
+            }
+        }
+    }
+
+    if (iteration % 16 != 0 && iteration != maxIterations)
+    {
+        evaluate();
+    }
+
+    if (mParallel)
+    {
+        mPool.stop();
+        mParallel = false;
+    }
+
+    return iteration;
+}
+
+int LSolver::getRows()
+{
+    return mRows;
+}
+
+int LSolver::getCols()
+{
+    return mCols;
+}
+
+std::vector<float> LSolver::getRowStrategy()
+{
+    double total = 0.0;
+    for (size_t i = 0; i < mRowSum.size(); ++i)
+    {
+        total += mRowSum[i];
+    }
+
+    std::vector<float> strategy(mRows, 1.0f / mRows);
+    for (size_t i = 0; i < mRowSum.size() && total > 0.0; ++i)
+    {
+        strategy[i] = (float)(mRowSum[i] / total);
+    }
+    return strategy;
+}
+
+std::vector<float> LSolver::getColStrategy()
+{
+    double total = 0.0;
+    for (size_t j = 0; j < mColSum.size(); ++j)
+    {
+        total += mColSum[j];
+    }
+
+    std::vector<float> strategy(mCols, 1.0f / mCols);
+    for (size_t j = 0; j < mColSum.size() && total > 0.0; ++j)
+    {
+        strategy[j] = (float)(mColSum[j] / total);
+    }
+    return strategy;
+}
+
+float LSolver::getValue()
+{
+    return mValue;
+}
+
+float LSolver::getExploitability()
+{
+    return mExploitability;
+}
+
+#ifdef HAVE_IO_URING
+//
+// LRing functions
+//
+
+
+LRing::LRing()
+{
+    mFd = -1;
+    mSqRing = NULL;
+    mSqRingSize = 0;
+    mCqRing = NULL;
+    mCqRingSize = 0;
+    mSqes = NULL;
+    mSqesSize = 0;
+    mTail = 0;
+    mQueued = 0;
+    mRegistered = false;
+}
+
+LRing::~LRing()
+{
+    close();
+}
+
+bool LRing::open(unsigned entries, unsigned completions, unsigned flags)
+{
+    close();
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = flags | IORING_SETUP_CQSIZE;
+    params.cq_entries = completions;
+    mFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (mFd < 0 && flags != 0)
+    {
+        //Older kernels reject setup flags they don't know, which are only hints here
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = completions;
+        mFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (mFd < 0)
+    {
+        return false;
+    }
+
+    //Newer kernels map both queues' rings in one go
+    mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+    {
+        mSqRingSize = mCqRingSize = mSqRingSize > mCqRingSize ? mSqRingSize : mCqRingSize;
+    }
+
+    void* sq = mmap(NULL, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING);
+    mSqRing = sq != MAP_FAILED ? sq : NULL;
+    void* cq = single ? sq : mmap(NULL, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_CQ_RING);
+    mCqRing = cq != MAP_FAILED ? cq : NULL;
+    mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(NULL, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQES);
+    mSqes = sqes != MAP_FAILED ? (io_uring_sqe*)sqes : NULL;
+    if (mSqRing == NULL || mCqRing == NULL || mSqes == NULL)
+    {
+        close();
+        return false;
+    }
+
+    Uint8* sqBytes = (Uint8*)mSqRing;
+    mSqHead = (unsigned*)(sqBytes + params.sq_off.head);
+    mSqTail = (unsigned*)(sqBytes + params.sq_off.tail);
+    mSqMask = *(unsigned*)(sqBytes + params.sq_off.ring_mask);
+    mSqEntries = params.sq_entries;
+
+    //Submission slot i always holds entry i, so entries are queued just by moving the tail
+    unsigned* array = (unsigned*)(sqBytes + params.sq_off.array);
+    for (unsigned i = 0; i < mSqEntries; ++i)
+    {
+        array[i] = i;
+    }
+
+    Uint8* cqBytes = (Uint8*)mCqRing;
+    mCqHead = (unsigned*)(cqBytes + params.cq_off.head);
+    mCqTail = (unsigned*)(cqBytes + params.cq_off.tail);
+    mCqMask = *(unsigned*)(cqBytes + params.cq_off.ring_mask);
+    mCqes = (io_uring_cqe*)(cqBytes + params.cq_off.cqes);
+
+    mTail = *mSqTail;
+    mQueued = 0;
+    mRegistered = false;
+    return true;
+}
+
+void LRing::close()
+{
+    if (mSqes != NULL)
+    {
+        munmap(mSqes, mSqesSize);
+    }
+    if (mCqRing != NULL && mCqRing != mSqRing)
+    {
+        munmap(mCqRing, mCqRingSize);
+    }
+    if (mSqRing != NULL)
+    {
+        munmap(mSqRing, mSqRingSize);
+    }
+    if (mFd >= 0)
+    {
+        ::close(mFd);
+    }
+
+    mFd = -1;
+    mSqRing = NULL;
+    mCqRing = NULL;
+    mSqes = NULL;
+    mQueued = 0;
+    mRegistered = false;
+}
+
+bool LRing::isOpen()
+{
+    return mFd >= 0;
+}
+
+bool LRing::isSupported()
+{
+    //Probed once, io_uring may be missing or turned off by the kernel's config or a sandbox
+    static int supported = -1;
+    if (supported < 0)
+    {
+        supported = 0;
+        LRing ring;
+        std::vector<Uint8> storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        io_uring_probe* probe = (io_uring_probe*)&storage[0];
+        if (ring.open(4, 8, 0) && syscall(__NR_io_uring_register, ring.mFd, IORING_REGISTER_PROBE, probe, 256) == 0)
+        {
+            const int ops[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED, IORING_OP_WRITE, IORING_OP_TIMEOUT };
+            supported = 1;
+            for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i)
+            {
+                if (ops[i] > probe->last_op || (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED) == 0)
+                {
+                    supported = 0;
+                }
+            }
+        }
+    }
+    return supported == 1;
+}
+
+bool LRing::registerBuffers(const iovec* buffers, unsigned count)
+{
+    ++gThreadSyscalls;
+    mRegistered = syscall(__NR_io_uring_register, mFd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+    return mRegistered;
+}
+
+bool LRing::hasRegisteredBuffers()
+{
+    return mRegistered;
+}
+
+io_uring_sqe* LRing::getSqe()
+{
+    if (mTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE) >= mSqEntries)
+    {
+        submit(0);
+        if (mTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE) >= mSqEntries)
+        {
+            return NULL;
+        }
+    }
+
+    io_uring_sqe* sqe = &mSqes[mTail & mSqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    ++mTail;
+    ++mQueued;
+    return sqe;
+}
+
+int LRing::submit(unsigned wait)
+{
+    __atomic_store_n(mSqTail, mTail, __ATOMIC_RELEASE);
+    ++gThreadSyscalls;
+    int submitted = (int)syscall(__NR_io_uring_enter, mFd, mQueued, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (submitted < 0)
+    {
+        return -errno;
+    }
+    mQueued -= (unsigned)submitted;
+    return submitted;
+}
+
+io_uring_cqe* LRing::peek()
+{
+    unsigned head = *mCqHead;
+    return head != __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE) ? &mCqes[head & mCqMask] : NULL;
+}
+
+void LRing::seen()
+{
+    __atomic_store_n(mCqHead, *mCqHead + 1, __ATOMIC_RELEASE);
+}
+#endif
+
+//
+// LReplayWriter functions
+//
+
+
+LReplayWriter::LReplayWriter()
+{
+    mFile = NULL;
+    mSnapshotFile = NULL;
+    mSnapshotBytes = 0;
+    mActive = 0;
+    mFill = 0;
+    mCount = 0;
+    mThread = NULL;
+    mLock = NULL;
+    mWake = NULL;
+    mIdle = NULL;
+    mPending = -1;
+    mPendingFill = 0;
+    mQuit = false;
+    mFailed = false;
+}
+
+LReplayWriter::~LReplayWriter()
+{
+    close();
+}
+
+bool LReplayWriter::open(const char* path, const ReplayHeader& header, Uint32 interval)
+{
+    close();
+
+    mFile = fopen(path, "wb");
+    if (mFile == NULL)
+    {
+        printf("Unable to create replay %s.\n", path);
+        return false;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, mFile) != 1 || fflush(mFile) != 0)
+    {
+        printf("Unable to write replay %s.\n", path);
+        fclose(mFile);
+        mFile = NULL;
+        return false;
+    }
+
+    //All allocation happens here so appends never touch the heap
+    mBuffers[0].resize(CAPACITY);
+    mBuffers[1].resize(CAPACITY);
+    mActive = 0;
+    mFill = 0;
+    mCount = 0;
+    mPending = -1;
+    mPendingFill = 0;
+    mQuit = false;
+    mFailed = false;
+    mInterval = interval;
+    mNextKeyframe = interval > 0 ? 0 : ~(Uint64)0;
+    mKeyframes.clear();
+    mSnapshots[0].clear();
+    mSnapshots[1].clear();
+    mSnapshotBytes = 0;
+    mSnapshotPath = std::string(path) + ".snapshots.tmp";
+    mSnapshotFile = interval > 0 ? fopen(mSnapshotPath.c_str(), "w+b") : NULL;
+    if (interval > 0 && mSnapshotFile == NULL)
+    {
+        printf("Unable to create %s, keyframes won't have model snapshots.\n", mSnapshotPath.c_str());
+    }
+
+#ifdef HAVE_IO_URING
+    //Rounds go from the pinned buffers straight to the file at known offsets, the stream only writes the index
+    mOffset = sizeof(header);
+    if (strcmp(gIoBackend, "epoll") != 0 && LRing::isSupported() && mRing.open(2, 4, 0))
+    {
+        iovec buffers[2];
+        for (int b = 0; b < 2; ++b)
+        {
+            buffers[b].iov_base = &mBuffers[b][0];
+            buffers[b].iov_len = CAPACITY * sizeof(ReplayRound);
+        }
+        mRing.registerBuffers(buffers, 2);
+    }
+#endif
+
+    mLock = SDL_CreateMutex();
+    mWake = SDL_CreateCond();
+    mIdle = SDL_CreateCond();
+    mThread = mLock != NULL && mWake != NULL && mIdle != NULL ? SDL_CreateThread(writerMain, "replay", this) : NULL;
+    if (mThread == NULL)
+    {
+        printf("Unable to start replay writer! SDL Error: %s\n", SDL_GetError());
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void LReplayWriter::submit()
+{
+    SDL_LockMutex(mLock);
+    while (mPending >= 0)
+    {
+        SDL_CondWait(mIdle, mLock);
+    }
+    mPending = mActive;
+    mPendingFill = mFill;
+    SDL_CondSignal(mWake);
+    SDL_UnlockMutex(mLock);
+
+    mCount += mFill;
+    mActive ^= 1;
+    mFill = 0;
+}
+
+int LReplayWriter::writerMain(void* data)
+{
+    LReplayWriter* writer = (LReplayWriter*)data;
+
+    SDL_LockMutex(writer->mLock);
+    for (;;)
+    {
+        while (writer->mPending < 0 && !writer->mQuit)
+        {
+            SDL_CondWait(writer->mWake, writer->mLock);
+        }
+        if (writer->mPending < 0)
+        {
+            break;
+        }
+
+        //Write without holding the lock so the game can keep filling the other buffer
+        int buffer = writer->mPending;
+        int fill = writer->mPendingFill;
+        SDL_UnlockMutex(writer->mLock);
+        bool written = writer->writeBuffer(buffer, fill) && writer->writeSnapshots(buffer);
+        SDL_LockMutex(writer->mLock);
+
+        writer->mFailed = writer->mFailed || !written;
+        writer->mPending = -1;
+        SDL_CondSignal(writer->mIdle);
+    }
+    SDL_UnlockMutex(writer->mLock);
+
+    return 0;
+}
+
+bool LReplayWriter::close()
+{
+    if (mFile == NULL)
+    {
+        return true;
+    }
+
+    if (mThread != NULL)
+    {
+        if (mFill > 0 || !mSnapshots[mActive].empty())
+        {
+            submit();
+        }
+
+        SDL_LockMutex(mLock);
+        mQuit = true;
+        SDL_CondSignal(mWake);
+        SDL_UnlockMutex(mLock);
+        SDL_WaitThread(mThread, NULL);
+        mThread = NULL;
+
+#ifdef HAVE_IO_URING
+        //The stream's position is still just past the header
+        if (mRing.isOpen())
+        {
+            mRing.close();
+            mFailed = mFailed || fseeko(mFile, (off_t)mOffset, SEEK_SET) != 0;
+        }
+#endif
+
+        if (mInterval > 0 && !mFailed && !writeIndex())
+        {
+            mFailed = true;
+        }
+    }
+
+    SDL_DestroyCond(mIdle);
+    SDL_DestroyCond(mWake);
+    SDL_DestroyMutex(mLock);
+    mIdle = NULL;
+    mWake = NULL;
+    mLock = NULL;
+
+    if (mSnapshotFile != NULL)
+    {
+        fclose(mSnapshotFile);
+        remove(mSnapshotPath.c_str());
+        mSnapshotFile = NULL;
+    }
+
+    bool success = fclose(mFile) == 0 && !mFailed;
+    mFile = NULL;
+    mBuffers[0].clear();
+    mBuffers[1].clear();
+    mSnapshots[0].clear();
+    mSnapshots[1].clear();
+    return success;
+}
+
+bool LReplayWriter::isOpen()
+{
+    return mFile != NULL;
+}
+
+const char* LReplayWriter::getBackend()
+{
+#ifdef HAVE_IO_URING
+    if (mRing.isOpen())
+    {
+        return mRing.hasRegisteredBuffers() ? "io_uring" : "io_uring without registered buffers";
+    }
+#endif
+    return "stdio";
+}
+
+void LReplayWriter::addKeyframe(const Scoreboard& score, LBot* bot)
+{
+    ReplayKeyframe keyframe;
+    keyframe.round = getCount();
+    keyframe.offset = sizeof(ReplayHeader) + keyframe.round * sizeof(ReplayRound);
+    keyframe.wins = (Uint32)score.wins;
+    keyframe.losses = (Uint32)score.losses;
+    keyframe.draws = (Uint32)score.draws;
+    keyframe.streak = (Uint32)score.streak;
+    keyframe.snapshotOffset = mSnapshotBytes;
+    keyframe.snapshotSize = 0;
+    keyframe.reserved = 0;
+
+    //Bots that can't be saved, or are too big to save this often, are left as they were by a seek
+    std::vector<Uint8>& snapshots = mSnapshots[mActive];
+    size_t start = snapshots.size();
+    if (bot != NULL && mSnapshotFile != NULL && bot->save(snapshots) && snapshots.size() - start <= MAX_SNAPSHOT)
+    {
+        keyframe.snapshotSize = (Uint32)(snapshots.size() - start);
+        mSnapshotBytes += keyframe.snapshotSize;
+    }
+    else
+    {
+        snapshots.resize(start);
+    }
+
+    mKeyframes.push_back(keyframe);
+    mNextKeyframe = keyframe.round + mInterval;
+
+    //Big models fill the snapshot buffer long before the rounds buffer, so they're handed off early
+    if (snapshots.size() >= SNAPSHOT_FLUSH)
+    {
+        submit();
+    }
+}
+
+bool LReplayWriter::writeBuffer(int buffer, int fill)
+{
+    const Uint8* data = (const Uint8*)&mBuffers[buffer][0];
+    size_t size = fill * sizeof(ReplayRound);
+
+#ifdef HAVE_IO_URING
+    if (mRing.isOpen())
+    {
+        //A short write goes round again from where it stopped
+        size_t done = 0;
+        while (done < size)
+        {
+            io_uring_sqe* sqe = mRing.getSqe();
+            if (sqe == NULL)
+            {
+                return false;
+            }
+            sqe->opcode = mRing.hasRegisteredBuffers() ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            sqe->fd = fileno(mFile);
+            sqe->addr = (Uint64)(uintptr_t)(data + done);
+            sqe->len = (Uint32)(size - done);
+            sqe->off = mOffset + done;
+            sqe->buf_index = (Uint16)buffer;
+
+            //Submits and waits in one call, going again if a signal cut the wait short
+            io_uring_cqe* cqe;
+            while ((cqe = mRing.peek()) == NULL)
+            {
+                int submitted = mRing.submit(1);
+                if (submitted < 0 && submitted != -EINTR)
+                {
+                    return false;
+                }
+            }
+            int result = cqe->res;
+            mRing.seen();
+            if (result <= 0)
+            {
+                return false;
+            }
+            done += (size_t)result;
+        }
+        mOffset += size;
+        return true;
+    }
+#endif
+
+    return fwrite(data, 1, size, mFile) == size;
+}
+
+bool LReplayWriter::writeSnapshots(int buffer)
+{
+    std::vector<Uint8>& snapshots = mSnapshots[buffer];
+    bool success = snapshots.empty() || fwrite(&snapshots[0], 1, snapshots.size(), mSnapshotFile) == snapshots.size();
+    snapshots.clear();
+    return success;
+}
+
+bool LReplayWriter::writeIndex()
+{
+    ReplayTrailer trailer;
+    memcpy(trailer.magic, REPLAY_INDEX_MAGIC, 4);
+    trailer.interval = mInterval;
+    trailer.keyframes = mKeyframes.size();
+    trailer.indexOffset = sizeof(ReplayHeader) + mCount * sizeof(ReplayRound);
+    trailer.snapshotOffset = trailer.indexOffset + mKeyframes.size() * sizeof(ReplayKeyframe);
+
+    bool success = mKeyframes.empty() || fwrite(&mKeyframes[0], sizeof(ReplayKeyframe), mKeyframes.size(), mFile) == mKeyframes.size();
+
+    //Copy the snapshot file in a piece at a time
+    Uint64 copied = 0;
+    if (mSnapshotFile != NULL)
+    {
+        std::vector<Uint8>& chunk = mSnapshots[0];
+        chunk.resize(1 << 16);
+        success = success && fflush(mSnapshotFile) == 0 && fseek(mSnapshotFile, 0, SEEK_SET) == 0;
+        size_t got;
+        while (success && (got = fread(&chunk[0], 1, chunk.size(), mSnapshotFile)) > 0)
+        {
+            success = fwrite(&chunk[0], 1, got, mFile) == got;
+            copied += got;
+        }
+    }
+    success = success && copied == mSnapshotBytes;
+
+    return success && fwrite(&trailer, sizeof(trailer), 1, mFile) == 1;
+}
+
+Uint64 LReplayWriter::getCount()
+{
+    return mCount + mFill;
+}
+
+//
+// LReplayReader functions
+//
+
+
+LReplayReader::LReplayReader()
+{
+    mHeader = NULL;
+    mRounds = NULL;
+    mCount = 0;
+    mSnapshots = NULL;
+    mSnapshotSize = 0;
+    mIndexed = false;
+}
+
+bool LReplayReader::open(const char* path)
+{
+    close();
+    if (!mFile.open(path))
+    {
+        printf("Unable to open replay %s.\n", path);
+        return false;
+    }
+
+    const ReplayHeader* header = (const ReplayHeader*)mFile.getData();
+    if (mFile.getSize() < sizeof(ReplayHeader) || memcmp(header->magic, REPLAY_MAGIC, 4) != 0 || header->version < 1 || header->version > REPLAY_VERSION)
+    {
+        printf("%s isn't a replay from this version.\n", path);
+        mFile.close();
+        return false;
+    }
+
+    mHeader = header;
+    mRounds = (const ReplayRound*)(mFile.getData() + sizeof(ReplayHeader));
+    mCount = (mFile.getSize() - sizeof(ReplayHeader)) / sizeof(ReplayRound);
+
+    //A finished log ends with its index, one cut short by a crash gets an index built by a scan
+    size_t size = mFile.getSize();
+    const ReplayTrailer* trailer = (const ReplayTrailer*)(mFile.getData() + size - sizeof(ReplayTrailer));
+    bool indexed = header->version >= 2 && size >= sizeof(ReplayHeader) + sizeof(ReplayTrailer) && memcmp(trailer->magic, REPLAY_INDEX_MAGIC, 4) == 0;
+    if (indexed)
+    {
+        //Bounds first so the keyframe count can't wrap the size, and a log recorded without keyframes gets the scan too
+        Uint64 end = size - sizeof(ReplayTrailer);
+        indexed = trailer->indexOffset >= sizeof(ReplayHeader) && trailer->indexOffset <= end &&
+            (trailer->indexOffset - sizeof(ReplayHeader)) % sizeof(ReplayRound) == 0 &&
+            trailer->keyframes > 0 && trailer->keyframes <= (end - trailer->indexOffset) / sizeof(ReplayKeyframe) &&
+            trailer->snapshotOffset == trailer->indexOffset + trailer->keyframes * sizeof(ReplayKeyframe);
+    }
+    if (indexed)
+    {
+        indexed = ((const ReplayKeyframe*)(mFile.getData() + trailer->indexOffset))->round == 0;
+    }
+
+    if (indexed)
+    {
+        const ReplayKeyframe* keyframes = (const ReplayKeyframe*)(mFile.getData() + trailer->indexOffset);
+        mKeyframes.assign(keyframes, keyframes + trailer->keyframes);
+        mSnapshots = mFile.getData() + trailer->snapshotOffset;
+        mSnapshotSize = size - sizeof(ReplayTrailer) - trailer->snapshotOffset;
+        mCount = (trailer->indexOffset - sizeof(ReplayHeader)) / sizeof(ReplayRound);
+        mIndexed = true;
+    }
+    else
+    {
+        buildIndex(4096);
+    }
+
+    return true;
+}
+
+void LReplayReader::buildIndex(Uint32 interval)
+{
+    Scoreboard score = { 0, 0, 0, 0, 0 };
+    mKeyframes.clear();
+    for (Uint64 i = 0; i <= mCount; ++i)
+    {
+        if (i % interval == 0)
+        {
+            ReplayKeyframe keyframe = {};
+            keyframe.round = i;
+            keyframe.offset = sizeof(ReplayHeader) + i * sizeof(ReplayRound);
+            keyframe.wins = (Uint32)score.wins;
+            keyframe.losses = (Uint32)score.losses;
+            keyframe.draws = (Uint32)score.draws;
+            keyframe.streak = (Uint32)score.streak;
+            mKeyframes.push_back(keyframe);
+        }
+        if (i < mCount)
+        {
+            scoreRound(mRounds[i].winner, score);
+        }
+    }
+}
+
+void LReplayReader::close()
+{
+    mFile.close();
+    mHeader = NULL;
+    mRounds = NULL;
+    mCount = 0;
+    mKeyframes.clear();
+    mSnapshots = NULL;
+    mSnapshotSize = 0;
+    mIndexed = false;
+}
+
+bool LReplayReader::isOpen()
+{
+    return mHeader != NULL;
+}
+
+const ReplayHeader& LReplayReader::getHeader()
+{
+    return *mHeader;
+}
+
+Uint64 LReplayReader::getCount()
+{
+    return mCount;
+}
+
+const ReplayRound& LReplayReader::getRound(Uint64 index)
+{
+    return mRounds[index];
+}
+
+bool LReplayReader::hasIndex()
+{
+    return mIndexed;
+}
+
+int LReplayReader::getKeyframeCount()
+{
+    return (int)mKeyframes.size();
+}
+
+const ReplayKeyframe& LReplayReader::findKeyframe(Uint64 round)
+{
+    //Every index starts with round 0, so there's always one at or before
+    size_t low = 0;
+    size_t high = mKeyframes.size();
+    while (high - low > 1)
+    {
+        size_t middle = (low + high) / 2;
+        if (mKeyframes[middle].round <= round)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return mKeyframes[low];
+}
+
+bool LReplayReader::seek(Uint64 round, Scoreboard& score, LBot* bot)
+{
+    round = round < mCount ? round : mCount;
+    const ReplayKeyframe& keyframe = findKeyframe(round);
+    score.rounds = (int)keyframe.round;
+    score.wins = (int)keyframe.wins;
+    score.losses = (int)keyframe.losses;
+    score.draws = (int)keyframe.draws;
+    score.streak = (int)keyframe.streak;
+
+    //Bots without a snapshot here are left as they were
+    Uint64 from = keyframe.round;
+    bool restored = bot == NULL;
+    if (bot != NULL && keyframe.snapshotSize > 0 && keyframe.snapshotOffset <= mSnapshotSize && keyframe.snapshotSize <= mSnapshotSize - keyframe.snapshotOffset)
+    {
+        restored = bot->load(mSnapshots + keyframe.snapshotOffset, keyframe.snapshotSize);
+    }
+
+    for (Uint64 i = from; i < round; ++i)
+    {
+        scoreRound(mRounds[i].winner, score);
+        if (restored && bot != NULL)
+        {
+            bot->observe(mRounds[i].computer, mRounds[i].player);
+        }
+    }
+
+    return restored;
+}
+
+//
+// Move codec
+//
+
+
+typedef void (*TritKernel)(const Uint8* in, size_t blocks, Uint8* out);
+
+static void packTritsScalar(const Uint8* moves, size_t blocks, Uint8* out)
+{
+    for (size_t b = 0; b < blocks; ++b, moves += TRIT_BLOCK_MOVES, out += TRIT_BLOCK_BYTES)
+    {
+        for (int j = 0; j < TRIT_BLOCK_BYTES; ++j)
+        {
+            out[j] = (Uint8)((moves[j] - 1) + 3 * ((moves[j + 16] - 1) + 3 * ((moves[j + 32] - 1) + 3 * ((moves[j + 48] - 1) + 3 * (moves[j + 64] - 1)))));
+        }
+    }
+}
+
+static void unpackTritsScalar(const Uint8* packed, size_t blocks, Uint8* moves)
+{
+    for (size_t b = 0; b < blocks; ++b, packed += TRIT_BLOCK_BYTES, moves += TRIT_BLOCK_MOVES)
+    {
+        for (int j = 0; j < TRIT_BLOCK_BYTES; ++j)
+        {
+            unsigned value = packed[j];
+            for (int k = 0; k < 5; ++k)
+            {
+                moves[k * 16 + j] = (Uint8)(value % 3 + 1);
+                value /= 3;
+            }
+        }
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+//Horner's rule in bytes, the largest value is 242 so nothing wraps
+__attribute__((target("sse2")))
+static void packTritsSSE2(const Uint8* moves, size_t blocks, Uint8* out)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    for (size_t b = 0; b < blocks; ++b, moves += TRIT_BLOCK_MOVES, out += TRIT_BLOCK_BYTES)
+    {
+        __m128i value = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(moves + 64)), one);
+        for (int k = 3; k >= 0; --k)
+        {
+            __m128i trit = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(moves + k * 16)), one);
+            value = _mm_add_epi8(_mm_add_epi8(value, _mm_add_epi8(value, value)), trit);
+        }
+        _mm_storeu_si128((__m128i*)out, value);
+    }
+}
+
+//Widens to 16 bits and divides by 3 with a high multiply, floor(x * 21846 / 65536) is x / 3 for every byte
+__attribute__((target("sse2")))
+static void unpackTritsSSE2(const Uint8* packed, size_t blocks, Uint8* moves)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i three = _mm_set1_epi16(3);
+    const __m128i third = _mm_set1_epi16(21846);
+    for (size_t b = 0; b < blocks; ++b, packed += TRIT_BLOCK_BYTES, moves += TRIT_BLOCK_MOVES)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)packed);
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        for (int k = 0; k < 4; ++k)
+        {
+            __m128i qlo = _mm_mulhi_epu16(lo, third);
+            __m128i qhi = _mm_mulhi_epu16(hi, third);
+            __m128i tlo = _mm_sub_epi16(lo, _mm_mullo_epi16(qlo, three));
+            __m128i thi = _mm_sub_epi16(hi, _mm_mullo_epi16(qhi, three));
+            _mm_storeu_si128((__m128i*)(moves + k * 16), _mm_add_epi8(_mm_packus_epi16(tlo, thi), one));
+            lo = qlo;
+            hi = qhi;
+        }
+        _mm_storeu_si128((__m128i*)(moves + 64), _mm_add_epi8(_mm_packus_epi16(lo, hi), one));
+    }
+}
+
+//Two blocks at a time, one per 128-bit lane since unpack and pack stay within lanes
+__attribute__((target("avx2")))
+static void unpackTritsAVX2(const Uint8* packed, size_t blocks, Uint8* moves)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i three = _mm256_set1_epi16(3);
+    const __m256i third = _mm256_set1_epi16(21846);
+    size_t b = 0;
+    for (; b + 2 <= blocks; b += 2, packed += 2 * TRIT_BLOCK_BYTES, moves += 2 * TRIT_BLOCK_MOVES)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)packed);
+        __m256i lo = _mm256_unpacklo_epi8(v, zero);
+        __m256i hi = _mm256_unpackhi_epi8(v, zero);
+        for (int k = 0; k < 5; ++k)
+        {
+            __m256i trits;
+            if (k < 4)
+            {
+                __m256i qlo = _mm256_mulhi_epu16(lo, third);
+                __m256i qhi = _mm256_mulhi_epu16(hi, third);
+                trits = _mm256_packus_epi16(_mm256_sub_epi16(lo, _mm256_mullo_epi16(qlo, three)), _mm256_sub_epi16(hi, _mm256_mullo_epi16(qhi, three)));
+                lo = qlo;
+                hi = qhi;
+            }
+            else
+            {
+                trits = _mm256_packus_epi16(lo, hi);
+            }
+            trits = _mm256_add_epi8(trits, one);
+            _mm_storeu_si128((__m128i*)(moves + k * 16), _mm256_castsi256_si128(trits));
+            _mm_storeu_si128((__m128i*)(moves + TRIT_BLOCK_MOVES + k * 16), _mm256_extracti128_si256(trits, 1));
+        }
+    }
+
+    unpackTritsSSE2(packed, blocks - b, moves);
+}
+#endif
+
+//Trit kernels from slowest to fastest
+struct TritKernelEntry
+{
+    const char* name;
+    TritKernel pack;
+    TritKernel unpack;
+    SDL_bool (*supported)();
+};
+
+const TritKernelEntry gTritKernels[] = {
+    { "scalar", packTritsScalar, unpackTritsScalar, alwaysSupported },
+#ifdef HAVE_X86_KERNELS
+    { "sse2", packTritsSSE2, unpackTritsSSE2, SDL_HasSSE2 },
+    { "avx2", packTritsSSE2, unpackTritsAVX2, SDL_HasAVX2 },
+#endif
+};
+const int TRIT_KERNEL_COUNT = sizeof(gTritKernels) / sizeof(gTritKernels[0]);
+
+//Index of the fastest supported trit kernels
+static int pickTritKernel()
+{
+    int best = 0;
+    for (int i = 0; i < TRIT_KERNEL_COUNT; ++i)
+    {
+        if (gTritKernels[i].supported())
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+//Gets the fastest supported trit kernels, picked once by a thread safe static initializer
+static const TritKernelEntry& getTritKernel()
+{
+    static const int best = pickTritKernel();
+    return gTritKernels[best];
+}
+
+size_t packedMoveSize(size_t count)
+{
+    size_t blocks = count / TRIT_BLOCK_MOVES;
+    return blocks * TRIT_BLOCK_BYTES + (count - blocks * TRIT_BLOCK_MOVES + 4) / 5;
+}
+
+void packMoves(const Uint8* moves, size_t count, Uint8* out)
+{
+    size_t blocks = count / TRIT_BLOCK_MOVES;
+    getTritKernel().pack(moves, blocks, out);
+
+    //Tail in order, missing moves count as rock
+    out += blocks * TRIT_BLOCK_BYTES;
+    for (size_t i = blocks * TRIT_BLOCK_MOVES; i < count; i += 5)
+    {
+        unsigned value = 0;
+        for (size_t k = (count - i < 5 ? count - i : 5); k-- > 0;)
+        {
+            value = value * 3 + (moves[i + k] - 1);
+        }
+        *out++ = (Uint8)value;
+    }
+}
+
+void unpackMoves(const Uint8* packed, size_t count, Uint8* moves)
+{
+    size_t blocks = count / TRIT_BLOCK_MOVES;
+    getTritKernel().unpack(packed, blocks, moves);
+
+    packed += blocks * TRIT_BLOCK_BYTES;
+    for (size_t i = blocks * TRIT_BLOCK_MOVES; i < count; i += 5)
+    {
+        unsigned value = *packed++;
+        for (size_t k = 0; k < 5 && i + k < count; ++k)
+        {
+            moves[i + k] = (Uint8)(value % 3 + 1);
+            value /= 3;
+        }
+    }
+}
+
+LMoveCoder::Model::Model()
+{
+    for (int c = 0; c < 9; ++c)
+    {
+        freq[c][0] = freq[c][1] = freq[c][2] = 1;
+        total[c] = 3;
+    }
+}
+
+void LMoveCoder::Model::update(int context, int symbol)
+{
+    freq[context][symbol] += INCREMENT;
+    total[context] += INCREMENT;
+    if (total[context] > MAX_TOTAL)
+    {
+        //Halving keeps every count at least 1 so any move can still be coded
+        total[context] = 0;
+        for (int s = 0; s < 3; ++s)
+        {
+            freq[context][s] = (Uint16)((freq[context][s] + 1) / 2);
+            total[context] += freq[context][s];
+        }
+    }
+}
+
+void LMoveCoder::encode(const Uint8* moves, size_t count, std::vector<Uint8>& out)
+{
+    //Range coder with a 64-bit low, 0xFF bytes are held back until it's known whether a carry reaches them
+    Model model;
+    Uint64 low = 0;
+    Uint32 range = 0xFFFFFFFF;
+    Uint8 cache = 0;
+    Uint64 cacheSize = 1;
+    int context = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        int symbol = moves[i] - 1;
+        Uint32 cumulative = 0;
+        for (int s = 0; s < symbol; ++s)
+        {
+            cumulative += model.freq[context][s];
+        }
+
+        Uint32 step = range / model.total[context];
+        low += (Uint64)step * cumulative;
+        range = step * model.freq[context][symbol];
+        while (range < (1u << 24))
+        {
+            range <<= 8;
+            shiftLow(low, cache, cacheSize, out);
+        }
+
+        model.update(context, symbol);
+        context = (context * 3 + symbol) % 9;
+    }
+
+    //Flush all of low
+    for (int i = 0; i < 5; ++i)
+    {
+        shiftLow(low, cache, cacheSize, out);
+    }
+}
+
+void LMoveCoder::shiftLow(Uint64& low, Uint8& cache, Uint64& cacheSize, std::vector<Uint8>& out)
+{
+    //A byte below 0xFF, or a carry, settles the bytes held back
+    if ((Uint32)low < 0xFF000000u || (low >> 32) != 0)
+    {
+        Uint8 carry = (Uint8)(low >> 32);
+        Uint8 pending = cache;
+        do
+        {
+            out.push_back((Uint8)(pending + carry));
+            pending = 0xFF;
+        }
+        while (--cacheSize != 0);
+        cache = (Uint8)(low >> 24);
+    }
+    ++cacheSize;
+    low = (low & 0x00FFFFFF) << 8;
+}
+
+bool LMoveCoder::decode(const Uint8* data, size_t size, size_t count, Uint8* moves)
+{
+    //The encoder's first byte is always 0
+    if (size < 5)
+    {
+        return false;
+    }
+
+    Model model;
+    const Uint8* end = data + size;
+    const Uint8* next = data + 1;
+    Uint32 code = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        code = (code << 8) | *next++;
+    }
+    Uint32 range = 0xFFFFFFFF;
+    int context = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Uint32 step = range / model.total[context];
+        Uint32 target = code / step;
+        target = target < model.total[context] ? target : model.total[context] - 1;
+
+        int symbol = 0;
+        Uint32 cumulative = 0;
+        while (symbol < 2 && cumulative + model.freq[context][symbol] <= target)
+        {
+            cumulative += model.freq[context][symbol++];
+        }
+
+        code -= step * cumulative;
+        range = step * model.freq[context][symbol];
+        while (range < (1u << 24))
+        {
+            if (next == end)
+            {
+                return false;
+            }
+            code = (code << 8) | *next++;
+            range <<= 8;
+        }
+
+        moves[i] = (Uint8)(symbol + 1);
+        model.update(context, symbol);
+        context = (context * 3 + symbol) % 9;
+    }
+
+    return true;
+}
+
+//
+// LColumnStore functions
+//
+
+
+LColumnStore::LColumnStore()
+{
+    mRows = 0;
+    mChunks = 0;
+}
+
+bool LColumnStore::readManifest(const char* dir, StoreManifest& manifest)
+{
+    manifest.found = false;
+    manifest.rows = 0;
+    manifest.chunks = 0;
+    for (int c = 0; c < STORE_COLUMN_COUNT; ++c)
+    {
+        manifest.lengths[c] = 0;
+    }
+    manifest.sessions.clear();
+
+    std::string path = std::string(dir) + "/manifest.txt";
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == NULL)
+    {
+        return true;
+    }
+
+    char line[512];
+    unsigned version = 0;
+    unsigned long long values[2 + STORE_COLUMN_COUNT];
+    bool success = fgets(line, sizeof(line), file) != NULL && sscanf(line, "RPSS %u %llu %llu %llu %llu %llu %llu %llu %llu", &version, &values[0], &values[1],
+        &values[2], &values[3], &values[4], &values[5], &values[6], &values[7]) == 3 + STORE_COLUMN_COUNT && version == COLUMN_VERSION;
+    while (success && fgets(line, sizeof(line), file) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        manifest.sessions.push_back(line);
+    }
+    fclose(file);
+
+    if (!success)
+    {
+        printf("Column store manifest %s is damaged or from another version.\n", path.c_str());
+        return false;
+    }
+
+    manifest.found = true;
+    manifest.rows = values[0];
+    manifest.chunks = values[1];
+    for (int c = 0; c < STORE_COLUMN_COUNT; ++c)
+    {
+        manifest.lengths[c] = values[2 + c];
+    }
+    return true;
+}
+
+bool LColumnStore::open(const char* dir)
+{
+    close();
+
+    StoreManifest manifest;
+    if (!readManifest(dir, manifest))
+    {
+        return false;
+    }
+    if (!manifest.found)
+    {
+        printf("No column store in %s.\n", dir);
+        return false;
+    }
+
+    std::string base = std::string(dir) + "/";
+    for (int c = 0; c < STORE_COLUMN_COUNT; ++c)
+    {
+        std::string path = base + STORE_COLUMNS[c].name + ".col";
+        if (!mFiles[c].open(path))
+        {
+            printf("Unable to map column %s.\n", path.c_str());
+            close();
+            return false;
+        }
+
+        //Only the committed length counts, anything after it is from an import that didn't finish
+        const Uint8* data = mFiles[c].getData();
+        Uint64 length = manifest.lengths[c];
+        Uint32 width = STORE_COLUMNS[c].width;
+        const ColumnHeader* header = (const ColumnHeader*)data;
+        bool valid = mFiles[c].getSize() >= length && length >= COLUMN_DATA_START && memcmp(header->magic, COLUMN_MAGIC, 4) == 0 &&
+            header->version == COLUMN_VERSION && header->width == width && header->chunkRows == COLUMN_CHUNK_ROWS;
+
+        //Chunks are walked from their summaries, each says how many values follow it
+        Uint64 offset = COLUMN_DATA_START;
+        Uint64 rows = 0;
+        for (Uint64 k = 0; valid && k < manifest.chunks; ++k)
+        {
+            const ColumnChunk* chunk = (const ColumnChunk*)(data + offset);
+            valid = offset + COLUMN_ALIGN <= length && chunk->count > 0 && chunk->count <= COLUMN_CHUNK_ROWS &&
+                offset + COLUMN_ALIGN + alignColumn(chunk->count * width) <= length;
+            if (valid)
+            {
+                mChunkTables[c].push_back(chunk);
+                mValues[c].push_back(data + offset + COLUMN_ALIGN);
+                rows += chunk->count;
+                offset += COLUMN_ALIGN + alignColumn(chunk->count * width);
+            }
+        }
+
+        if (!valid || offset != length || rows != manifest.rows)
+        {
+            printf("Column %s is damaged or doesn't match the manifest.\n", path.c_str());
+            close();
+            return false;
+        }
+    }
+
+    mRows = manifest.rows;
+    mChunks = manifest.chunks;
+    mSessions = manifest.sessions;
+    for (size_t s = 0; s < mSessions.size(); ++s)
+    {
+        mSessionAi.push_back(mSessions[s].substr(0, mSessions[s].find(' ')));
+    }
+    return true;
+}
+
+void LColumnStore::close()
+{
+    for (int c = 0; c < STORE_COLUMN_COUNT; ++c)
+    {
+        mFiles[c].close();
+        mChunkTables[c].clear();
+        mValues[c].clear();
+    }
+    mRows = 0;
+    mChunks = 0;
+    mSessions.clear();
+    mSessionAi.clear();
+}
+
+Uint64 LColumnStore::getRows()
+{
+    return mRows;
+}
+
+Uint64 LColumnStore::getChunks()
+{
+    return mChunks;
+}
+
+const ColumnChunk& LColumnStore::getChunk(int column, Uint64 chunk)
+{
+    return *mChunkTables[column][chunk];
+}
+
+const Uint8* LColumnStore::getValues(int column, Uint64 chunk)
+{
+    return mValues[column][chunk];
+}
+
+int LColumnStore::getSessionCount()
+{
+    return (int)mSessionAi.size();
+}
+
+const std::string& LColumnStore::getSessionAi(int session)
+{
+    return mSessionAi[session];
+}
+
+//Reads a little endian value of width bytes
+static Uint64 loadColumnValue(const Uint8* data, Uint32 width)
+{
+    Uint64 value = 0;
+    memcpy(&value, data, width);
+    return value;
+}
+
+bool LColumnStore::append(const char* dir, const std::vector<Uint8> columns[STORE_COLUMN_COUNT], const std::vector<std::string>& sessions)
+{
+#ifdef _WIN32
+    _mkdir(dir);
+#else
+    mkdir(dir, 0755);
+#endif
+
+    StoreManifest manifest;
+    if (!readManifest(dir, manifest))
+    {
+        return false;
+    }
+
+    static const Uint8 padding[COLUMN_ALIGN] = {};
+    std::string base = std::string(dir) + "/";
+    Uint64 rows = columns[0].size() / STORE_COLUMNS[0].width;
+    Uint64 chunks = (rows + COLUMN_CHUNK_ROWS - 1) / COLUMN_CHUNK_ROWS;
+    for (int c = 0; c < STORE_COLUMN_COUNT; ++c)
+    {
+        //A new store starts its columns over, an existing one writes from its committed end
+        Uint32 width = STORE_COLUMNS[c].width;
+        std::string path = base + STORE_COLUMNS[c].name + ".col";
+        FILE* file = fopen(path.c_str(), manifest.found ? "r+b" : "wb");
+        if (file == NULL)
+        {
+            printf("Unable to write column %s.\n", path.c_str());
+            return false;
+        }
+
+        bool success;
+        Uint64 offset;
+        if (manifest.found)
+        {
+            offset = manifest.lengths[c];
+            success = seekFile(file, offset);
+        }
+        else
+        {
+            ColumnHeader header;
+            memcpy(header.magic, COLUMN_MAGIC, 4);
+            header.version = COLUMN_VERSION;
+            header.width = width;
+            header.chunkRows = COLUMN_CHUNK_ROWS;
+            offset = COLUMN_DATA_START;
+            success = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(padding, 1, COLUMN_DATA_START - sizeof(header), file) == COLUMN_DATA_START - sizeof(header);
+        }
+
+        for (Uint64 k = 0; success && k < chunks; ++k)
+        {
+            Uint64 first = k * COLUMN_CHUNK_ROWS;
+            ColumnChunk chunk;
+            chunk.count = rows - first < COLUMN_CHUNK_ROWS ? rows - first : COLUMN_CHUNK_ROWS;
+            chunk.min = ~(Uint64)0;
+            chunk.max = 0;
+            chunk.reserved = 0;
+            for (Uint64 i = first; i < first + chunk.count; ++i)
+            {
+                Uint64 value = loadColumnValue(&columns[c][i * width], width);
+                chunk.min = value < chunk.min ? value : chunk.min;
+                chunk.max = value > chunk.max ? value : chunk.max;
+            }
+
+            size_t size = (size_t)(chunk.count * width);
+            size_t pad = (size_t)(alignColumn(size) - size);
+            success = fwrite(&chunk, sizeof(chunk), 1, file) == 1 && fwrite(padding, 1, COLUMN_ALIGN - sizeof(chunk), file) == COLUMN_ALIGN - sizeof(chunk) &&
+                fwrite(&columns[c][first * width], 1, size, file) == size && fwrite(padding, 1, pad, file) == pad;
+            offset += COLUMN_ALIGN + size + pad;
+        }
+        success = fclose(file) == 0 && success;
+
+        if (!success)
+        {
+            printf("Unable to write column %s.\n", path.c_str());
+            return false;
+        }
+        manifest.lengths[c] = offset;
+    }
+
+    //Renaming the manifest into place commits every column's new chunks and the sessions at once
+    std::string path = base + "manifest.txt";
+    std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "w");
+    if (file == NULL)
+    {
+        printf("Unable to write %s.\n", temp.c_str());
+        return false;
+    }
+    fprintf(file, "RPSS %u %llu %llu", COLUMN_VERSION, (unsigned long long)(manifest.rows + rows), (unsigned long long)(manifest.chunks + chunks));
+    for (int c = 0; c < STORE_COLUMN_COUNT; ++c)
+    {
+        fprintf(file, " %llu", (unsigned long long)manifest.lengths[c]);
+    }
+    fprintf(file, "\n");
+    manifest.sessions.insert(manifest.sessions.end(), sessions.begin(), sessions.end());
+    for (size_t s = 0; s < manifest.sessions.size(); ++s)
+    {
+        fprintf(file, "%s\n", manifest.sessions[s].c_str());
+    }
+    bool success = !ferror(file);
+    success = fclose(file) == 0 && success;
+
+    if (!success || !replaceFile(temp.c_str(), path.c_str()))
+    {
+        printf("Unable to write %s.\n", path.c_str());
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool LColumnStore::importReplay(const char* dir, const char* path)
+{
+    LReplayReader replay;
+    if (!replay.open(path))
+    {
+        return false;
+    }
+
+    //Queries key moves and outcomes on 1 to 3
+    if (replay.getHeader().weapons != 3)
+    {
+        printf("Only rock paper scissors replays can be imported, %s has %u weapons.\n", path, replay.getHeader().weapons);
+        return false;
+    }
+
+    //Only the new session's rows are built, they go after the committed ones
+    StoreManifest manifest;
+    if (!readManifest(dir, manifest))
+    {
+        return false;
+    }
+
+    const ReplayHeader& header = replay.getHeader();
+    Uint64 rows = replay.getCount();
+    Uint32 session = (Uint32)manifest.sessions.size();
+    std::vector<Uint8> columns[STORE_COLUMN_COUNT];
+    for (int c = 0; c < STORE_COLUMN_COUNT; ++c)
+    {
+        columns[c].reserve(rows * STORE_COLUMNS[c].width);
+    }
+
+    Uint64 micros = (Uint64)header.startTime * 1000000;
+    int streak = 0;
+    for (Uint64 i = 0; i < rows; ++i)
+    {
+        const ReplayRound& round = replay.getRound(i);
+        micros += round.dtMicros;
+        columns[STORE_PLAYER].push_back(round.player);
+        columns[STORE_COMPUTER].push_back(round.computer);
+        columns[STORE_OUTCOME].push_back(round.winner);
+        columns[STORE_TIME].insert(columns[STORE_TIME].end(), (const Uint8*)&micros, (const Uint8*)&micros + 8);
+        columns[STORE_SESSION].insert(columns[STORE_SESSION].end(), (const Uint8*)&session, (const Uint8*)&session + 4);
+        columns[STORE_STREAK].push_back((Uint8)(streak < 255 ? streak : 255));
+        streak = round.winner == 1 ? streak + 1 : 0;
+    }
+
+    char ai[sizeof(header.ai) + 1] = {};
+    memcpy(ai, header.ai, sizeof(header.ai));
+    char line[1024];
+    snprintf(line, sizeof(line), "%s %llu %s", ai[0] != '\0' ? ai : "unknown", (unsigned long long)header.seed, path);
+
+    return append(dir, columns, std::vector<std::string>(1, line));
+}
+
+//
+// Statistics queries
+//
+
+
+typedef void (*Filter8Kernel)(const Uint8* values, size_t n, Uint8 min, Uint8 max, Uint8* mask);
+typedef void (*Filter32Kernel)(const Uint32* values, size_t n, Uint32 min, Uint32 max, Uint8* mask);
+typedef void (*CountKernel)(const Uint8* outcomes, const Uint8* mask, size_t n, Uint64 counts[4]);
+
+//Masks are 0xFF for rows still in and 0 for rows filtered out, filters only ever clear them
+static void filter8Scalar(const Uint8* values, size_t n, Uint8 min, Uint8 max, Uint8* mask)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        mask[i] &= (Uint8)(values[i] - min) <= (Uint8)(max - min) ? 0xFF : 0;
+    }
+}
+
+static void filter32Scalar(const Uint32* values, size_t n, Uint32 min, Uint32 max, Uint8* mask)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        mask[i] &= values[i] - min <= max - min ? 0xFF : 0;
+    }
+}
+
+static void filter64Scalar(const Uint64* values, size_t n, Uint64 min, Uint64 max, Uint8* mask)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        mask[i] &= values[i] - min <= max - min ? 0xFF : 0;
+    }
+}
+
+static void countScalar(const Uint8* outcomes, const Uint8* mask, size_t n, Uint64 counts[4])
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        counts[outcomes[i] & 3] += mask[i] & 1;
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+//In range when value - min doesn't pass max - min, compared unsigned through min
+__attribute__((target("sse2")))
+static void filter8SSE2(const Uint8* values, size_t n, Uint8 min, Uint8 max, Uint8* mask)
+{
+    const __m128i low = _mm_set1_epi8((char)min);
+    const __m128i span = _mm_set1_epi8((char)(max - min));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i d = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(values + i)), low);
+        __m128i in = _mm_cmpeq_epi8(_mm_min_epu8(d, span), d);
+        _mm_storeu_si128((__m128i*)(mask + i), _mm_and_si128(_mm_loadu_si128((const __m128i*)(mask + i)), in));
+    }
+
+    filter8Scalar(values + i, n - i, min, max, mask + i);
+}
+
+//SSE2 has no unsigned 32-bit compare, flipping the sign bits turns it into a signed one
+__attribute__((target("sse2")))
+static void filter32SSE2(const Uint32* values, size_t n, Uint32 min, Uint32 max, Uint8* mask)
+{
+    const __m128i low = _mm_set1_epi32((int)min);
+    const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+    const __m128i span = _mm_xor_si128(_mm_set1_epi32((int)(max - min)), sign);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i out[4];
+        for (int k = 0; k < 4; ++k)
+        {
+            __m128i d = _mm_xor_si128(_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(values + i + k * 4)), low), sign);
+            out[k] = _mm_cmpgt_epi32(d, span);
+        }
+        __m128i outside = _mm_packs_epi16(_mm_packs_epi32(out[0], out[1]), _mm_packs_epi32(out[2], out[3]));
+        _mm_storeu_si128((__m128i*)(mask + i), _mm_andnot_si128(outside, _mm_loadu_si128((const __m128i*)(mask + i))));
+    }
+
+    filter32Scalar(values + i, n - i, min, max, mask + i);
+}
+
+//Byte counters take up to 255 blocks before they're summed into 64 bits
+__attribute__((target("sse2")))
+static void countSSE2(const Uint8* outcomes, const Uint8* mask, size_t n, Uint64 counts[4])
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i values[3] = { _mm_set1_epi8(1), _mm_set1_epi8(2), _mm_set1_epi8(3) };
+    size_t i = 0;
+    while (i + 16 <= n)
+    {
+        __m128i tally[3] = { zero, zero, zero };
+        for (int block = 0; block < 255 && i + 16 <= n; ++block, i += 16)
+        {
+            __m128i outcome = _mm_loadu_si128((const __m128i*)(outcomes + i));
+            __m128i in = _mm_loadu_si128((const __m128i*)(mask + i));
+            for (int k = 0; k < 3; ++k)
+            {
+                tally[k] = _mm_sub_epi8(tally[k], _mm_and_si128(_mm_cmpeq_epi8(outcome, values[k]), in));
+            }
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            __m128i sums = _mm_sad_epu8(tally[k], zero);
+            counts[k + 1] += (Uint64)_mm_cvtsi128_si32(sums) + (Uint64)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+        }
+    }
+
+    countScalar(outcomes + i, mask + i, n - i, counts);
+}
+
+__attribute__((target("avx2")))
+static void filter8AVX2(const Uint8* values, size_t n, Uint8 min, Uint8 max, Uint8* mask)
+{
+    const __m256i low = _mm256_set1_epi8((char)min);
+    const __m256i span = _mm256_set1_epi8((char)(max - min));
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i d = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)(values + i)), low);
+        __m256i in = _mm256_cmpeq_epi8(_mm256_min_epu8(d, span), d);
+        _mm256_storeu_si256((__m256i*)(mask + i), _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(mask + i)), in));
+    }
+
+    filter8SSE2(values + i, n - i, min, max, mask + i);
+}
+
+__attribute__((target("avx2")))
+static void countAVX2(const Uint8* outcomes, const Uint8* mask, size_t n, Uint64 counts[4])
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i values[3] = { _mm256_set1_epi8(1), _mm256_set1_epi8(2), _mm256_set1_epi8(3) };
+    size_t i = 0;
+    while (i + 32 <= n)
+    {
+        __m256i tally[3] = { zero, zero, zero };
+        for (int block = 0; block < 255 && i + 32 <= n; ++block, i += 32)
+        {
+            __m256i outcome = _mm256_loadu_si256((const __m256i*)(outcomes + i));
+            __m256i in = _mm256_loadu_si256((const __m256i*)(mask + i));
+            for (int k = 0; k < 3; ++k)
+            {
+                tally[k] = _mm256_sub_epi8(tally[k], _mm256_and_si256(_mm256_cmpeq_epi8(outcome, values[k]), in));
+            }
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            Uint64 sums[4];
+            _mm256_storeu_si256((__m256i*)sums, _mm256_sad_epu8(tally[k], zero));
+            counts[k + 1] += sums[0] + sums[1] + sums[2] + sums[3];
+        }
+    }
+
+    countSSE2(outcomes + i, mask + i, n - i, counts);
+}
+#endif
+
+//Query kernels from slowest to fastest
+struct StoreKernelEntry
+{
+    const char* name;
+    Filter8Kernel filter8;
+    Filter32Kernel filter32;
+    CountKernel count;
+    SDL_bool (*supported)();
+};
+
+const StoreKernelEntry gStoreKernels[] = {
+    { "scalar", filter8Scalar, filter32Scalar, countScalar, alwaysSupported },
+#ifdef HAVE_X86_KERNELS
+    { "sse2", filter8SSE2, filter32SSE2, countSSE2, SDL_HasSSE2 },
+    { "avx2", filter8AVX2, filter32SSE2, countAVX2, SDL_HasAVX2 },
+#endif
+};
+const int STORE_KERNEL_COUNT = sizeof(gStoreKernels) / sizeof(gStoreKernels[0]);
+
+//Index of the fastest supported query kernels
+static int pickStoreKernel()
+{
+    int best = 0;
+    for (int i = 0; i < STORE_KERNEL_COUNT; ++i)
+    {
+        if (gStoreKernels[i].supported())
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+//Gets the fastest supported query kernels, picked once by a thread safe static initializer
+static const StoreKernelEntry& getStoreKernel()
+{
+    static const int best = pickStoreKernel();
+    return gStoreKernels[best];
+}
+
+//Groupings, each keyed by a column or by a value derived from one
+enum QueryGroup
+{
+    QUERY_NONE,
+    QUERY_PLAYER,
+    QUERY_COMPUTER,
+    QUERY_OUTCOME,
+    QUERY_STREAK,
+    QUERY_HOUR,
+    QUERY_SESSION,
+    QUERY_AI
+};
+
+struct QueryGroupInfo
+{
+    const char* name;
+    //Column the key is read from, -1 for none
+    int column;
+};
+
+const QueryGroupInfo QUERY_GROUPS[] = {
+    { "none", -1 },
+    { "player", STORE_PLAYER },
+    { "computer", STORE_COMPUTER },
+    { "outcome", STORE_OUTCOME },
+    { "streak", STORE_STREAK },
+    { "hour", STORE_TIME },
+    { "session", STORE_SESSION },
+    { "ai", STORE_SESSION },
+};
+const int QUERY_GROUP_COUNT = sizeof(QUERY_GROUPS) / sizeof(QUERY_GROUPS[0]);
+
+//Keys spanning at most this many values in a chunk are counted one vectorized pass per key
+const Uint64 QUERY_PASS_KEYS = 16;
+
+struct QueryStats
+{
+    Uint64 scanned;
+    Uint64 skipped;
+};
+
+//Adds the outcome counts of every row passing the filters to tallies, four per group key
+static QueryStats queryStore(LColumnStore& store, int group, const std::vector<StoreFilter>& filters, const StoreKernelEntry& kernel, std::vector<Uint64>& tallies)
+{
+    std::vector<Uint8> mask(COLUMN_CHUNK_ROWS);
+    std::vector<Uint8> keyMask(COLUMN_CHUNK_ROWS);
+    QueryStats stats = { 0, 0 };
+    int keyColumn = QUERY_GROUPS[group].column;
+
+    for (Uint64 c = 0; c < store.getChunks(); ++c)
+    {
+        size_t n = (size_t)store.getChunk(STORE_OUTCOME, c).count;
+
+        //Summaries settle most filters for the whole chunk, only the rest are evaluated per row
+        bool skip = false;
+        memset(&mask[0], 0xFF, n);
+        for (size_t f = 0; f < filters.size() && !skip; ++f)
+        {
+            const StoreFilter& filter = filters[f];
+            const ColumnChunk& summary = store.getChunk(filter.column, c);
+            if (summary.max < filter.min || summary.min > filter.max)
+            {
+                skip = true;
+            }
+            else if (summary.min < filter.min || summary.max > filter.max)
+            {
+                const Uint8* values = store.getValues(filter.column, c);
+                switch (STORE_COLUMNS[filter.column].width)
+                {
+                case 1:
+                    kernel.filter8(values, n, (Uint8)(filter.min < 255 ? filter.min : 255), (Uint8)(filter.max < 255 ? filter.max : 255), &mask[0]);
+                    break;
+
+                case 4:
+                    kernel.filter32((const Uint32*)values, n, (Uint32)(filter.min < 0xFFFFFFFF ? filter.min : 0xFFFFFFFF),
+                        (Uint32)(filter.max < 0xFFFFFFFF ? filter.max : 0xFFFFFFFF), &mask[0]);
+                    break;
+
+                default:
+                    filter64Scalar((const Uint64*)values, n, filter.min, filter.max, &mask[0]);
+                    break;
+                }
+            }
+        }
+
+        if (skip)
+        {
+            ++stats.skipped;
+            continue;
+        }
+        ++stats.scanned;
+
+        const Uint8* outcomes = store.getValues(STORE_OUTCOME, c);
+        if (keyColumn < 0)
+        {
+            kernel.count(outcomes, &mask[0], n, &tallies[0]);
+            continue;
+        }
+
+        const Uint8* keys = store.getValues(keyColumn, c);
+        if (group == QUERY_HOUR)
+        {
+            //Hours of the day in UTC
+            const Uint64* times = (const Uint64*)keys;
+            for (size_t i = 0; i < n; ++i)
+            {
+                tallies[times[i] / 3600000000ULL % 24 * 4 + (outcomes[i] & 3)] += mask[i] & 1;
+            }
+            continue;
+        }
+
+        //A chunk usually holds a handful of keys, one masked pass each beats scattering counts per row
+        const ColumnChunk& summary = store.getChunk(keyColumn, c);
+        if (summary.max - summary.min < QUERY_PASS_KEYS)
+        {
+            for (Uint64 key = summary.min; key <= summary.max; ++key)
+            {
+                memcpy(&keyMask[0], &mask[0], n);
+                if (keyColumn == STORE_SESSION)
+                {
+                    kernel.filter32((const Uint32*)keys, n, (Uint32)key, (Uint32)key, &keyMask[0]);
+                }
+                else
+                {
+                    kernel.filter8(keys, n, (Uint8)key, (Uint8)key, &keyMask[0]);
+                }
+                kernel.count(outcomes, &keyMask[0], n, &tallies[key * 4]);
+            }
+        }
+        else if (keyColumn == STORE_SESSION)
+        {
+            const Uint32* sessions = (const Uint32*)keys;
+            for (size_t i = 0; i < n; ++i)
+            {
+                tallies[(Uint64)sessions[i] * 4 + (outcomes[i] & 3)] += mask[i] & 1;
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                tallies[keys[i] * 4 + (outcomes[i] & 3)] += mask[i] & 1;
+            }
+        }
+    }
+
+    return stats;
+}
+
+//Number of keys a grouping can produce
+static Uint64 queryKeyCount(LColumnStore& store, int group)
+{
+    switch (group)
+    {
+    case QUERY_NONE:
+        return 1;
+
+    case QUERY_STREAK:
+        return 256;
+
+    case QUERY_HOUR:
+        return 24;
+
+    case QUERY_SESSION:
+    case QUERY_AI:
+        return store.getSessionCount() > 0 ? store.getSessionCount() : 1;
+
+    default:
+        return 4;
+    }
+}
+
+int runQuery()
+{
+    int group = -1;
+    for (int g = 0; g < QUERY_GROUP_COUNT; ++g)
+    {
+        if (strcmp(gQueryGroup, QUERY_GROUPS[g].name) == 0)
+        {
+            group = g;
+        }
+    }
+    if (group < 0)
+    {
+        printf("Unknown grouping %s.\n", gQueryGroup);
+        return 1;
+    }
+
+    LColumnStore store;
+    if (!store.open(gStorePath))
+    {
+        return 1;
+    }
+
+    //Keys index the tallies, so a damaged store could hold session ids past the list or moves past 3
+    std::vector<Uint64> tallies(queryKeyCount(store, group) * 4);
+    for (Uint64 c = 0; c < store.getChunks(); ++c)
+    {
+        if (store.getChunk(STORE_SESSION, c).max >= (Uint64)store.getSessionCount())
+        {
+            printf("Column store %s has rows for sessions it doesn't list.\n", gStorePath);
+            return 1;
+        }
+        if (store.getChunk(STORE_PLAYER, c).max > 3 || store.getChunk(STORE_COMPUTER, c).max > 3 || store.getChunk(STORE_OUTCOME, c).max > 3)
+        {
+            printf("Column store %s has moves or outcomes outside rock paper scissors.\n", gStorePath);
+            return 1;
+        }
+    }
+
+    const StoreKernelEntry& kernel = getStoreKernel();
+    Uint64 start = SDL_GetPerformanceCounter();
+    QueryStats stats = queryStore(store, group, gQueryFilters, kernel, tallies);
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    //Strategies are per session, so sessions fold into their computer strategy
+    std::vector<std::string> names;
+    if (group == QUERY_AI)
+    {
+        std::vector<Uint64> byAi;
+        for (int s = 0; s < store.getSessionCount(); ++s)
+        {
+            size_t index = std::find(names.begin(), names.end(), store.getSessionAi(s)) - names.begin();
+            if (index == names.size())
+            {
+                names.push_back(store.getSessionAi(s));
+                byAi.resize(byAi.size() + 4);
+            }
+            for (int k = 0; k < 4; ++k)
+            {
+                byAi[index * 4 + k] += tallies[s * 4 + k];
+            }
+        }
+        tallies = byAi;
+    }
+
+    printf("%-12s %12s %8s %8s %8s\n", QUERY_GROUPS[group].name, "rounds", "win %", "loss %", "draw %");
+    for (size_t key = 0; key < tallies.size() / 4; ++key)
+    {
+        const Uint64* counts = &tallies[key * 4];
+        Uint64 rounds = counts[0] + counts[1] + counts[2] + counts[3];
+        if (rounds == 0)
+        {
+            continue;
+        }
+
+        char label[64];
+        if (group == QUERY_AI)
+        {
+            snprintf(label, sizeof(label), "%s", names[key].c_str());
+        }
+        else if (group == QUERY_NONE)
+        {
+            snprintf(label, sizeof(label), "all");
+        }
+        else
+        {
+            snprintf(label, sizeof(label), "%llu", (unsigned long long)key);
+        }
+        printf("%-12s %12llu %8.2f %8.2f %8.2f\n", label, (unsigned long long)rounds, 100.0 * counts[1] / rounds, 100.0 * counts[2] / rounds, 100.0 * counts[3] / rounds);
+    }
+
+    printf("Scanned %llu of %llu chunks (%llu skipped by summaries) in %.2f ms with %s kernels, %.0f M rows/s\n", (unsigned long long)stats.scanned,
+        (unsigned long long)store.getChunks(), (unsigned long long)stats.skipped, seconds * 1000.0, kernel.name,
+        seconds > 0 ? store.getRows() / seconds / 1e6 : 0.0);
+    return 0;
+}
+
+//
+// Game functions
+//
+
+
+int playRound(int pChoice, int& cChoice, LBot& computer, Scoreboard& score)
+{
+    cChoice = computer.move();
+    int winner = gRules.outcome(pChoice, cChoice);
+    computer.observe(cChoice, pChoice);
+    scoreRound(winner, score);
+
+    return winner;
+}
+
+int playRound(GameSession& session, int pChoice, LBot& computer)
+{
+    session.pChoice = pChoice;
+    session.winner = playRound(pChoice, session.cChoice, computer, session.score);
+    return session.winner;
+}
+
+void scoreRound(int winner, Scoreboard& score)
+{
+    ++score.rounds;
+    switch (winner)
+    {
+    case 1:
+        ++score.wins;
+        ++score.streak;
+        break;
+
+    case 2:
+        ++score.losses;
+        score.streak = 0;
+        break;
+
+    case 3:
+        ++score.draws;
+        score.streak = 0;
+        break;
+
+    default:
+        break;
+    }
+}
+
+void recordRound(const GameSession& session)
+{
+    if (!gRecorder.isOpen())
+    {
+        return;
+    }
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 micros = (now - gLastRoundTicks) * 1000000 / SDL_GetPerformanceFrequency();
+    gLastRoundTicks = now;
+
+    ReplayRound round;
+    round.player = (Uint8)session.pChoice;
+    round.computer = (Uint8)session.cChoice;
+    round.winner = (Uint8)session.winner;
+    round.reserved = 0;
+    round.dtMicros = micros < 0xFFFFFFFF ? (Uint32)micros : 0xFFFFFFFF;
+    gRecorder.append(round);
+
+    if (gRecorder.needsKeyframe())
+    {
+        gRecorder.addKeyframe(session.score, gComputer);
+    }
+}
+
+bool stepReplay(GameSession& session)
+{
+    if (gReplayNext >= gReplay.getCount())
+    {
+        return false;
+    }
+
+    const ReplayRound& round = gReplay.getRound(gReplayNext++);
+    session.pChoice = round.player;
+    session.cChoice = round.computer;
+    session.winner = round.winner;
+    scoreRound(session.winner, session.score);
+    gComputer->observe(round.computer, round.player);
+    return true;
+}
+
+void seekReplay(Uint64 round, GameSession& session)
+{
+    //Land just after round - 1 and show it, so stepping carries on from there
+    round = round < gReplay.getCount() ? round : gReplay.getCount();
+    gReplay.seek(round, session.score, gComputer);
+    gReplayNext = round;
+    resetRound(session);
+    if (round > 0)
+    {
+        const ReplayRound& shown = gReplay.getRound(round - 1);
+        session.pChoice = shown.player;
+        session.cChoice = shown.computer;
+        session.winner = shown.winner;
+    }
+}
+
+void resetRound(GameSession& session)
+{
+    session.winner = 0;
+    session.pChoice = 0;
+    session.cChoice = 0;
+}
+
+int runHeadless()
+{
+    LBot* player = createBot(gPlayerBot);
+    if (player == NULL)
+    {
+        printf("Unknown player strategy %s.\n", gPlayerBot);
+        return 1;
+    }
+
+    GameSession session = { 0, 0, 0, { 0, 0, 0, 0, 0 } };
+    const Scoreboard& score = session.score;
+    int bestStreak = 0;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    int rounds = gRounds > 0 ? gRounds : 1000;
+    for (int i = 0; i < rounds; ++i)
+    {
+        playRound(session, player->move(), *gComputer);
+        player->observe(session.pChoice, session.cChoice);
+        recordRound(session);
+        if (score.streak > bestStreak)
+        {
+            bestStreak = score.streak;
+        }
+        resetRound(session);
+    }
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    //Results are from the player's point of view
+    int played = score.rounds > 0 ? score.rounds : 1;
+    printf("Player strategy: %s\n", gPlayerBot);
+    printf("Computer strategy: %s\n", gComputerBot);
+    printf("Weapons: %d\n", gRules.getCount());
+    printf("Seed: %llu\n", (unsigned long long)gSeed);
+    printf("Rounds: %d\n", score.rounds);
+    printf("Wins: %d (%.2f%%)\n", score.wins, 100.0 * score.wins / played);
+    printf("Losses: %d (%.2f%%)\n", score.losses, 100.0 * score.losses / played);
+    printf("Draws: %d (%.2f%%)\n", score.draws, 100.0 * score.draws / played);
+    printf("Longest win streak: %d\n", bestStreak);
+    printf("Elapsed: %.3f s (%.0f rounds/s)\n", seconds, seconds > 0 ? score.rounds / seconds : 0.0);
+
+    delete player;
+    return 0;
+}
+
+int runReplaySummary()
+{
+    const ReplayHeader& header = gReplay.getHeader();
+    Uint64 count = gReplay.getCount();
+    Uint64 counts[4] = { 0, 0, 0, 0 };
+    Uint64 mismatches = 0;
+    Uint64 micros = 0;
+
+    //Every round is checked against the rules it claims to have been played with
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (Uint64 i = 0; i < count; ++i)
+    {
+        const ReplayRound& round = gReplay.getRound(i);
+        ++counts[round.winner & 3];
+        mismatches += gRules.outcome(round.player, round.computer) != round.winner;
+        micros += round.dtMicros;
+    }
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    Uint64 played = count > 0 ? count : 1;
+    char ai[sizeof(header.ai) + 1] = {};
+    memcpy(ai, header.ai, sizeof(header.ai));
+    printf("Replay: %s\n", gReplayPath);
+    printf("Computer strategy: %s\n", ai);
+    printf("Weapons: %u\n", header.weapons);
+    printf("Seed: %llu\n", (unsigned long long)header.seed);
+    printf("Rounds: %llu over %.3f s of play\n", (unsigned long long)count, micros / 1e6);
+    printf("Wins: %llu (%.2f%%)\n", (unsigned long long)counts[1], 100.0 * counts[1] / played);
+    printf("Losses: %llu (%.2f%%)\n", (unsigned long long)counts[2], 100.0 * counts[2] / played);
+    printf("Draws: %llu (%.2f%%)\n", (unsigned long long)counts[3], 100.0 * counts[3] / played);
+    printf("Rounds that don't match the rules: %llu\n", (unsigned long long)mismatches);
+    printf("Read in %.3f s (%.0f rounds/s)\n", seconds, seconds > 0 ? count / seconds : 0.0);
+    printf("Keyframes: %d%s\n", gReplay.getKeyframeCount(), gReplay.hasIndex() ? "" : " (built by scan, the log has no index)");
+
+    //What the moves alone would archive to, the codecs only take rock paper scissors
+    if (header.weapons == 3 && mismatches == 0 && count > 0)
+    {
+        std::vector<Uint8> moves(count);
+        std::vector<Uint8> coded;
+        for (int side = 0; side < 2; ++side)
+        {
+            for (Uint64 i = 0; i < count; ++i)
+            {
+                moves[i] = side == 0 ? gReplay.getRound(i).player : gReplay.getRound(i).computer;
+            }
+            LMoveCoder::encode(&moves[0], count, coded);
+        }
+        printf("Moves archive to %.1f KB packed, %.1f KB range coded (%.3f bits a move)\n", 2 * packedMoveSize(count) / 1024.0, coded.size() / 1024.0,
+            coded.size() * 8.0 / (2 * count));
+    }
+
+    //Seeking must land on the same score as counting every round up to it
+    bool seekMatches = true;
+    if (gReplayStart > 0)
+    {
+        Uint64 target = gReplayStart < count ? gReplayStart : count;
+        LBot* bot = createBot(ai);
+        Scoreboard seeked = { 0, 0, 0, 0, 0 };
+        start = SDL_GetPerformanceCounter();
+        bool restored = gReplay.seek(target, seeked, bot);
+        double seekSeconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+        delete bot;
+
+        Scoreboard scanned = { 0, 0, 0, 0, 0 };
+        for (Uint64 i = 0; i < target; ++i)
+        {
+            scoreRound(gReplay.getRound(i).winner, scanned);
+        }
+        seekMatches = memcmp(&seeked, &scanned, sizeof(Scoreboard)) == 0;
+
+        printf("Seek to round %llu: %.1f us from keyframe %llu, computer %s\n", (unsigned long long)target, seekSeconds * 1e6,
+            (unsigned long long)gReplay.findKeyframe(target).round, restored ? "restored" : "not restored");
+        printf("Score there: wins %d, losses %d, draws %d, streak %d (%s a full scan)\n", seeked.wins, seeked.losses, seeked.draws, seeked.streak,
+            seekMatches ? "matches" : "DOES NOT MATCH");
+    }
+
+    return mismatches == 0 && seekMatches ? 0 : 1;
+}
+
+//
+// Benchmarks
+//
+
+
+static int benchCheckWin()
+{
+    //Every byte pair must match the scalar function exactly
+    const size_t pairs = 256 * 256;
+    std::vector<uint8_t> p(pairs), c(pairs), out(pairs);
+    for (size_t i = 0; i < pairs; ++i)
+    {
+        p[i] = (uint8_t)(i >> 8);
+        c[i] = (uint8_t)i;
+    }
+
+    bool exact = true;
+    for (int k = 0; k < CHECKWIN_KERNEL_COUNT; ++k)
+    {
+        if (!gCheckWinKernels[k].supported())
+        {
+            continue;
+        }
+
+        gCheckWinKernels[k].kernel(&p[0], &c[0], &out[0], pairs);
+        for (size_t i = 0; i < pairs; ++i)
+        {
+            if (out[i] != checkWin(p[i], c[i]))
+            {
+                printf("%s kernel mismatch for %d vs %d: %d, expected %d\n", gCheckWinKernels[k].name, p[i], c[i], out[i], checkWin(p[i], c[i]));
+                exact = false;
+                break;
+            }
+        }
+    }
+
+    //Throughput over random valid moves
+    const size_t n = 1 << 16;
+    p.resize(n);
+    c.resize(n);
+    out.resize(n);
+    threadRandom().fill(&p[0], n);
+    threadRandom().fill(&c[0], n);
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    const int passes = 2000;
+    unsigned sink = 0;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            out[i] = (uint8_t)checkWin(p[i], c[i]);
+        }
+        sink += out[pass % n];
+    }
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+    printf("checkWin    %10.1f M matches/s\n", passes * (double)n / seconds / 1e6);
+
+    for (int k = 0; k < CHECKWIN_KERNEL_COUNT; ++k)
+    {
+        if (!gCheckWinKernels[k].supported())
+        {
+            printf("%-11s not supported\n", gCheckWinKernels[k].name);
+            continue;
+        }
+
+        start = SDL_GetPerformanceCounter();
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            gCheckWinKernels[k].kernel(&p[0], &c[0], &out[0], n);
+            sink += out[pass % n];
+        }
+        seconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+        printf("%-11s %10.1f M matches/s\n", gCheckWinKernels[k].name, passes * (double)n / seconds / 1e6);
+    }
+
+    printf("Kernels %s bit-exact with checkWin (checksum %u)\n", exact ? "are" : "are NOT", sink);
+    return exact ? 0 : 1;
+}
+
+static int benchRandom()
+{
+    const size_t n = 1 << 16;
+    const int passes = 1000;
+    std::vector<uint8_t> moves(n);
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    LRandom& random = threadRandom();
+    unsigned sink = 0;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            moves[i] = (uint8_t)(rand() % 3 + 1);
+        }
+        sink += moves[pass % n];
+    }
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+    printf("rand() %% 3 + 1  %8.1f M moves/s\n", passes * (double)n / seconds / 1e6);
+
+    start = SDL_GetPerformanceCounter();
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            moves[i] = (uint8_t)random.move();
+        }
+        sink += moves[pass % n];
+    }
+    seconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+    printf("LRandom::move   %8.1f M moves/s\n", passes * (double)n / seconds / 1e6);
+
+    int counts[4] = { 0, 0, 0, 0 };
+    start = SDL_GetPerformanceCounter();
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        random.fill(&moves[0], n);
+        sink += moves[pass % n];
+    }
+    seconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+    printf("LRandom::fill   %8.1f M moves/s\n", passes * (double)n / seconds / 1e6);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        ++counts[moves[i]];
+    }
+    printf("Last fill: %d rock, %d paper, %d scissors (checksum %u)\n", counts[1], counts[2], counts[3], sink);
+    return 0;
+}
+
+static int benchTextureCache()
+{
+    //Use a scratch cache directory so cold runs really start empty
+    const char* cacheDir = "cache-bench";
+    const char* savedCache = gTextureCache;
+    std::vector<std::string> images = listFiles("media", ".png");
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    const int passes = 20;
+    double decodeMs = 0;
+    double coldMs = 0;
+    double warmMs = 0;
+
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        std::string path = "media/" + images[i];
+
+        gTextureCache = NULL;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            SDL_FreeSurface(loadImage(path));
+        }
+        double decode = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / passes;
+
+        //Cold: the entry is removed before every load so each one decodes and writes
+        struct stat info;
+        size_t size = 0;
+        void* data = SDL_LoadFile(path.c_str(), &size);
+        if (data == NULL || stat(path.c_str(), &info) != 0)
+        {
+            printf("Unable to read image %s.\n", path.c_str());
+            SDL_free(data);
+            continue;
+        }
+        char cachePath[512];
+        snprintf(cachePath, sizeof(cachePath), "%s/%016llx_%llx.rgba", cacheDir, (unsigned long long)hashBytes(data, size), (unsigned long long)info.st_mtime);
+        SDL_free(data);
+
+        gTextureCache = cacheDir;
+        double cold = 0;
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            remove(cachePath);
+            start = SDL_GetPerformanceCounter();
+            SDL_FreeSurface(loadImage(path));
+            cold += (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+        }
+        cold /= passes;
+
+        //Warm: the entry written by the last cold load is reused
+        start = SDL_GetPerformanceCounter();
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            SDL_FreeSurface(loadImage(path));
+        }
+        double warm = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / passes;
+
+        printf("%-16s decode %7.3f ms  cold %7.3f ms  warm %7.3f ms\n", images[i].c_str(), decode, cold, warm);
+        decodeMs += decode;
+        coldMs += cold;
+        warmMs += warm;
+    }
+
+    printf("%-16s decode %7.3f ms  cold %7.3f ms  warm %7.3f ms (%.1fx faster warm than decode)\n", "total", decodeMs, coldMs, warmMs, warmMs > 0 ? decodeMs / warmMs : 0.0);
+    gTextureCache = savedCache;
+    return 0;
+}
+
+static int benchBots()
+{
+    //Time move + observe per round against a random player, in batches so timer cost stays out
+    const int BATCH = 1024;
+    const int batches = 1000;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    std::vector<uint8_t> opponent(BATCH);
+    LRandom& random = threadRandom();
+    bool fast = true;
+
+    printf("%-10s %10s %14s\n", "Bot", "mean ns", "worst batch ns");
+    for (int b = 0; b < BOT_COUNT; ++b)
+    {
+        LBot* bot = gBots[b].create();
+        Uint64 total = 0;
+        Uint64 worst = 0;
+        unsigned sink = 0;
+        for (int batch = 0; batch < batches; ++batch)
+        {
+            random.fill(&opponent[0], BATCH);
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (int i = 0; i < BATCH; ++i)
+            {
+                int mine = bot->move();
+                bot->observe(mine, opponent[i]);
+                sink += mine;
+            }
+            Uint64 ticks = SDL_GetPerformanceCounter() - start;
+            total += ticks;
+            worst = ticks > worst ? ticks : worst;
+        }
+
+        double mean = total * 1e9 / frequency / ((double)batches * BATCH);
+        double worstMean = worst * 1e9 / frequency / BATCH;
+        printf("%-10s %10.1f %14.1f (checksum %u)\n", gBots[b].name, mean, worstMean, sink);
+        if (mean >= 1000.0)
+        {
+            fast = false;
+        }
+        delete bot;
+    }
+
+    printf("Every bot averages under a microsecond per decision: %s\n", fast ? "yes" : "NO");
+    return fast ? 0 : 1;
+}
+
+static int benchSolver()
+{
+    //Random non-symmetric payoffs, solved to a fixed tolerance at growing sizes
+    const int sizes[] = { 3, 5, 31, 101, 255, 501, 1001, 2001, 4001 };
+    const float tolerance = 0.001f;
+    const int maxIterations = 20000;
+    int threads = gThreads > 0 ? gThreads : SDL_GetCPUCount();
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    LRandom random(gSeed);
+
+    printf("Kernel %s, %d threads, tolerance %.3f\n", getSolverKernel().name, threads, tolerance);
+    printf("%6s %10s %12s %12s %12s %10s\n", "N", "iters", "total ms", "ms/iter", "exploit", "value");
+    bool converged = true;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        int n = sizes[s];
+        std::vector<float> payoffs((size_t)n * n);
+        for (size_t i = 0; i < payoffs.size(); ++i)
+        {
+            payoffs[i] = (float)(random.next() >> 40) * (2.0f / 16777216.0f) - 1.0f;
+        }
+
+        LSolver solver;
+        solver.setPayoffs(n, n, &payoffs[0]);
+        Uint64 start = SDL_GetPerformanceCounter();
+        int iterations = solver.solve(tolerance, maxIterations, threads);
+        double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+        printf("%6d %10d %12.1f %12.4f %12.5f %10.4f\n", n, iterations, ms, ms / iterations, solver.getExploitability(), solver.getValue());
+        if (solver.getExploitability() > tolerance)
+        {
+            converged = false;
+        }
+    }
+
+    printf("Every size converged: %s\n", converged ? "yes" : "NO");
+    return converged ? 0 : 1;
+}
+
+static int benchReplay()
+{
+    //Append rounds as fast as the game can produce them, then read them back
+    const char* path = "bench.rpr";
+    const Uint64 rounds = 1 << 24;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    ReplayHeader header = {};
+    memcpy(header.magic, REPLAY_MAGIC, 4);
+    header.version = REPLAY_VERSION;
+    header.seed = gSeed;
+    header.weapons = 3;
+    strncpy(header.ai, "markov", sizeof(header.ai));
+
+    //Keyframes carry a markov model, which learns from every round as it would in a game
+    const Uint32 interval = 4096;
+    LMarkovBot model(3);
+    LReplayWriter writer;
+    if (!writer.open(path, header, interval))
+    {
+        return 1;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    Scoreboard score = { 0, 0, 0, 0, 0 };
+    writer.addKeyframe(score, &model);
+    ReplayRound round = { 0, 0, 0, 0, 1 };
+    for (Uint64 i = 0; i < rounds; ++i)
+    {
+        round.player = (Uint8)(i % 3 + 1);
+        round.computer = (Uint8)(i / 3 % 3 + 1);
+        round.winner = (Uint8)checkWin(round.player, round.computer);
+        writer.append(round);
+        scoreRound(round.winner, score);
+        model.observe(round.computer, round.player);
+        if (writer.needsKeyframe())
+        {
+            writer.addKeyframe(score, &model);
+        }
+    }
+    const char* backend = writer.getBackend();
+    bool written = writer.close();
+    double writeSeconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+
+    LReplayReader reader;
+    bool success = written && reader.open(path) && reader.getCount() == rounds;
+    start = SDL_GetPerformanceCounter();
+    for (Uint64 i = 0; success && i < rounds; ++i)
+    {
+        const ReplayRound& read = reader.getRound(i);
+        success = read.player == i % 3 + 1 && read.computer == i / 3 % 3 + 1 && read.winner == checkWin(read.player, read.computer);
+    }
+    double readSeconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+
+    //Random seeks, each restoring the score and the model
+    const int seeks = 1000;
+    LRandom random(gSeed);
+    LMarkovBot restored(3);
+    Scoreboard seeked;
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; success && i < seeks; ++i)
+    {
+        success = reader.seek(random.next() % rounds, seeked, &restored);
+    }
+    double seekSeconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+
+    //Seeking to the end must agree with the writer's own count
+    success = success && reader.seek(rounds, seeked, &restored) && memcmp(&seeked, &score, sizeof(Scoreboard)) == 0;
+    int keyframes = reader.getKeyframeCount();
+    reader.close();
+    remove(path);
+
+    double megabytes = rounds * sizeof(ReplayRound) / (1024.0 * 1024.0);
+    printf("Appended %llu rounds with %s in %.3f s: %.1f M rounds/s, %.0f MB/s to disk\n", (unsigned long long)rounds, backend, writeSeconds, rounds / writeSeconds / 1e6,
+        megabytes / writeSeconds);
+    printf("Read back in %.3f s: %.1f M rounds/s\n", readSeconds, rounds / readSeconds / 1e6);
+    printf("%d random seeks over %d keyframes: %.1f us each\n", seeks, keyframes, seekSeconds * 1e6 / seeks);
+    printf("Round trip intact: %s\n", success ? "yes" : "NO");
+    return success ? 0 : 1;
+}
+
+static int benchCodec()
+{
+    //Games of each player strategy against a markov computer, both sides' moves archived
+    const char* players[] = { "random", "cycle", "copy", "beatlast", "markov", "history" };
+    const int PLAYER_COUNT = sizeof(players) / sizeof(players[0]);
+    const size_t rounds = 1 << 22;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    bool intact = true;
+
+    printf("%-10s %10s %10s %10s %12s\n", "Player", "int KB", "packed KB", "coded KB", "bits/move");
+    std::vector<Uint8> moves(2 * rounds);
+    std::vector<Uint8> packed(packedMoveSize(rounds));
+    std::vector<Uint8> decoded(rounds);
+    std::vector<Uint8> coded;
+    for (int p = 0; p < PLAYER_COUNT; ++p)
+    {
+        LBot* player = createBot(players[p]);
+        LMarkovBot computer(3);
+        Scoreboard score = { 0, 0, 0, 0, 0 };
+        for (size_t i = 0; i < rounds; ++i)
+        {
+            int pChoice = player->move();
+            int cChoice = 0;
+            playRound(pChoice, cChoice, computer, score);
+            player->observe(pChoice, cChoice);
+            moves[i] = (Uint8)pChoice;
+            moves[rounds + i] = (Uint8)cChoice;
+        }
+        delete player;
+
+        //Each side is its own stream
+        size_t codedSize = 0;
+        for (int side = 0; side < 2; ++side)
+        {
+            coded.clear();
+            LMoveCoder::encode(&moves[side * rounds], rounds, coded);
+            intact = intact && LMoveCoder::decode(&coded[0], coded.size(), rounds, &decoded[0]) && memcmp(&decoded[0], &moves[side * rounds], rounds) == 0;
+            codedSize += coded.size();
+        }
+
+        printf("%-10s %10.0f %10.0f %10.0f %12.3f\n", players[p], 2 * rounds * sizeof(int) / 1024.0, 2 * packed.size() / 1024.0, codedSize / 1024.0,
+            codedSize * 8.0 / (2 * rounds));
+    }
+
+    //Throughput on the last game's player moves, in moves per second (one byte each unpacked)
+    const int passes = 64;
+    for (int k = 0; k < TRIT_KERNEL_COUNT; ++k)
+    {
+        if (!gTritKernels[k].supported())
+        {
+            printf("%-6s not supported\n", gTritKernels[k].name);
+            continue;
+        }
+
+        size_t blocks = rounds / TRIT_BLOCK_MOVES;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            gTritKernels[k].pack(&moves[0], blocks, &packed[0]);
+        }
+        double packSeconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+
+        start = SDL_GetPerformanceCounter();
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            gTritKernels[k].unpack(&packed[0], blocks, &decoded[0]);
+        }
+        double unpackSeconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+        intact = intact && memcmp(&decoded[0], &moves[0], blocks * TRIT_BLOCK_MOVES) == 0;
+
+        double moved = (double)passes * blocks * TRIT_BLOCK_MOVES;
+        printf("%-6s pack %6.2f GB/s, unpack %6.2f GB/s\n", gTritKernels[k].name, moved / packSeconds / 1e9, moved / unpackSeconds / 1e9);
+    }
+
+    coded.clear();
+    Uint64 start = SDL_GetPerformanceCounter();
+    LMoveCoder::encode(&moves[0], rounds, coded);
+    double encodeSeconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+    start = SDL_GetPerformanceCounter();
+    intact = intact && LMoveCoder::decode(&coded[0], coded.size(), rounds, &decoded[0]);
+    double decodeSeconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+    printf("Range coder: encode %.0f M moves/s, decode %.0f M moves/s\n", rounds / encodeSeconds / 1e6, rounds / decodeSeconds / 1e6);
+
+    printf("Round trips intact: %s\n", intact ? "yes" : "NO");
+    return intact ? 0 : 1;
+}
+
+//Deletes the benchmark's store
+static void removeBenchStore(const char* dir)
+{
+    for (int c = 0; c < STORE_COLUMN_COUNT; ++c)
+    {
+        remove((std::string(dir) + "/" + STORE_COLUMNS[c].name + ".col").c_str());
+    }
+    remove((std::string(dir) + "/manifest.txt").c_str());
+#ifdef _WIN32
+    _rmdir(dir);
+#else
+    rmdir(dir);
+#endif
+}
+
+static int benchStore()
+{
+    //Sessions of random length played one after another, rows in time order like imported replays
+    const char* dir = "bench-store";
+    const Uint64 rows = 1 << 24;
+    const Uint32 sessionCount = 256;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    LRandom& random = threadRandom();
+
+    std::vector<Uint8> columns[STORE_COLUMN_COUNT];
+    for (int c = 0; c < STORE_COLUMN_COUNT; ++c)
+    {
+        columns[c].resize(rows * STORE_COLUMNS[c].width);
+    }
+    std::vector<std::string> sessions;
+    const char* ais[] = { "random", "markov", "history", "ensemble" };
+    for (Uint32 s = 0; s < sessionCount; ++s)
+    {
+        sessions.push_back(std::string(ais[s % 4]) + " 0 bench");
+    }
+
+    Uint64 micros = (Uint64)1700000000 * 1000000;
+    Uint32 session = 0;
+    int streak = 0;
+    for (Uint64 i = 0; i < rows; ++i)
+    {
+        if (i * sessionCount / rows != session)
+        {
+            session = (Uint32)(i * sessionCount / rows);
+            streak = 0;
+        }
+        micros += 50000 + random.next() % 1000000;
+        int player = random.move();
+        int computer = random.move();
+        int outcome = checkWin(player, computer);
+        columns[STORE_PLAYER][i] = (Uint8)player;
+        columns[STORE_COMPUTER][i] = (Uint8)computer;
+        columns[STORE_OUTCOME][i] = (Uint8)outcome;
+        memcpy(&columns[STORE_TIME][i * 8], &micros, 8);
+        memcpy(&columns[STORE_SESSION][i * 4], &session, 4);
+        columns[STORE_STREAK][i] = (Uint8)(streak < 255 ? streak : 255);
+        streak = outcome == 1 ? streak + 1 : 0;
+    }
+
+    //A store left by an interrupted run would be appended to
+    removeBenchStore(dir);
+    Uint64 start = SDL_GetPerformanceCounter();
+    LColumnStore store;
+    bool success = LColumnStore::append(dir, columns, sessions) && store.open(dir);
+    double writeSeconds = (double)(SDL_GetPerformanceCounter() - start) / frequency;
+    printf("Wrote %llu rows in %llu chunks in %.3f s\n", (unsigned long long)rows, (unsigned long long)store.getChunks(), writeSeconds);
+
+    //A whole-table count, groupings, a selective session range and a filter the summaries can't settle
+    struct BenchQuery
+    {
+        const char* label;
+        int group;
+        StoreFilter filters[2];
+        int filterCount;
+    };
+    const BenchQuery queries[] = {
+        { "count", QUERY_NONE, {}, 0 },
+        { "by player", QUERY_PLAYER, {}, 0 },
+        { "by ai", QUERY_AI, {}, 0 },
+        { "by streak", QUERY_STREAK, {}, 0 },
+        { "by hour", QUERY_HOUR, {}, 0 },
+        { "sessions 16-31", QUERY_PLAYER, { { STORE_SESSION, 16, 31 } }, 1 },
+        { "rock, streak>=2", QUERY_COMPUTER, { { STORE_PLAYER, 1, 1 }, { STORE_STREAK, 2, 255 } }, 2 },
+    };
+    const int QUERY_COUNT = sizeof(queries) / sizeof(queries[0]);
+
+    printf("%-16s", "Query");
+    for (int k = 0; k < STORE_KERNEL_COUNT; ++k)
+    {
+        printf(" %10s ms", gStoreKernels[k].name);
+    }
+    printf(" %8s\n", "skipped");
+
+    for (int q = 0; q < QUERY_COUNT && success; ++q)
+    {
+        std::vector<StoreFilter> filters(queries[q].filters, queries[q].filters + queries[q].filterCount);
+        std::vector<Uint64> reference;
+        QueryStats stats = { 0, 0 };
+        printf("%-16s", queries[q].label);
+        for (int k = 0; k < STORE_KERNEL_COUNT; ++k)
+        {
+            if (!gStoreKernels[k].supported())
+            {
+                printf(" %13s", "-");
+                continue;
+            }
+
+            //Every kernel has to agree with the scalar one
+            std::vector<Uint64> tallies(queryKeyCount(store, queries[q].group) * 4);
+            start = SDL_GetPerformanceCounter();
+            stats = queryStore(store, queries[q].group, filters, gStoreKernels[k], tallies);
+            double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+            printf(" %13.2f", ms);
+            if (k == 0)
+            {
+                reference = tallies;
+            }
+            success = success && tallies == reference;
+        }
+        printf(" %8llu\n", (unsigned long long)stats.skipped);
+    }
+
+    //The scalar kernels against a plain scan of the columns
+    std::vector<Uint64> expected(16);
+    for (Uint64 i = 0; i < rows; ++i)
+    {
+        expected[columns[STORE_PLAYER][i] * 4 + columns[STORE_OUTCOME][i]] += columns[STORE_SESSION][i * 4] >= 16 && columns[STORE_SESSION][i * 4] <= 31;
+    }
+    std::vector<StoreFilter> filters(1, queries[5].filters[0]);
+    std::vector<Uint64> tallies(16);
+    success = success && (queryStore(store, QUERY_PLAYER, filters, gStoreKernels[0], tallies), tallies == expected);
+
+    store.close();
+    removeBenchStore(dir);
+
+    printf("Every kernel matches a plain scan: %s\n", success ? "yes" : "NO");
+    return success ? 0 : 1;
+}
+
+int runBenchmark(const char* name)
+{
+    if (strcmp(name, "checkwin") == 0)
+    {
+        return benchCheckWin();
+    }
+
+    if (strcmp(name, "rng") == 0)
+    {
+        return benchRandom();
+    }
+
+    if (strcmp(name, "texture-cache") == 0)
+    {
+        return benchTextureCache();
+    }
+
+    if (strcmp(name, "bots") == 0)
+    {
+        return benchBots();
+    }
+
+    if (strcmp(name, "solver") == 0)
+    {
+        return benchSolver();
+    }
+
+    if (strcmp(name, "replay") == 0)
+    {
+        return benchReplay();
+    }
+
+    if (strcmp(name, "codec") == 0)
+    {
+        return benchCodec();
+    }
+
+    if (strcmp(name, "store") == 0)
+    {
+        return benchStore();
+    }
+
+    if (strcmp(name, "server") == 0)
+    {
+        return benchServer();
+    }
+
+    printf("Unknown benchmark %s.\n", name);
+    return 1;
+}
+
+//
+// Asset archive packer
+//
+
+
+//Pads a file with zeros up to the next aligned offset
+static Uint64 alignFile(FILE* file, Uint64 offset)
+{
+    static const char zeros[ARCHIVE_ALIGN] = { 0 };
+    Uint64 aligned = (offset + ARCHIVE_ALIGN - 1) / ARCHIVE_ALIGN * ARCHIVE_ALIGN;
+    fwrite(zeros, 1, (size_t)(aligned - offset), file);
+    return aligned;
+}
+
+int packArchive(const char* path)
+{
+    std::vector<std::string> images = listFiles("media", ".png");
+    std::vector<std::string> fonts = listFiles("media", ".ttf");
+    if (images.empty() && fonts.empty())
+    {
+        printf("No images or fonts under media/ to pack.\n");
+        return 1;
+    }
+
+    std::vector<ArchiveEntry> entries(images.size() + fonts.size());
+    memset(&entries[0], 0, sizeof(ArchiveEntry) * entries.size());
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("Unable to open %s for writing.\n", path);
+        return 1;
+    }
+
+    //Index first, it's rewritten once every offset is known
+    ArchiveHeader header;
+    memcpy(header.magic, ARCHIVE_MAGIC, 4);
+    header.version = ARCHIVE_VERSION;
+    header.count = (Uint32)entries.size();
+    header.reserved = 0;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(&entries[0], sizeof(ArchiveEntry), entries.size(), file);
+    Uint64 offset = sizeof(header) + sizeof(ArchiveEntry) * entries.size();
+
+    bool success = true;
+    for (size_t i = 0; i < entries.size() && success; ++i)
+    {
+        ArchiveEntry& entry = entries[i];
+        bool isImage = i < images.size();
+        std::string name = isImage ? images[i] : fonts[i - images.size()];
+        std::string source = "media/" + name;
+        if (name.size() >= sizeof(entry.name))
+        {
+            printf("Asset name %s is too long for the archive.\n", name.c_str());
+            success = false;
+            break;
+        }
+        strcpy(entry.name, name.c_str());
+        offset = alignFile(file, offset);
+        entry.offset = offset;
+
+        if (isImage)
+        {
+            //Store pixels in the format the renderer takes without conversion
+            SDL_Surface* loaded = IMG_Load(source.c_str());
+            SDL_Surface* rgba = loaded != NULL ? SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0) : NULL;
+            if (rgba == NULL)
+            {
+                printf("Unable to decode %s. SDL_image Error: %s\n", source.c_str(), IMG_GetError());
+                success = false;
+            }
+            else
+            {
+                entry.type = ARCHIVE_RGBA;
+                entry.width = rgba->w;
+                entry.height = rgba->h;
+                entry.pitch = rgba->w * 4;
+                entry.size = (Uint64)entry.pitch * rgba->h;
+                SDL_LockSurface(rgba);
+                for (int y = 0; y < rgba->h; ++y)
+                {
+                    fwrite((const uint8_t*)rgba->pixels + y * rgba->pitch, 1, entry.pitch, file);
+                }
+                SDL_UnlockSurface(rgba);
+            }
+            SDL_FreeSurface(rgba);
+            SDL_FreeSurface(loaded);
+        }
+        else
+        {
+            SDL_RWops* rw = SDL_RWFromFile(source.c_str(), "rb");
+            size_t size = 0;
+            void* data = rw != NULL ? SDL_LoadFile_RW(rw, &size, 1) : NULL;
+            if (data == NULL)
+            {
+                printf("Unable to read %s. SDL Error: %s\n", source.c_str(), SDL_GetError());
+                success = false;
+            }
+            else
+            {
+                entry.type = ARCHIVE_RAW;
+                entry.size = size;
+                fwrite(data, 1, size, file);
+                SDL_free(data);
+            }
+        }
+
+        offset += entry.size;
+        printf("%-24s %s %llu bytes\n", entry.name, entry.type == ARCHIVE_RGBA ? "rgba" : "raw ", (unsigned long long)entry.size);
+    }
+
+    fseek(file, sizeof(header), SEEK_SET);
+    fwrite(&entries[0], sizeof(ArchiveEntry), entries.size(), file);
+    if (fclose(file) != 0)
+    {
+        success = false;
+    }
+
+    if (!success)
+    {
+        remove(path);
+        printf("Failed to pack %s.\n", path);
+        return 1;
+    }
+
+    printf("Packed %d assets into %s (%llu bytes)\n", (int)entries.size(), path, (unsigned long long)offset);
+    return 0;
+}
+
+//
+// Tournament
+//
+
+
+//Rounds per match, pairings are split into matches so work spreads evenly
+const int MATCH_ROUNDS = 1 << 16;
+//Most bots a tournament can hold
+const int MAX_TOURNAMENT_BOTS = 32;
+
+struct TournamentMatch
+{
+    int a;
+    int b;
+    int rounds;
+    uint64_t seed;
+};
+
+//One worker's results, counts[a][b][winner] from a's point of view
+struct alignas(64) TournamentTally
+{
+    uint64_t counts[MAX_TOURNAMENT_BOTS][MAX_TOURNAMENT_BOTS][4];
+};
+
+struct Tournament
+{
+    std::vector<TournamentMatch> matches;
+    //Bot instances per worker, reset before each match
+    std::vector<std::vector<LBot*> > bots;
+    std::vector<TournamentTally> tallies;
+};
+
+static void playMatch(int index, int worker, void* data)
+{
+    Tournament* tournament = (Tournament*)data;
+    const TournamentMatch& match = tournament->matches[index];
+    LBot* a = tournament->bots[worker][match.a];
+    LBot* b = tournament->bots[worker][match.b];
+
+    //Streams come from the match seed only, so results don't depend on which thread runs it
+    LRandom seeds(match.seed);
+    a->reset(seeds.next());
+    b->reset(seeds.next());
+
+    const int BLOCK = 4096;
+    uint8_t aMoves[BLOCK];
+    uint8_t bMoves[BLOCK];
+    uint8_t outcomes[BLOCK];
+    uint64_t counts[4] = { 0, 0, 0, 0 };
+
+    for (int played = 0; played < match.rounds; played += BLOCK)
+    {
+        int n = match.rounds - played < BLOCK ? match.rounds - played : BLOCK;
+        for (int i = 0; i < n; ++i)
+        {
+            int aMove = a->move();
+            int bMove = b->move();
+            a->observe(aMove, bMove);
+            b->observe(bMove, aMove);
+            aMoves[i] = (uint8_t)aMove;
+            bMoves[i] = (uint8_t)bMove;
+        }
+
+        checkWinBatch(aMoves, bMoves, outcomes, n);
+        for (int i = 0; i < n; ++i)
+        {
+            ++counts[outcomes[i]];
+        }
+    }
+
+    uint64_t* tally = tournament->tallies[worker].counts[match.a][match.b];
+    for (int w = 0; w < 4; ++w)
+    {
+        tally[w] += counts[w];
+    }
+}
+
+//Plays a full round-robin on a given number of threads, merged counts go to totals
+static double playTournament(int threads, int rounds, std::vector<uint64_t>& totals)
+{
+    int bots = BOT_COUNT < MAX_TOURNAMENT_BOTS ? BOT_COUNT : MAX_TOURNAMENT_BOTS;
+    Tournament tournament;
+
+    LRandom seeds(gSeed);
+    for (int a = 0; a < bots; ++a)
+    {
+        for (int b = a + 1; b < bots; ++b)
+        {
+            for (int played = 0; played < rounds; played += MATCH_ROUNDS)
+            {
+                TournamentMatch match = { a, b, rounds - played < MATCH_ROUNDS ? rounds - played : MATCH_ROUNDS, seeds.next() };
+                tournament.matches.push_back(match);
+            }
+        }
+    }
+
+    LThreadPool pool;
+    if (!pool.start(threads))
+    {
+        return -1.0;
+    }
+
+    tournament.bots.resize(threads);
+    for (int w = 0; w < threads; ++w)
+    {
+        for (int b = 0; b < bots; ++b)
+        {
+            tournament.bots[w].push_back(gBots[b].create());
+        }
+    }
+    tournament.tallies.resize(threads);
+    memset(&tournament.tallies[0], 0, sizeof(TournamentTally) * threads);
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    pool.run((int)tournament.matches.size(), playMatch, &tournament);
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    pool.stop();
+
+    //Merge worker tallies
+    totals.assign(MAX_TOURNAMENT_BOTS * MAX_TOURNAMENT_BOTS * 4, 0);
+    for (int w = 0; w < threads; ++w)
+    {
+        const uint64_t* counts = &tournament.tallies[w].counts[0][0][0];
+        for (size_t i = 0; i < totals.size(); ++i)
+        {
+            totals[i] += counts[i];
+        }
+
+        for (int b = 0; b < bots; ++b)
+        {
+            delete tournament.bots[w][b];
+        }
+    }
+
+    return seconds;
+}
+
+int runTournament()
+{
+    if (gRules.getCount() != 3)
+    {
+        printf("Tournaments are played with rock paper scissors rules only.\n");
+        return 1;
+    }
+
+    int threads = gThreads > 0 ? gThreads : SDL_GetCPUCount();
+    int rounds = gRounds > 0 ? gRounds : 1 << 20;
+    int bots = BOT_COUNT < MAX_TOURNAMENT_BOTS ? BOT_COUNT : MAX_TOURNAMENT_BOTS;
+    int pairings = bots * (bots - 1) / 2;
+    double totalRounds = (double)pairings * rounds;
+
+    std::vector<uint64_t> totals;
+    double seconds = playTournament(threads, rounds, totals);
+    if (seconds < 0)
+    {
+        return 1;
+    }
+
+    printf("Tournament: %d bots, %d pairings, %d rounds each, %d threads, seed %llu\n", bots, pairings, rounds, threads, (unsigned long long)gSeed);
+    printf("%-10s %12s %12s %12s %8s\n", "Bot", "Wins", "Losses", "Draws", "Score");
+    for (int b = 0; b < bots; ++b)
+    {
+        //Wins as a are losses as b and the other way around
+        uint64_t wins = 0;
+        uint64_t losses = 0;
+        uint64_t draws = 0;
+        for (int o = 0; o < bots; ++o)
+        {
+            const uint64_t* asA = &totals[(b * MAX_TOURNAMENT_BOTS + o) * 4];
+            const uint64_t* asB = &totals[(o * MAX_TOURNAMENT_BOTS + b) * 4];
+            wins += asA[1] + asB[2];
+            losses += asA[2] + asB[1];
+            draws += asA[3] + asB[3];
+        }
+        uint64_t played = wins + losses + draws > 0 ? wins + losses + draws : 1;
+        printf("%-10s %12llu %12llu %12llu %+7.3f\n", gBots[b].name, (unsigned long long)wins, (unsigned long long)losses, (unsigned long long)draws, ((double)wins - (double)losses) / played);
+    }
+    printf("Played %.0f rounds in %.3f s (%.1f M rounds/s)\n", totalRounds, seconds, totalRounds / seconds / 1e6);
+
+    if (gScaling)
+    {
+        //Same seed on every thread count must give the same results
+        printf("%8s %14s %8s %10s\n", "Threads", "M rounds/s", "Speedup", "Identical");
+        double baseline = 0;
+        for (int t = 1; ; t = t * 2 < threads ? t * 2 : threads)
+        {
+            std::vector<uint64_t> scaled;
+            double scaledSeconds = playTournament(t, rounds, scaled);
+            if (scaledSeconds < 0)
+            {
+                return 1;
+            }
+            double rate = totalRounds / scaledSeconds;
+            if (t == 1)
+            {
+                baseline = rate;
+            }
+            printf("%8d %14.1f %7.2fx %10s\n", t, rate / 1e6, rate / baseline, scaled == totals ? "yes" : "NO");
+
+            if (t == threads)
+            {
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+//
+// Policy training
+//
+
+
+const char POLICY_MAGIC[4] = { 'R', 'P', 'S', 'P' };
+const Uint32 POLICY_VERSION = 1;
+
+//Fixed work split per batch, so results don't depend on the thread count
+const int TRAIN_TASKS = 16;
+const int TRAIN_TASK_ROUNDS = 1 << 12;
+
+//Batches between checkpoints
+const int TRAIN_CHECKPOINT_BATCHES = 64;
+
+struct PolicyHeader
+{
+    char magic[4];
+    Uint32 version;
+    Uint32 order;
+    Uint32 contexts;
+    Uint64 rounds;
+    Uint64 batches;
+};
+
+bool loadPolicy(const char* path, PolicyTables& policy)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    PolicyHeader header;
+    bool success = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, POLICY_MAGIC, 4) == 0 && header.version == POLICY_VERSION && header.order <= (Uint32)PolicyTables::MAX_ORDER;
+    if (success)
+    {
+        policy.order = (int)header.order;
+        policy.contexts = 1;
+        for (int i = 0; i < policy.order; ++i)
+        {
+            policy.contexts *= 9;
+        }
+        policy.rounds = header.rounds;
+        policy.batches = header.batches;
+        policy.regrets.resize((size_t)policy.contexts * 3);
+        policy.sums.resize((size_t)policy.contexts * 3);
+        success = header.contexts == policy.contexts && fread(&policy.regrets[0], sizeof(float), policy.regrets.size(), file) == policy.regrets.size() && fread(&policy.sums[0], sizeof(double), policy.sums.size(), file) == policy.sums.size();
+    }
+    fclose(file);
+
+    if (!success)
+    {
+        printf("Policy %s is corrupt or from another version.\n", path);
+    }
+    return success;
+}
+
+bool savePolicy(const char* path, const PolicyTables& policy)
+{
+    char temp[512];
+    int length = snprintf(temp, sizeof(temp), "%s.tmp", path);
+    FILE* file = length >= 0 && (size_t)length < sizeof(temp) ? fopen(temp, "wb") : NULL;
+    if (file == NULL)
+    {
+        printf("Unable to write policy %s.\n", temp);
+        return false;
+    }
+
+    PolicyHeader header;
+    memcpy(header.magic, POLICY_MAGIC, 4);
+    header.version = POLICY_VERSION;
+    header.order = (Uint32)policy.order;
+    header.contexts = policy.contexts;
+    header.rounds = policy.rounds;
+    header.batches = policy.batches;
+
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(&policy.regrets[0], sizeof(float), policy.regrets.size(), file) == policy.regrets.size() && fwrite(&policy.sums[0], sizeof(double), policy.sums.size(), file) == policy.sums.size();
+    success = fclose(file) == 0 && success;
+
+    //A failed write leaves the previous checkpoint in place
+    if (!success || !replaceFile(temp, path))
+    {
+        printf("Unable to write policy %s.\n", path);
+        remove(temp);
+        return false;
+    }
+    return true;
+}
+
+//One task's results for a batch, merged into the policy after every task finished
+struct TrainTally
+{
+    std::vector<float> regrets;
+    std::vector<float> sums;
+    //Wins minus losses of the policy player
+    Sint64 score;
+};
+
+struct Trainer
+{
+    Uint32 contexts;
+    Uint64 batch;
+    //Current strategy from the regrets, four per context
+    std::vector<float> strategy;
+    std::vector<TrainTally> tallies;
+    //Opponent per task when not training by self-play
+    std::vector<LBot*> opponents;
+};
+
+//Samples a move from four probabilities
+static int sampleMove(const float* strategy, LRandom& random)
+{
+    float u = (float)(random.next() >> 40) * (1.0f / 16777216.0f);
+    return u < strategy[0] ? 1 : (u < strategy[0] + strategy[1] ? 2 : 3);
+}
+
+//Adds how much better each move would have done against theirs than the strategy did
+static void addRegrets(const float* strategy, int theirs, float* regrets, float* sums)
+{
+    //checkWin is from the first move's side: 1 wins, 2 loses, 3 draws
+    static const float PAYOFF[4] = { 0.0f, 1.0f, -1.0f, 0.0f };
+    float payoffs[3];
+    float expected = 0.0f;
+    for (int m = 0; m < 3; ++m)
+    {
+        payoffs[m] = PAYOFF[checkWin(m + 1, theirs)];
+        expected += strategy[m] * payoffs[m];
+    }
+
+    for (int m = 0; m < 3; ++m)
+    {
+        regrets[m] += payoffs[m] - expected;
+        sums[m] += strategy[m];
+    }
+}
+
+static void trainTask(int index, int worker, void* data)
+{
+    Trainer* trainer = (Trainer*)data;
+    TrainTally& tally = trainer->tallies[index];
+    std::fill(tally.regrets.begin(), tally.regrets.end(), 0.0f);
+    std::fill(tally.sums.begin(), tally.sums.end(), 0.0f);
+    tally.score = 0;
+
+    //Streams come from the batch and task only
+    LRandom random(gSeed ^ (trainer->batch * TRAIN_TASKS + index) * 0x9E3779B97F4A7C15ULL);
+    LBot* opponent = trainer->opponents.empty() ? NULL : trainer->opponents[index];
+    if (opponent != NULL)
+    {
+        opponent->reset(random.next());
+    }
+
+    const float* strategy = &trainer->strategy[0];
+    Uint32 contexts = trainer->contexts;
+    Uint32 mine = 0;
+    Uint32 theirs = 0;
+    for (int round = 0; round < TRAIN_TASK_ROUNDS; ++round)
+    {
+        int a = sampleMove(&strategy[mine * 4], random);
+        int b = opponent != NULL ? opponent->move() : sampleMove(&strategy[theirs * 4], random);
+
+        //Self-play shares one policy, so both seats learn from the same round
+        addRegrets(&strategy[mine * 4], b, &tally.regrets[mine * 4], &tally.sums[mine * 4]);
+        if (opponent != NULL)
+        {
+            opponent->observe(b, a);
+        }
+        else
+        {
+            addRegrets(&strategy[theirs * 4], a, &tally.regrets[theirs * 4], &tally.sums[theirs * 4]);
+        }
+
+        int winner = checkWin(a, b);
+        tally.score += winner == 1 ? 1 : (winner == 2 ? -1 : 0);
+
+        mine = (mine * 9 + (Uint32)((a - 1) * 3 + (b - 1))) % contexts;
+        theirs = (theirs * 9 + (Uint32)((b - 1) * 3 + (a - 1))) % contexts;
+    }
+}
+
+int runTrain()
+{
+    if (gRules.getCount() != 3)
+    {
+        printf("Policies are trained with rock paper scissors rules only.\n");
+        return 1;
+    }
+
+    //Resume from the checkpoint when there is one
+    PolicyTables policy;
+    if (loadPolicy(gPolicyPath, policy))
+    {
+        printf("Resuming %s: order %d, %llu rounds trained\n", gPolicyPath, policy.order, (unsigned long long)policy.rounds);
+    }
+    else
+    {
+        policy.order = gPolicyOrder;
+        policy.contexts = 1;
+        for (int i = 0; i < policy.order; ++i)
+        {
+            policy.contexts *= 9;
+        }
+        policy.rounds = 0;
+        policy.batches = 0;
+        policy.regrets.assign((size_t)policy.contexts * 3, 0.0f);
+        policy.sums.assign((size_t)policy.contexts * 3, 0.0);
+        printf("Training new policy %s: order %d, %u contexts\n", gPolicyPath, policy.order, policy.contexts);
+    }
+
+    Trainer trainer;
+    trainer.contexts = policy.contexts;
+    trainer.strategy.assign((size_t)policy.contexts * 4, 0.0f);
+    trainer.tallies.resize(TRAIN_TASKS);
+    for (int t = 0; t < TRAIN_TASKS; ++t)
+    {
+        trainer.tallies[t].regrets.assign((size_t)policy.contexts * 4, 0.0f);
+        trainer.tallies[t].sums.assign((size_t)policy.contexts * 4, 0.0f);
+    }
+
+    if (gTrainOpponent != NULL)
+    {
+        for (int t = 0; t < TRAIN_TASKS; ++t)
+        {
+            LBot* bot = createBot(gTrainOpponent);
+            if (bot == NULL)
+            {
+                printf("Unknown opponent strategy %s.\n", gTrainOpponent);
+                return 1;
+            }
+            trainer.opponents.push_back(bot);
+        }
+    }
+
+    int threads = gThreads > 0 ? gThreads : SDL_GetCPUCount();
+    LThreadPool pool;
+    if (!pool.start(threads))
+    {
+        return 1;
+    }
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 start = SDL_GetPerformanceCounter();
+    Sint64 score = 0;
+    Uint64 scored = 0;
+    bool success = true;
+    for (int b = 0; b < gTrainBatches; ++b)
+    {
+        //Regret matching: play each context's moves in proportion to their positive regret
+        for (Uint32 c = 0; c < policy.contexts; ++c)
+        {
+            const float* regrets = &policy.regrets[c * 3];
+            float total = regrets[0] + regrets[1] + regrets[2];
+            for (int m = 0; m < 3; ++m)
+            {
+                trainer.strategy[c * 4 + m] = total > 0.0f ? regrets[m] / total : 1.0f / 3;
+            }
+        }
+
+        trainer.batch = policy.batches;
+        pool.run(TRAIN_TASKS, trainTask, &trainer);
+
+        //Merge in task order so the result is the same on any thread count
+        for (int t = 0; t < TRAIN_TASKS; ++t)
+        {
+            const TrainTally& tally = trainer.tallies[t];
+            for (Uint32 c = 0; c < policy.contexts; ++c)
+            {
+                for (int m = 0; m < 3; ++m)
+                {
+                    policy.regrets[c * 3 + m] += tally.regrets[c * 4 + m];
+                    policy.sums[c * 3 + m] += tally.sums[c * 4 + m];
+                }
+            }
+            score += tally.score;
+        }
+
+        //Regret matching+ forgets negative regret so a move can come back quickly
+        for (size_t i = 0; i < policy.regrets.size(); ++i)
+        {
+            policy.regrets[i] = policy.regrets[i] > 0.0f ? policy.regrets[i] : 0.0f;
+        }
+
+        policy.rounds += (Uint64)TRAIN_TASKS * TRAIN_TASK_ROUNDS;
+        ++policy.batches;
+        scored += (Uint64)TRAIN_TASKS * TRAIN_TASK_ROUNDS;
+
+        if ((b + 1) % TRAIN_CHECKPOINT_BATCHES == 0 || b + 1 == gTrainBatches)
+        {
+            double seconds = (SDL_GetPerformanceCounter() - start) / (double)frequency;
+            printf("Batch %llu: %llu rounds, %.1f M rounds/s, score %+.4f per round\n", (unsigned long long)policy.batches, (unsigned long long)policy.rounds, (b + 1.0) * TRAIN_TASKS * TRAIN_TASK_ROUNDS / seconds / 1e6, (double)score / scored);
+            score = 0;
+            scored = 0;
+            if (!savePolicy(gPolicyPath, policy))
+            {
+                success = false;
+                break;
+            }
+        }
+    }
+
+    pool.stop();
+    for (size_t i = 0; i < trainer.opponents.size(); ++i)
+    {
+        delete trainer.opponents[i];
+    }
+
+    //Show what the policy opens with
+    const double* sums = &policy.sums[0];
+    double total = sums[0] + sums[1] + sums[2];
+    if (success && total > 0.0)
+    {
+        printf("Opening strategy: rock %.3f, paper %.3f, scissors %.3f\n", sums[0] / total, sums[1] / total, sums[2] / total);
+    }
+
+    return success ? 0 : 1;
+}
+
+int runSolve()
+{
+    LSolver solver;
+    if (gPayoffPath != NULL)
+    {
+        if (!solver.load(gPayoffPath))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        solver.setRules(gRules);
+    }
+
+    int threads = gThreads > 0 ? gThreads : SDL_GetCPUCount();
+    Uint64 start = SDL_GetPerformanceCounter();
+    int iterations = solver.solve(1e-4f, 100000, threads);
+    double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+
+    printf("Game: %dx%d %s\n", solver.getRows(), solver.getCols(), gPayoffPath != NULL ? gPayoffPath : "rules");
+    printf("Solved in %d iterations, %.1f ms on %d threads\n", iterations, ms, threads);
+    printf("Value: %.5f\n", solver.getValue());
+    printf("Exploitability: %.6f\n", solver.getExploitability());
+
+    //Only moves that are actually played are worth listing
+    std::vector<float> strategies[2] = { solver.getRowStrategy(), solver.getColStrategy() };
+    const char* players[2] = { "Row", "Column" };
+    for (int p = 0; p < 2; ++p)
+    {
+        printf("%s strategy:\n", players[p]);
+        for (size_t i = 0; i < strategies[p].size(); ++i)
+        {
+            if (strategies[p][i] >= 1e-4f)
+            {
+                const char* name = gPayoffPath == NULL ? gRules.getName((int)i + 1) : "";
+                printf("  %5d %-10s %.4f\n", (int)i + 1, name, strategies[p][i]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+//
+// Session server
+//
+
+
+LSessionTable::LSessionTable()
+{
+    mCount = 0;
+}
+
+LSessionTable::~LSessionTable()
+{
+    for (size_t i = 0; i < mBots.size(); ++i)
+    {
+        delete mBots[i];
+    }
+}
+
+int LSessionTable::create(int bot, int owner)
+{
+    Uint32 id;
+    if (!mFree.empty())
+    {
+        id = mFree.back();
+        mFree.pop_back();
+    }
+    else if (mOwner.size() < MAX_SESSIONS)
+    {
+        id = (Uint32)mOwner.size();
+        mOwner.push_back(-1);
+        mOwnedIndex.push_back(0);
+        mBots.push_back(NULL);
+        mPlayer.push_back(0);
+        mComputer.push_back(0);
+        mWinner.push_back(0);
+        mRounds.push_back(0);
+        mWins.push_back(0);
+        mLosses.push_back(0);
+        mDraws.push_back(0);
+        mStreak.push_back(0);
+    }
+    else
+    {
+        return -1;
+    }
+
+    //Bots that don't know the rules in play fall back to random like they do in the game
+    mOwner[id] = owner;
+    if ((size_t)owner >= mOwned.size())
+    {
+        mOwned.resize(owner + 1);
+    }
+    mOwnedIndex[id] = (Uint32)mOwned[owner].size();
+    mOwned[owner].push_back(id);
+    mBots[id] = createBot(gBots[bot].name);
+    mPlayer[id] = mComputer[id] = mWinner[id] = 0;
+    mRounds[id] = mWins[id] = mLosses[id] = mDraws[id] = mStreak[id] = 0;
+    ++mCount;
+    return (int)id;
+}
+
+void LSessionTable::close(Uint32 id)
+{
+    delete mBots[id];
+    mBots[id] = NULL;
+    //The owner's last session takes this one's place in its list
+    std::vector<Uint32>& owned = mOwned[mOwner[id]];
+    Uint32 last = owned.back();
+    owned[mOwnedIndex[id]] = last;
+    mOwnedIndex[last] = mOwnedIndex[id];
+    owned.pop_back();
+    mOwner[id] = -1;
+    mFree.push_back(id);
+    --mCount;
+}
+
+void LSessionTable::closeOwner(int owner)
+{
+    while ((size_t)owner < mOwned.size() && !mOwned[owner].empty())
+    {
+        close(mOwned[owner].back());
+    }
+}
+
+int LSessionTable::getCount()
+{
+    return mCount;
+}
+
+GameSession LSessionTable::get(Uint32 id)
+{
+    GameSession session;
+    session.pChoice = mPlayer[id];
+    session.cChoice = mComputer[id];
+    session.winner = mWinner[id];
+    session.score.rounds = (int)mRounds[id];
+    session.score.wins = (int)mWins[id];
+    session.score.losses = (int)mLosses[id];
+    session.score.draws = (int)mDraws[id];
+    session.score.streak = (int)mStreak[id];
+    return session;
+}
+
+void LSessionTable::handle(const ServerRequest& request, int owner, ServerResponse& response)
+{
+    memset(&response, 0, sizeof(response));
+    response.op = request.op;
+    response.session = request.session;
+
+    if (request.op == SERVER_CREATE)
+    {
+        if (request.move >= BOT_COUNT)
+        {
+            response.status = SERVER_BAD_REQUEST;
+            return;
+        }
+
+        int id = create(request.move, owner);
+        response.status = id >= 0 ? SERVER_OK : SERVER_FULL;
+        response.session = id >= 0 ? (Uint32)id : 0;
+        return;
+    }
+
+    Uint32 id = request.session;
+    if (id >= mOwner.size() || mOwner[id] != owner)
+    {
+        response.status = request.op == SERVER_PLAY || request.op == SERVER_CLOSE ? SERVER_NO_SESSION : SERVER_BAD_REQUEST;
+        return;
+    }
+
+    if (request.op == SERVER_CLOSE)
+    {
+        close(id);
+        response.status = SERVER_OK;
+        return;
+    }
+
+    if (request.op != SERVER_PLAY || request.move < 1 || request.move > gRules.getCount())
+    {
+        response.status = SERVER_BAD_REQUEST;
+        return;
+    }
+
+    //Same round logic as the game, on the session's fields
+    GameSession session = get(id);
+    playRound(session, request.move, *mBots[id]);
+    mPlayer[id] = (Uint8)session.pChoice;
+    mComputer[id] = (Uint8)session.cChoice;
+    mWinner[id] = (Uint8)session.winner;
+    mRounds[id] = (Uint32)session.score.rounds;
+    mWins[id] = (Uint32)session.score.wins;
+    mLosses[id] = (Uint32)session.score.losses;
+    mDraws[id] = (Uint32)session.score.draws;
+    mStreak[id] = (Uint32)session.score.streak;
+
+    response.status = SERVER_OK;
+    response.computer = mComputer[id];
+    response.winner = mWinner[id];
+    response.rounds = mRounds[id];
+    response.wins = mWins[id];
+    response.losses = mLosses[id];
+    response.draws = mDraws[id];
+}
+
+#ifdef __linux__
+//Set by SIGINT and SIGTERM to stop the server loop
+volatile sig_atomic_t gServerQuit = 0;
+
+static void stopServer(int)
+{
+    gServerQuit = 1;
+}
+
+//Every connection is a descriptor, so thousands of them need more than the usual soft limit
+static void raiseFileLimit()
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+//Listens on, or connects to, the configured Unix socket or loopback port, returns a non-blocking descriptor or -1
+static int openServerSocket(bool listening)
+{
+    int fd = socket(gServerPort > 0 ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    bool success;
+    int one = 1;
+    if (gServerPort > 0)
+    {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t)gServerPort);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (listening)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            success = bind(fd, (sockaddr*)&address, sizeof(address)) == 0 && listen(fd, SOMAXCONN) == 0;
+        }
+        else
+        {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            success = connect(fd, (sockaddr*)&address, sizeof(address)) == 0;
+        }
+    }
+    else
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, gSocketPath, sizeof(address.sun_path) - 1);
+        if (listening)
+        {
+            //A socket file left by a server that didn't shut down cleanly would block bind
+            unlink(gSocketPath);
+            success = bind(fd, (sockaddr*)&address, sizeof(address)) == 0 && listen(fd, SOMAXCONN) == 0;
+        }
+        else
+        {
+            success = connect(fd, (sockaddr*)&address, sizeof(address)) == 0;
+        }
+    }
+
+    if (!success || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void printServerAddress(const char* prefix)
+{
+    if (gServerPort > 0)
+    {
+        printf("%s 127.0.0.1:%d\n", prefix, gServerPort);
+    }
+    else
+    {
+        printf("%s %s\n", prefix, gSocketPath);
+    }
+}
+
+//Byte buffers for one socket, out is written from sent onwards
+struct SocketBuffers
+{
+    std::vector<Uint8> in;
+    std::vector<Uint8> out;
+    size_t sent;
+};
+
+//Bytes read from a socket per wakeup, so one fast client can't keep the loop to itself. Whole requests are
+//answered before the next read, so input never holds more than this and a partial request
+const size_t SOCKET_READ_BYTES = 16384;
+
+//Reads up to SOCKET_READ_BYTES, level-triggered epoll reports the socket again if there's more, false once it's
+//closed or failed
+static bool receiveSome(int fd, SocketBuffers& buffers)
+{
+    Uint8 chunk[SOCKET_READ_BYTES];
+    for (;;)
+    {
+        ++gThreadSyscalls;
+        ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+        if (got > 0)
+        {
+            buffers.in.insert(buffers.in.end(), chunk, chunk + got);
+            return true;
+        }
+        else if (got == 0)
+        {
+            return false;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return true;
+        }
+        else if (errno != EINTR)
+        {
+            return false;
+        }
+    }
+}
+
+//Writes as much of out as the socket takes, false if it failed
+static bool sendPending(int fd, SocketBuffers& buffers)
+{
+    while (buffers.sent < buffers.out.size())
+    {
+        ++gThreadSyscalls;
+        ssize_t wrote = send(fd, &buffers.out[buffers.sent], buffers.out.size() - buffers.sent, MSG_NOSIGNAL);
+        if (wrote > 0)
+        {
+            buffers.sent += (size_t)wrote;
+        }
+        else if (wrote < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true;
+        }
+        else if (wrote < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    buffers.out.clear();
+    buffers.sent = 0;
+    return true;
+}
+
+//Server side of a connection
+struct ServerConnection
+{
+    SocketBuffers buffers;
+    bool open;
+    //Waiting for the socket to take more output
+    bool writing;
+};
+
+//Bytes of responses a client can leave unread before it's dropped
+const size_t SERVER_MAX_PENDING = 1 << 20;
+
+//How long the listener sits out after running out of descriptors, instead of waking the loop over and over
+const int SERVER_ACCEPT_BACKOFF_MS = 100;
+
+//What a server loop did, for its summary and the benchmark
+struct ServerStats
+{
+    Uint64 requests;
+    Uint64 syscalls;
+    int peakConnections;
+    int peakSessions;
+};
+
+//Answers every whole request in a connection's input, returns how many
+static size_t answerRequests(LSessionTable& sessions, int owner, const Uint8* in, size_t size, Uint8* out)
+{
+    size_t count = size / sizeof(ServerRequest);
+    for (size_t r = 0; r < count; ++r)
+    {
+        ServerRequest request;
+        ServerResponse response;
+        memcpy(&request, in + r * sizeof(ServerRequest), sizeof(request));
+        sessions.handle(request, owner, response);
+        memcpy(out + r * sizeof(ServerResponse), &response, sizeof(response));
+    }
+    return count;
+}
+
+//Readiness loop: epoll says which sockets can be read or written, then recv and send move the bytes
+static bool serveEpoll(int listener, ServerStats& stats)
+{
+    int poll = epoll_create1(0);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = listener;
+    if (poll < 0 || epoll_ctl(poll, EPOLL_CTL_ADD, listener, &event) != 0)
+    {
+        printf("Unable to start the event loop.\n");
+        if (poll >= 0)
+        {
+            ::close(poll);
+        }
+        return false;
+    }
+
+    //Connections are indexed by descriptor, which the kernel keeps dense
+    LSessionTable sessions;
+    std::vector<ServerConnection> connections;
+    const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+    int connected = 0;
+    bool success = true;
+    //When the listener goes back in after running out of descriptors, 0 while it's in
+    Uint32 acceptResume = 0;
+
+    while (!gServerQuit)
+    {
+        int timeout = 500;
+        if (acceptResume != 0)
+        {
+            Sint32 wait = (Sint32)(acceptResume - SDL_GetTicks());
+            if (wait <= 0)
+            {
+                ++gThreadSyscalls;
+                if (epoll_ctl(poll, EPOLL_CTL_ADD, listener, &event) != 0)
+                {
+                    printf("Unable to resume accepting connections.\n");
+                    success = false;
+                    break;
+                }
+                acceptResume = 0;
+            }
+            else
+            {
+                timeout = wait < timeout ? wait : timeout;
+            }
+        }
+
+        ++gThreadSyscalls;
+        int ready = epoll_wait(poll, events, MAX_EVENTS, timeout);
+        if (ready < 0 && errno != EINTR)
+        {
+            printf("Event loop failed.\n");
+            success = false;
+            break;
+        }
+
+        for (int i = 0; i < ready; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listener)
+            {
+                for (;;)
+                {
+                    ++gThreadSyscalls;
+                    int client = accept4(listener, NULL, NULL, SOCK_NONBLOCK);
+                    if (client < 0 && (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM))
+                    {
+                        //The pending connection stays queued, and a level-triggered listener would report it every wait
+                        ++gThreadSyscalls;
+                        epoll_ctl(poll, EPOLL_CTL_DEL, listener, NULL);
+                        acceptResume = SDL_GetTicks() + SERVER_ACCEPT_BACKOFF_MS;
+                        acceptResume += acceptResume == 0;
+                        break;
+                    }
+                    if (client < 0)
+                    {
+                        break;
+                    }
+
+                    int one = 1;
+                    if (gServerPort > 0)
+                    {
+                        ++gThreadSyscalls;
+                        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    }
+                    if ((size_t)client >= connections.size())
+                    {
+                        connections.resize(client + 1);
+                    }
+                    connections[client].buffers.in.clear();
+                    connections[client].buffers.out.clear();
+                    connections[client].buffers.sent = 0;
+                    connections[client].open = true;
+                    connections[client].writing = false;
+
+                    epoll_event added = {};
+                    added.events = EPOLLIN;
+                    added.data.fd = client;
+                    ++gThreadSyscalls;
+                    if (epoll_ctl(poll, EPOLL_CTL_ADD, client, &added) != 0)
+                    {
+                        ++gThreadSyscalls;
+                        ::close(client);
+                        connections[client].open = false;
+                        continue;
+                    }
+                    ++connected;
+                    stats.peakConnections = connected > stats.peakConnections ? connected : stats.peakConnections;
+                }
+                continue;
+            }
+
+            //Whole requests are answered in order, a partial one waits for the rest of its bytes
+            ServerConnection& connection = connections[fd];
+            SocketBuffers& buffers = connection.buffers;
+            bool alive = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                alive = receiveSome(fd, buffers);
+                size_t start = buffers.out.size();
+                buffers.out.resize(start + buffers.in.size() / sizeof(ServerRequest) * sizeof(ServerResponse));
+                size_t count = answerRequests(sessions, fd, buffers.in.data(), buffers.in.size(), buffers.out.data() + start);
+                buffers.in.erase(buffers.in.begin(), buffers.in.begin() + count * sizeof(ServerRequest));
+                stats.requests += count;
+                stats.peakSessions = sessions.getCount() > stats.peakSessions ? sessions.getCount() : stats.peakSessions;
+            }
+
+            alive = sendPending(fd, buffers) && alive && buffers.out.size() - buffers.sent <= SERVER_MAX_PENDING;
+            bool writing = buffers.sent < buffers.out.size();
+            if (alive && writing != connection.writing)
+            {
+                epoll_event changed = {};
+                changed.events = writing ? EPOLLIN | EPOLLOUT : EPOLLIN;
+                changed.data.fd = fd;
+                ++gThreadSyscalls;
+                alive = epoll_ctl(poll, EPOLL_CTL_MOD, fd, &changed) == 0;
+                connection.writing = writing;
+            }
+
+            if (!alive)
+            {
+                sessions.closeOwner(fd);
+                gThreadSyscalls += 2;
+                epoll_ctl(poll, EPOLL_CTL_DEL, fd, NULL);
+                ::close(fd);
+                buffers.in.clear();
+                buffers.out.clear();
+                connection.open = false;
+                --connected;
+            }
+        }
+    }
+
+    //Sessions still open go with the table
+    for (size_t fd = 0; fd < connections.size(); ++fd)
+    {
+        if (connections[fd].open)
+        {
+            ::close((int)fd);
+        }
+    }
+    ::close(poll);
+    return success;
+}
+
+#ifdef HAVE_IO_URING
+//Connections the io_uring loop can hold, each with a slot of the registered buffer region
+const int RING_SLOTS = 4096;
+//A slot's input holds a batch of requests, and its output the responses to all of them
+const size_t RING_BATCH = 256;
+const size_t RING_IN_BYTES = RING_BATCH * sizeof(ServerRequest);
+const size_t RING_SLOT_BYTES = RING_IN_BYTES + RING_BATCH * sizeof(ServerResponse);
+
+//What a completion's user_data refers to, in its low byte above the slot
+enum RingEvent
+{
+    RING_ACCEPT,
+    RING_RECEIVE,
+    RING_SEND,
+    RING_TIMEOUT,
+    RING_ACCEPT_RETRY
+};
+
+//A connection of the io_uring loop, always with exactly one receive or send in flight
+struct RingConnection
+{
+    //-1 while the slot is free
+    int fd;
+    //Bytes of a partial request kept at the start of the input
+    Uint32 inFill;
+    Uint32 outSize;
+    Uint32 outSent;
+};
+
+//The io_uring loop's state, shared by its helpers
+struct RingServer
+{
+    LRing ring;
+    Uint8* region;
+    std::vector<RingConnection> slots;
+    std::vector<int> free;
+    __kernel_timespec tick;
+    __kernel_timespec backoff;
+    //Set once every slot is taken, so the refusals are reported once per burst
+    bool full;
+};
+
+//Queues a read into the free end of the slot's input, false if the submission queue is stuck
+static bool queueRingReceive(RingServer& server, int slot)
+{
+    io_uring_sqe* sqe = server.ring.getSqe();
+    if (sqe == NULL)
+    {
+        return false;
+    }
+
+    //Registered buffers skip pinning the pages on every call, plain recv works without them
+    RingConnection& connection = server.slots[slot];
+    Uint8* in = server.region + slot * RING_SLOT_BYTES;
+    sqe->opcode = server.ring.hasRegisteredBuffers() ? IORING_OP_READ_FIXED : IORING_OP_RECV;
+    sqe->fd = connection.fd;
+    sqe->addr = (Uint64)(uintptr_t)(in + connection.inFill);
+    sqe->len = (Uint32)(RING_IN_BYTES - connection.inFill);
+    sqe->user_data = (Uint64)slot << 8 | RING_RECEIVE;
+    return true;
+}
+
+//Queues the rest of the slot's output
+static bool queueRingSend(RingServer& server, int slot)
+{
+    io_uring_sqe* sqe = server.ring.getSqe();
+    if (sqe == NULL)
+    {
+        return false;
+    }
+
+    RingConnection& connection = server.slots[slot];
+    Uint8* out = server.region + slot * RING_SLOT_BYTES + RING_IN_BYTES;
+    sqe->opcode = server.ring.hasRegisteredBuffers() ? IORING_OP_WRITE_FIXED : IORING_OP_SEND;
+    sqe->fd = connection.fd;
+    sqe->addr = (Uint64)(uintptr_t)(out + connection.outSent);
+    sqe->len = connection.outSize - connection.outSent;
+    //Writes share the field with their own flags, and SIGPIPE is ignored anyway
+    if (sqe->opcode == IORING_OP_SEND)
+    {
+        sqe->msg_flags = MSG_NOSIGNAL;
+    }
+    sqe->user_data = (Uint64)slot << 8 | RING_SEND;
+    return true;
+}
+
+static bool queueRingAccept(RingServer& server, int listener)
+{
+    io_uring_sqe* sqe = server.ring.getSqe();
+    if (sqe == NULL)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listener;
+    sqe->user_data = RING_ACCEPT;
+    return true;
+}
+
+//Wakes the loop now and then to check for shutdown
+static bool queueRingTimeout(RingServer& server)
+{
+    io_uring_sqe* sqe = server.ring.getSqe();
+    if (sqe == NULL)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (Uint64)(uintptr_t)&server.tick;
+    sqe->len = 1;
+    sqe->user_data = RING_TIMEOUT;
+    return true;
+}
+
+//Re-arms the accept only after the backoff, since a failed accept would complete again right away
+static bool queueRingAcceptRetry(RingServer& server)
+{
+    io_uring_sqe* sqe = server.ring.getSqe();
+    if (sqe == NULL)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (Uint64)(uintptr_t)&server.backoff;
+    sqe->len = 1;
+    sqe->user_data = RING_ACCEPT_RETRY;
+    return true;
+}
+
+//Completion loop: accepts, receives and sends are queued, then one io_uring_enter per sweep submits them all and
+//waits for the next completions
+static bool serveRing(int listener, ServerStats& stats)
+{
+    RingServer server;
+    if (!server.ring.open(1024, 4 * RING_SLOTS, IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN))
+    {
+        printf("Unable to set up io_uring.\n");
+        return false;
+    }
+
+    //Every slot's buffers in one region, registered once
+    size_t regionSize = RING_SLOTS * RING_SLOT_BYTES;
+    void* region = mmap(NULL, regionSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+    {
+        printf("Unable to map the connection buffers.\n");
+        return false;
+    }
+    server.region = (Uint8*)region;
+    iovec buffers = { region, regionSize };
+    server.ring.registerBuffers(&buffers, 1);
+    server.slots.resize(RING_SLOTS);
+    for (int slot = RING_SLOTS - 1; slot >= 0; --slot)
+    {
+        server.slots[slot].fd = -1;
+        server.free.push_back(slot);
+    }
+    server.tick.tv_sec = 0;
+    server.tick.tv_nsec = 500000000;
+    server.backoff.tv_sec = 0;
+    server.backoff.tv_nsec = SERVER_ACCEPT_BACKOFF_MS * 1000000LL;
+    server.full = false;
+
+    LSessionTable sessions;
+    int connected = 0;
+    bool success = queueRingAccept(server, listener) && queueRingTimeout(server);
+
+    while (success && !gServerQuit)
+    {
+        int submitted = server.ring.submit(1);
+        if (submitted < 0 && submitted != -EINTR && submitted != -EAGAIN && submitted != -EBUSY)
+        {
+            printf("Event loop failed.\n");
+            success = false;
+            break;
+        }
+
+        io_uring_cqe* cqe;
+        while (success && (cqe = server.ring.peek()) != NULL)
+        {
+            int kind = (int)(cqe->user_data & 0xFF);
+            int slot = (int)(cqe->user_data >> 8);
+            int result = cqe->res;
+            server.ring.seen();
+
+            if (kind == RING_TIMEOUT)
+            {
+                success = queueRingTimeout(server);
+                continue;
+            }
+
+            if (kind == RING_ACCEPT_RETRY)
+            {
+                success = queueRingAccept(server, listener);
+                continue;
+            }
+
+            if (kind == RING_ACCEPT)
+            {
+                if (result >= 0 && server.free.empty())
+                {
+                    if (!server.full)
+                    {
+                        printf("All %d io_uring connection slots are in use, refusing connections.\n", RING_SLOTS);
+                        fflush(stdout);
+                        server.full = true;
+                    }
+                    ++gThreadSyscalls;
+                    ::close(result);
+                }
+                else if (result >= 0)
+                {
+                    int one = 1;
+                    if (gServerPort > 0)
+                    {
+                        ++gThreadSyscalls;
+                        setsockopt(result, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    }
+                    int opened = server.free.back();
+                    server.free.pop_back();
+                    RingConnection& connection = server.slots[opened];
+                    connection.fd = result;
+                    connection.inFill = 0;
+                    connection.outSize = 0;
+                    connection.outSent = 0;
+                    ++connected;
+                    stats.peakConnections = connected > stats.peakConnections ? connected : stats.peakConnections;
+                    success = queueRingReceive(server, opened);
+                }
+                //The pending connection stays queued when descriptors run out, so wait before asking again
+                bool exhausted = result == -EMFILE || result == -ENFILE || result == -ENOBUFS || result == -ENOMEM;
+                success = success && (exhausted ? queueRingAcceptRetry(server) : queueRingAccept(server, listener));
+                continue;
+            }
+
+            RingConnection& connection = server.slots[slot];
+            bool alive = result > 0;
+            if (alive && kind == RING_RECEIVE)
+            {
+                //Answer the whole requests and keep a partial one for the next receive
+                Uint8* in = server.region + slot * RING_SLOT_BYTES;
+                connection.inFill += (Uint32)result;
+                size_t count = answerRequests(sessions, connection.fd, in, connection.inFill, in + RING_IN_BYTES);
+                size_t used = count * sizeof(ServerRequest);
+                memmove(in, in + used, connection.inFill - used);
+                connection.inFill -= (Uint32)used;
+                connection.outSize = (Uint32)(count * sizeof(ServerResponse));
+                connection.outSent = 0;
+                stats.requests += count;
+                stats.peakSessions = sessions.getCount() > stats.peakSessions ? sessions.getCount() : stats.peakSessions;
+                alive = count > 0 ? queueRingSend(server, slot) : queueRingReceive(server, slot);
+            }
+            else if (alive)
+            {
+                connection.outSent += (Uint32)result;
+                alive = connection.outSent < connection.outSize ? queueRingSend(server, slot) : queueRingReceive(server, slot);
+            }
+
+            if (!alive)
+            {
+                sessions.closeOwner(connection.fd);
+                ++gThreadSyscalls;
+                ::close(connection.fd);
+                connection.fd = -1;
+                server.free.push_back(slot);
+                server.full = false;
+                --connected;
+            }
+        }
+    }
+
+    //Closing the ring cancels whatever is still in flight
+    server.ring.close();
+    for (size_t slot = 0; slot < server.slots.size(); ++slot)
+    {
+        if (server.slots[slot].fd >= 0)
+        {
+            ::close(server.slots[slot].fd);
+        }
+    }
+    munmap(region, regionSize);
+    return success;
+}
+#endif
+
+//Serves on the backend --io picks, reporting it in the summary
+static bool serveOn(int listener, ServerStats& stats, const char** backend)
+{
+    memset(&stats, 0, sizeof(stats));
+    Uint64 syscalls = gThreadSyscalls;
+    bool success;
+
+#ifdef HAVE_IO_URING
+    bool ring = strcmp(gIoBackend, "epoll") != 0 && LRing::isSupported();
+#else
+    bool ring = false;
+#endif
+    if (strcmp(gIoBackend, "uring") == 0 && !ring)
+    {
+        printf("io_uring isn't available on this system.\n");
+        return false;
+    }
+
+#ifdef HAVE_IO_URING
+    if (ring)
+    {
+        *backend = "io_uring";
+        success = serveRing(listener, stats);
+    }
+    else
+#endif
+    {
+        *backend = "epoll";
+        success = serveEpoll(listener, stats);
+    }
+
+    stats.syscalls = gThreadSyscalls - syscalls;
+    return success;
+}
+
+int runServer()
+{
+    raiseFileLimit();
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = openServerSocket(true);
+    if (listener < 0)
+    {
+        printServerAddress("Unable to listen on");
+        return 1;
+    }
+
+    printServerAddress("Serving sessions on");
+    fflush(stdout);
+    ServerStats stats;
+    const char* backend = "";
+    bool success = serveOn(listener, stats, &backend);
+
+    ::close(listener);
+    if (gServerPort == 0)
+    {
+        unlink(gSocketPath);
+    }
+
+    printf("Served %llu requests with %s, peak %d connections and %d sessions\n", (unsigned long long)stats.requests, backend, stats.peakConnections, stats.peakSessions);
+    return success ? 0 : 1;
+}
+
+//One load generator connection, each slot plays one session after another
+struct LoadgenConnection
+{
+    int fd;
+    SocketBuffers buffers;
+    //Session id, rounds played and when the last request went out, per slot
+    std::vector<Uint32> session;
+    std::vector<int> played;
+    std::vector<Uint64> sentAt;
+    //Slot of each request awaiting its response, in send order
+    std::vector<int> pending;
+    size_t pendingHead;
+};
+
+struct Loadgen
+{
+    //Sessions handed out so far
+    SDL_atomic_t started;
+    int sessions;
+    int rounds;
+    int connections;
+    int threads;
+    Uint8 bot;
+    //Per task results
+    std::vector<std::vector<Uint64> > latencies;
+    std::vector<Uint64> completed;
+    std::vector<Uint64> errors;
+};
+
+//Queues the slot's next request: a new session, its next round or its close, false when the slot is done
+static bool queueLoadgenRequest(Loadgen* loadgen, LoadgenConnection& connection, int slot, bool create, LRandom& random)
+{
+    ServerRequest request = {};
+    if (create)
+    {
+        if (SDL_AtomicAdd(&loadgen->started, 1) >= loadgen->sessions)
+        {
+            return false;
+        }
+        request.op = SERVER_CREATE;
+        request.move = loadgen->bot;
+        connection.played[slot] = 0;
+    }
+    else
+    {
+        request.op = connection.played[slot] < loadgen->rounds ? SERVER_PLAY : SERVER_CLOSE;
+        request.move = (Uint8)(random.next() % gRules.getCount() + 1);
+        request.session = connection.session[slot];
+    }
+
+    const Uint8* bytes = (const Uint8*)&request;
+    connection.buffers.out.insert(connection.buffers.out.end(), bytes, bytes + sizeof(request));
+    connection.pending.push_back(slot);
+    connection.sentAt[slot] = SDL_GetPerformanceCounter();
+    return true;
+}
+
+static void loadgenTask(int index, int worker, void* data)
+{
+    Loadgen* loadgen = (Loadgen*)data;
+    std::vector<Uint64>& latencies = loadgen->latencies[index];
+    LRandom random(gSeed ^ (index + 1) * 0x9E3779B97F4A7C15ULL);
+
+    //Every task opens its share of the connections and fills each one's pipeline
+    int poll = epoll_create1(0);
+    std::vector<LoadgenConnection> connections;
+    for (int c = index; c < loadgen->connections; c += loadgen->threads)
+    {
+        LoadgenConnection connection;
+        connection.fd = openServerSocket(false);
+        if (connection.fd < 0)
+        {
+            ++loadgen->errors[index];
+            continue;
+        }
+        connection.buffers.sent = 0;
+        connection.session.resize(gLoadgenPipeline);
+        connection.played.resize(gLoadgenPipeline);
+        connection.sentAt.resize(gLoadgenPipeline);
+        connection.pendingHead = 0;
+        connections.push_back(connection);
+    }
+
+    size_t outstanding = 0;
+    for (size_t c = 0; c < connections.size(); ++c)
+    {
+        LoadgenConnection& connection = connections[c];
+        for (int slot = 0; slot < gLoadgenPipeline && queueLoadgenRequest(loadgen, connection, slot, true, random); ++slot)
+        {
+            ++outstanding;
+        }
+        sendPending(connection.fd, connection.buffers);
+
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u32 = (Uint32)c;
+        epoll_ctl(poll, EPOLL_CTL_ADD, connection.fd, &event);
+    }
+
+    const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+    while (outstanding > 0)
+    {
+        int ready = epoll_wait(poll, events, MAX_EVENTS, 10000);
+        if (ready == 0 || (ready < 0 && errno != EINTR))
+        {
+            //The server stopped answering
+            loadgen->errors[index] += outstanding;
+            break;
+        }
+
+        for (int i = 0; i < ready; ++i)
+        {
+            LoadgenConnection& connection = connections[events[i].data.u32];
+            SocketBuffers& buffers = connection.buffers;
+            bool alive = receiveSome(connection.fd, buffers);
+            Uint64 now = SDL_GetPerformanceCounter();
+
+            //Responses come back in the order the requests went out
+            size_t count = buffers.in.size() / sizeof(ServerResponse);
+            for (size_t r = 0; r < count; ++r)
+            {
+                ServerResponse response;
+                memcpy(&response, &buffers.in[r * sizeof(ServerResponse)], sizeof(response));
+                int slot = connection.pending[connection.pendingHead++];
+                --outstanding;
+
+                bool create = false;
+                if (response.status != SERVER_OK)
+                {
+                    ++loadgen->errors[index];
+                    create = true;
+                }
+                else if (response.op == SERVER_CREATE)
+                {
+                    connection.session[slot] = response.session;
+                }
+                else if (response.op == SERVER_PLAY)
+                {
+                    latencies.push_back(now - connection.sentAt[slot]);
+                    ++connection.played[slot];
+                }
+                else
+                {
+                    ++loadgen->completed[index];
+                    create = true;
+                }
+
+                if (queueLoadgenRequest(loadgen, connection, slot, create, random))
+                {
+                    ++outstanding;
+                }
+            }
+            buffers.in.erase(buffers.in.begin(), buffers.in.begin() + count * sizeof(ServerResponse));
+
+            //Drop the consumed part of the pending queue once it's all answered
+            if (connection.pendingHead == connection.pending.size())
+            {
+                connection.pending.clear();
+                connection.pendingHead = 0;
+            }
+
+            //Requests are a few bytes, the socket buffer always has room for a pipeline's worth
+            if (!sendPending(connection.fd, buffers) || !alive)
+            {
+                size_t lost = connection.pending.size() - connection.pendingHead;
+                loadgen->errors[index] += lost;
+                outstanding -= lost;
+                connection.pending.clear();
+                connection.pendingHead = 0;
+                epoll_ctl(poll, EPOLL_CTL_DEL, connection.fd, NULL);
+            }
+        }
+    }
+
+    for (size_t c = 0; c < connections.size(); ++c)
+    {
+        ::close(connections[c].fd);
+    }
+    ::close(poll);
+}
+
+//Totals of a load generator run
+struct LoadgenReport
+{
+    int threads;
+    int rounds;
+    Uint64 completed;
+    Uint64 played;
+    Uint64 errors;
+    double seconds;
+    //Round latency in microseconds
+    double p50;
+    double p99;
+    double worst;
+};
+
+//Plays gLoadgenSessions sessions against the server, false if it couldn't start
+static bool driveLoadgen(LoadgenReport& report)
+{
+    int bot = -1;
+    for (int b = 0; b < BOT_COUNT; ++b)
     {
-        //Create texture from surface pixels
-        newTexture = SDL_CreateTextureFromSurface(gRenderer, loadedSurface);
-        if (newTexture == NULL)
-        {
-            printf("Unable to create texture from %s. SDL Error: %s\n", path.c_str(), SDL_GetError());
-        }
-        else
+        if (strcmp(gBots[b].name, gComputerBot) == 0)
         {
-            //Get image dimensions
-            mWidth = loadedSurface->w;
-            mHeight = loadedSurface->h;
+            bot = b;
         }
+    }
+    if (bot < 0)
+    {
+        printf("Unknown computer strategy %s.\n", gComputerBot);
+        return false;
+    }
 
-        //Get rid of old loaded surface
-        SDL_FreeSurface(loadedSurface);
+    Loadgen loadgen;
+    SDL_AtomicSet(&loadgen.started, 0);
+    loadgen.sessions = gLoadgenSessions;
+    loadgen.rounds = gRounds > 0 ? gRounds : 32;
+    loadgen.connections = gLoadgenConnections;
+    loadgen.bot = (Uint8)bot;
+    int threads = gThreads > 0 ? gThreads : SDL_GetCPUCount();
+    loadgen.threads = threads < loadgen.connections ? threads : loadgen.connections;
+    loadgen.latencies.resize(loadgen.threads);
+    loadgen.completed.assign(loadgen.threads, 0);
+    loadgen.errors.assign(loadgen.threads, 0);
+
+    LThreadPool pool;
+    if (!pool.start(loadgen.threads))
+    {
+        return false;
     }
 
-    //Return success
-    mTexture = newTexture;
-    return mTexture != NULL;
-}
+    Uint64 start = SDL_GetPerformanceCounter();
+    pool.run(loadgen.threads, loadgenTask, &loadgen);
+    report.seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
 
-void LTexture::free()
-{
-    //Free texture if it exists
-    if (mTexture != NULL)
+    std::vector<Uint64> latencies;
+    report.threads = loadgen.threads;
+    report.rounds = loadgen.rounds;
+    report.completed = 0;
+    report.errors = 0;
+    for (int t = 0; t < loadgen.threads; ++t)
     {
-        SDL_DestroyTexture(mTexture);
-        mTexture = NULL;
-        mWidth = 0;
-        mHeight = 0;
+        latencies.insert(latencies.end(), loadgen.latencies[t].begin(), loadgen.latencies[t].end());
+        report.completed += loadgen.completed[t];
+        report.errors += loadgen.errors[t];
     }
+    std::sort(latencies.begin(), latencies.end());
+    double toMicros = 1e6 / SDL_GetPerformanceFrequency();
+    report.played = latencies.size();
+    report.p50 = latencies.empty() ? 0.0 : latencies[latencies.size() / 2] * toMicros;
+    report.p99 = latencies.empty() ? 0.0 : latencies[latencies.size() * 99 / 100] * toMicros;
+    report.worst = latencies.empty() ? 0.0 : latencies.back() * toMicros;
+    return true;
 }
 
-void LTexture::render(int x, int y)
+int runLoadgen()
 {
-    //Set rendering space and render to screen
-    SDL_Rect renderQuad = { x, y, mWidth, mHeight };
-    SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
+    raiseFileLimit();
+    signal(SIGPIPE, SIG_IGN);
+
+    LoadgenReport report;
+    if (!driveLoadgen(report))
+    {
+        return 1;
+    }
+
+    printServerAddress("Server:");
+    printf("Connections: %d, %d sessions in flight on each, %d threads\n", gLoadgenConnections, gLoadgenPipeline, report.threads);
+    printf("Sessions: %llu of %d, %d rounds each against %s\n", (unsigned long long)report.completed, gLoadgenSessions, report.rounds, gComputerBot);
+    printf("Elapsed: %.3f s, %.0f sessions/s, %.0f rounds/s\n", report.seconds, report.completed / report.seconds, report.played / report.seconds);
+    printf("Round latency: p50 %.1f us, p99 %.1f us, max %.1f us\n", report.p50, report.p99, report.worst);
+    printf("Errors: %llu\n", (unsigned long long)report.errors);
+    return report.errors == 0 && report.completed == (Uint64)gLoadgenSessions ? 0 : 1;
 }
 
-int LTexture::getWidth()
+//A benchmark server running on its own thread
+struct BenchServer
 {
-    return mWidth;
-}
+    int listener;
+    ServerStats stats;
+    const char* backend;
+    bool success;
+};
 
-int LTexture::getHeight()
+static int benchServerMain(void* data)
 {
-    return mHeight;
+    BenchServer* server = (BenchServer*)data;
+    server->success = serveOn(server->listener, server->stats, &server->backend);
+    return 0;
 }
 
-bool init()
+int benchServer()
 {
-    //Init flag
+    raiseFileLimit();
+    signal(SIGPIPE, SIG_IGN);
+
+    //The same load against an in-process server on each backend, over a Unix socket of its own
+    const char* socketPath = gSocketPath;
+    int serverPort = gServerPort;
+    const char* ioBackend = gIoBackend;
+    int sessions = gLoadgenSessions;
+    gSocketPath = "bench-server.sock";
+    gServerPort = 0;
+    gLoadgenSessions = sessions > 0 ? sessions : 20000;
+
+    const char* backends[] = { "epoll", "uring" };
     bool success = true;
-    //Init SDL
-    if (SDL_Init(SDL_INIT_VIDEO) < 0)
-    {
-        printf("SDL could not initialize. SDL Error: %s\n", SDL_GetError());
-        success = false;
-    }
-    else
+    printf("%d sessions of %d rounds, %d connections with %d sessions in flight on each\n", gLoadgenSessions, gRounds > 0 ? gRounds : 32,
+        gLoadgenConnections, gLoadgenPipeline);
+    printf("%-9s %12s %15s %10s %10s\n", "Backend", "rounds/s", "syscalls/round", "p50 us", "p99 us");
+    for (int b = 0; b < 2; ++b)
     {
-        //Set texture filtering to linear
-        if (!SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1"))
+#ifdef HAVE_IO_URING
+        bool supported = b == 0 || LRing::isSupported();
+#else
+        bool supported = b == 0;
+#endif
+        if (!supported)
         {
-            printf("Warning: Linear texture filtering not enabled.\n");
+            printf("%-9s not supported\n", "io_uring");
+            continue;
         }
 
-        //Create window
-        gWindow = SDL_CreateWindow("Epic Rock Paper Scissors", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-        if (gWindow == NULL)
+        gIoBackend = backends[b];
+        gServerQuit = 0;
+        BenchServer server;
+        server.listener = openServerSocket(true);
+        server.backend = backends[b];
+        server.success = false;
+        SDL_Thread* thread = server.listener >= 0 ? SDL_CreateThread(benchServerMain, "server", &server) : NULL;
+        if (thread == NULL)
         {
-            printf("Wdinwo could not be created. SDL Error: %s\n", SDL_GetError());
+            printServerAddress("Unable to serve on");
             success = false;
+            break;
         }
-        else
-        {
-            //Create renderer for window
-            gRenderer = SDL_CreateRenderer(gWindow, -1, SDL_RENDERER_ACCELERATED);
-            if (gRenderer == NULL)
-            {
-                printf("Renderer could not be created. SDL Error: %s\n", SDL_GetError());
-                success = false;
-            }
-            else
-            {
-                //Init renderer color
-                SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
 
-                //Init PNG loading
-                int imgFlags = IMG_INIT_PNG;
-                if (!(IMG_Init(imgFlags) & imgFlags))
-                {
-                    printf("SDL_image could not initialize. SDL_image Error: %s\n", IMG_GetError());
-                    success = false;
-                }
+        LoadgenReport report;
+        bool ran = driveLoadgen(report);
+        gServerQuit = 1;
+        SDL_WaitThread(thread, NULL);
+        ::close(server.listener);
+        unlink(gSocketPath);
 
-                //Initialize SDL_ttf
-                if(TTF_Init() == -1)
-                {
-                    printf( "SDL_ttf could not initialize! SDL_ttf Error: %s\n", TTF_GetError() );
-                    success = false;
-                }
-            }
+        if (!ran || !server.success)
+        {
+            success = false;
+            break;
         }
+        success = success && report.errors == 0 && report.completed == (Uint64)gLoadgenSessions;
+        printf("%-9s %12.0f %15.3f %10.1f %10.1f\n", server.backend, report.played / report.seconds,
+            report.played > 0 ? (double)server.stats.syscalls / report.played : 0.0, report.p50, report.p99);
     }
 
-    return success;
+    gSocketPath = socketPath;
+    gServerPort = serverPort;
+    gIoBackend = ioBackend;
+    gLoadgenSessions = sessions;
+    gServerQuit = 0;
+    printf("Every session completed: %s\n", success ? "yes" : "NO");
+    return success ? 0 : 1;
+}
+#else
+int runServer()
+{
+    printf("The session server needs Linux.\n");
+    return 1;
 }
 
-bool loadMedia()
+int runLoadgen()
 {
-    //Loading success flag
-    bool success = true;
+    printf("The load generator needs Linux.\n");
+    return 1;
+}
+
+int benchServer()
+{
+    printf("The session server needs Linux.\n");
+    return 1;
+}
+#endif
+
+int main(int argc, char* args[])
+{
+    GameSession session = { 0, 0, 0, { 0, 0, 0, 0, 0 } };
+    gLaunchTicks = SDL_GetPerformanceCounter();
 
-    //Load rock texture
-    if (!gRockTexture.loadFromFile("media/rock.png"))
+    if (!parseArgs(argc, args))
     {
-        printf("Failed to load rock texture image.\n");
-        success = false;
+        return 1;
     }
 
-    //Load paper texture
-    if (!gPaperTexture.loadFromFile("media/paper.png"))
+    //Without an explicit seed every run plays differently
+    if (!gSeedGiven)
     {
-        printf("Failed to load paper texture.\n");
-        success = false;
+        gSeed = SDL_GetPerformanceCounter() ^ ((uint64_t)time(NULL) << 32);
     }
 
-    //Load scissors texture
-    if (!gScissorsTexture.loadFromFile("media/scissors.png"))
+    if (gBenchmark != NULL)
     {
-        printf("Failed to load scissors texture.\n");
-        success = false;
+        return runBenchmark(gBenchmark);
     }
 
-    if (!gWelcome.createText("media/ComicSansMS.ttf", { 0, 0, 0 }, 20, "Use your keyboard: 1 - rock,  2 - paper, 3 - scissors."))
+    if (gTournament)
     {
-        printf("Failed to create welcome message texture.\n");
-        success = false;
+        return runTournament();
     }
 
-    if (!gWin.createText("media/ComicSansMS.ttf", { 0, 0, 0 }, 30, "You win!"))
+    if (gPackArchive != NULL)
     {
-        printf("Failed to create win message texture.\n");
-        success = false;
+        return packArchive(gPackArchive);
     }
 
-    if (!gLoss.createText("media/ComicSansMS.ttf", { 0, 0, 0 }, 30, "You lose!"))
+    if (gSolve)
     {
-        printf("Failed to create loss message texture.\n");
-        success = false;
+        return runSolve();
     }
 
-    if (!gDraw.createText("media/ComicSansMS.ttf", { 0, 0, 0 }, 30, "It's a draw!"))
+    if (gTrainBatches > 0)
     {
-        printf("Failed to create loss message texture.\n");
-        success = false;
+        return runTrain();
     }
 
-    if (!gRetry.createText("media/ComicSansMS.ttf", { 0, 0, 0 }, 20, "Press Space to play again."))
+    if (gImportPath != NULL)
     {
-        printf("Failed to create loss message texture.\n");
-        success = false;
+        if (!LColumnStore::importReplay(gStorePath, gImportPath))
+        {
+            return 1;
+        }
+        printf("Imported %s into %s\n", gImportPath, gStorePath);
+        return 0;
     }
 
-    return success;
-}
-
-void close()
-{
-    gRockTexture.free();
-    gWelcome.free();
+    if (gQueryGroup != NULL)
+    {
+        return runQuery();
+    }
 
-    SDL_DestroyRenderer(gRenderer);
-    gRenderer = NULL;
-    SDL_DestroyWindow(gWindow);
-    gWindow = NULL;
+    if (gServe)
+    {
+        return runServer();
+    }
 
-    IMG_Quit();
-    SDL_Quit();
-}
+    if (gLoadgenSessions > 0)
+    {
+        return runLoadgen();
+    }
 
-int checkWin(int p, int c)
-{
-    if (p == 1)
+    //Replays bring their own rules
+    if (gReplayPath != NULL)
     {
-        switch (c)
+        if (!gReplay.open(gReplayPath))
         {
-        case 1:
-            return 3;
-            break;
-        
-        case 2:
-            return 2;
-            break;
-        
-        case 3:
             return 1;
-            break;
-        
-        default:
-            break;
         }
-    }
 
-    if (p == 2)
-    {
-        switch (c)
+        if (!gRules.create((int)gReplay.getHeader().weapons))
         {
-        case 1:
+            printf("Replay %s has an unsupported weapon count.\n", gReplayPath);
             return 1;
-            break;
-        
-        case 2:
-            return 3;
-            break;
-        
-        case 3:
-            return 2;
-            break;
-        
-        default:
-            break;
         }
+
+        if (gHeadless)
+        {
+            return runReplaySummary();
+        }
+
+        //Play the computer the replay was recorded with, so seeking can restore it
+        char ai[sizeof(ReplayHeader::ai) + 1] = {};
+        memcpy(ai, gReplay.getHeader().ai, sizeof(ReplayHeader::ai));
+        gComputer = createBot(ai);
+        if (gComputer == NULL)
+        {
+            printf("Replay %s was recorded against unknown computer strategy %s.\n", gReplayPath, ai);
+            return 1;
+        }
+        if (gReplayStart > 0)
+        {
+            seekReplay(gReplayStart, session);
+        }
+    }
+    else
+    {
+        gComputer = createBot(gComputerBot);
     }
 
-    if (p == 3)
+    if (gComputer == NULL)
     {
-        switch (c)
+        printf("Unknown computer strategy %s.\n", gComputerBot);
+        return 1;
+    }
+
+    if (gRecordPath != NULL && gReplayPath == NULL)
+    {
+        ReplayHeader header = {};
+        memcpy(header.magic, REPLAY_MAGIC, 4);
+        header.version = REPLAY_VERSION;
+        header.seed = gSeed;
+        header.weapons = (Uint32)gRules.getCount();
+        header.startTime = (Uint32)time(NULL);
+        strncpy(header.ai, gComputerBot, sizeof(header.ai) - 1);
+        if (!gRecorder.open(gRecordPath, header, (Uint32)gKeyframeInterval))
         {
-        case 1:
-            return 2;
-            break;
-        
-        case 2:
+            delete gComputer;
             return 1;
-            break;
-        
-        case 3:
-            return 3;
-            break;
-        
-        default:
-            break;
         }
+        if (gRecorder.needsKeyframe())
+        {
+            gRecorder.addKeyframe(session.score, gComputer);
+        }
+        gLastRoundTicks = SDL_GetPerformanceCounter();
     }
 
-    return 0;
-}
-
-int main(int argc, char* args[])
-{
-    int pChoice;
-    int cChoice;
-    int winner = 0;
+    //Simulate without touching SDL video, fonts or images
+    if (gHeadless)
+    {
+        int result = runHeadless();
+        if (gRecorder.isOpen())
+        {
+            Uint64 recorded = gRecorder.getCount();
+            if (!gRecorder.close())
+            {
+                printf("Failed to write replay %s.\n", gRecordPath);
+                result = 1;
+            }
+            else
+            {
+                printf("Recorded %llu rounds to %s\n", (unsigned long long)recorded, gRecordPath);
+            }
+        }
+        delete gComputer;
+        return result;
+    }
 
     //Start up SDL and create window
     if (!init())
@@ -475,149 +10716,189 @@ int main(int argc, char* args[])
     }
     else
     {
+        //Decode media on workers, drawing progress until it's ready to upload
+        bool quit = false;
+        buildWelcomeMessage();
+        bool loaded = startLoadMedia();
+        bool shownLoading = false;
+        SDL_Event e;
+        while (!quit && gAssets.getDone() < gAssets.getTotal())
+        {
+            while (SDL_PollEvent(&e) != 0)
+            {
+                if (e.type == SDL_QUIT)
+                {
+                    quit = true;
+                }
+            }
+
+            renderLoading();
+            SDL_RenderPresent(gRenderer);
+            if (gShowStats && !shownLoading)
+            {
+                printf("Time to loading screen: %.1f ms\n", (SDL_GetPerformanceCounter() - gLaunchTicks) * 1000.0 / SDL_GetPerformanceFrequency());
+                shownLoading = true;
+            }
+            SDL_Delay(gVsync ? 0 : 5);
+        }
+
         //Load media
-        if (!loadMedia())
+        if (!finishLoadMedia() || !loaded)
         {
             printf("Failed to load media.\n");
         }
         else
         {
-            //Main loop flag
-            bool quit = false;
-            //Event handler
-            SDL_Event e;
+            //Redraw pending
+            bool dirty = true;
+            bool firstFrame = true;
+
+            //Frame pacing and idle/busy accounting
+            Uint64 frequency = SDL_GetPerformanceFrequency();
+            Uint64 frameTicks = gTargetFps > 0 ? frequency / gTargetFps : 0;
+            Uint64 lastFrame = 0;
+            Uint64 reportStart = SDL_GetPerformanceCounter();
+            Uint64 idleTicks = 0;
+            Uint64 frameTimeTicks = 0;
+            int frames = 0;
 
             while (!quit)
             {
-                //Handle events on queue
-                while (SDL_PollEvent(&e) != 0)
+                //Sleep until something happens when there's nothing to redraw
+                if (!gPollLoop && !dirty)
                 {
-                    //User requests quit
-                    if (e.type == SDL_QUIT)
+                    Uint64 waitStart = SDL_GetPerformanceCounter();
+                    Uint64 untilReport = reportStart + frequency > waitStart ? reportStart + frequency - waitStart : 0;
+                    int timeout = gShowStats ? (int)(untilReport * 1000 / frequency) + 1 : 1000;
+                    //Keep the overlay numbers moving while it's shown
+                    if (gShowProfiler && timeout > 250)
+                    {
+                        timeout = 250;
+                    }
+                    //Wake for the next replayed round
+                    if (gReplay.isOpen() && !gReplayPaused)
                     {
-                        quit = true;
+                        int untilStep = gReplayDue > waitStart ? (int)((gReplayDue - waitStart) * 1000 / frequency) + 1 : 0;
+                        timeout = untilStep < timeout ? untilStep : timeout;
                     }
+                    bool gotEvent = SDL_WaitEventTimeout(&e, timeout) != 0;
+                    idleTicks += SDL_GetPerformanceCounter() - waitStart;
 
-                    if (winner == 0)
+                    gProfiler.begin(PROFILE_EVENTS);
+                    if (gotEvent && handleEvent(e, quit, session))
                     {
-                        if (e.type == SDL_KEYDOWN)
-                        {
-                            switch (e.key.keysym.sym)
-                            {
-                            case SDLK_1:
-                                pChoice = 1;
-                                cChoice = rand() % 3 + 1;
-                                winner = checkWin(pChoice, cChoice);
-                                break;
-
-                            case SDLK_2:
-                                pChoice = 2;
-                                cChoice = rand() % 3 + 1;
-                                winner = checkWin(pChoice, cChoice);
-                                break;
-
-                            case SDLK_3:
-                                pChoice = 3;
-                                cChoice = rand() % 3 + 1;
-                                winner = checkWin(pChoice, cChoice);
-                                break;
-                            
-                            default:
-                                break;
-                            }
-                        }
+                        dirty = true;
                     }
+                    gProfiler.end(PROFILE_EVENTS);
 
-                    else
+                    if (!gotEvent && gShowProfiler)
                     {
-                        if (e.type = SDL_KEYDOWN)
-                        {
-                            if (e.key.keysym.sym == SDLK_SPACE)
-                            {
-                                winner = 0;
-                                pChoice = 0;
-                                cChoice = 0;
-                            }
-                        }
+                        dirty = true;
                     }
                 }
 
-                //Clear screen
-                SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
-                SDL_RenderClear(gRenderer);
-
-                //Fill background
-                SDL_Rect bgRect = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
-                SDL_SetRenderDrawColor(gRenderer, 172, 202, 250, 0xFF);
-                SDL_RenderFillRect(gRenderer, &bgRect);
-
-                gWelcome.render(20, 20);
+                //Handle events on queue
+                gProfiler.begin(PROFILE_EVENTS);
+                while (SDL_PollEvent(&e) != 0)
+                {
+                    if (handleEvent(e, quit, session))
+                    {
+                        dirty = true;
+                    }
+                }
+                gProfiler.end(PROFILE_EVENTS);
 
-                switch (pChoice)
+                //Advance the replay at its recorded pace, clamped so it's watchable
+                if (gReplay.isOpen() && !gReplayPaused && SDL_GetPerformanceCounter() >= gReplayDue)
                 {
-                case 1:
-                    gRockTexture.render(80, 200);
-                    break;
-                
-                case 2:
-                    gPaperTexture.render(80, 200);
-                    break;
+                    if (stepReplay(session))
+                    {
+                        dirty = true;
+                    }
 
-                case 3:
-                    gScissorsTexture.render(80, 200);
-                    break;
-                
-                default:
-                    break;
+                    Uint64 stepMs = gReplayNext < gReplay.getCount() ? gReplay.getRound(gReplayNext).dtMicros / 1000 : 1000;
+                    stepMs = stepMs < 100 ? 100 : (stepMs > 1000 ? 1000 : stepMs);
+                    gReplayDue = SDL_GetPerformanceCounter() + stepMs * frequency / 1000;
                 }
 
-                switch (cChoice)
+                if (dirty || gPollLoop)
                 {
-                case 1:
-                    gRockTexture.render(400, 200);
-                    break;
-                
-                case 2:
-                    gPaperTexture.render(400, 200);
-                    break;
+                    //Hold the frame back to the target rate
+                    if (frameTicks > 0)
+                    {
+                        Uint64 now = SDL_GetPerformanceCounter();
+                        if (now < lastFrame + frameTicks)
+                        {
+                            SDL_Delay((Uint32)((lastFrame + frameTicks - now) * 1000 / frequency));
+                            idleTicks += SDL_GetPerformanceCounter() - now;
+                        }
+                    }
 
-                case 3:
-                    gScissorsTexture.render(400, 200);
-                    break;
-                
-                default:
-                    break;
+                    Uint64 frameStart = SDL_GetPerformanceCounter();
+                    gProfiler.begin(PROFILE_FRAME);
+                    drawFrame(session);
+                    if (gShowProfiler)
+                    {
+                        renderProfiler();
+                    }
+
+                    //Update screen
+                    gProfiler.begin(PROFILE_PRESENT);
+                    SDL_RenderPresent(gRenderer);
+                    gProfiler.end(PROFILE_PRESENT);
+                    gProfiler.end(PROFILE_FRAME);
+                    gProfiler.endFrame();
+                    lastFrame = SDL_GetPerformanceCounter();
+                    frameTimeTicks += lastFrame - frameStart;
+
+                    if (firstFrame && gShowStats)
+                    {
+                        printf("Time to first frame: %.1f ms\n", (lastFrame - gLaunchTicks) * 1000.0 / frequency);
+                    }
+                    firstFrame = false;
+                    dirty = false;
+                    ++frames;
                 }
 
-                switch (winner)
+                //Report idle vs busy time once per second
+                Uint64 now = SDL_GetPerformanceCounter();
+                if (now - reportStart >= frequency)
                 {
-                case 1:
-                    gWin.render((SCREEN_WIDTH - gWin.getWidth()) / 2, 100);
-                    gRetry.render((SCREEN_WIDTH - gRetry.getWidth()) / 2, 130);
-                    break;
+                    if (gShowStats)
+                    {
+                        Uint64 elapsed = now - reportStart;
+                        printf("Loop: %d frames, idle %.1f ms, busy %.1f ms, frame cache %d hits %d rebuilds\n", frames, idleTicks * 1000.0 / frequency, (elapsed - idleTicks) * 1000.0 / frequency, gFrameCacheHits, gFrameCacheMisses);
+                        if (frames > 0)
+                        {
+                            printf("Frame: %.1f draw calls, %.3f ms draw + present\n", (double)gDrawCalls / frames, frameTimeTicks * 1000.0 / frequency / frames);
+                        }
+                    }
 
-                case 2:
-                    gLoss.render((SCREEN_WIDTH - gLoss.getWidth()) / 2, 100);
-                    gRetry.render((SCREEN_WIDTH - gRetry.getWidth()) / 2, 130);
-                    break;
-                
-                case 3:
-                    gDraw.render((SCREEN_WIDTH - gDraw.getWidth()) / 2, 100);
-                    gRetry.render((SCREEN_WIDTH - gRetry.getWidth()) / 2, 130);
-                    break;
-                
-                default:
-                    break;
+                    reportStart = now;
+                    idleTicks = 0;
+                    frameTimeTicks = 0;
+                    frames = 0;
+                    gDrawCalls = 0;
+                    gFrameCacheHits = 0;
+                    gFrameCacheMisses = 0;
                 }
+            }
 
-                //Update screen
-                SDL_RenderPresent(gRenderer);
+            if (gProfileCsv != NULL)
+            {
+                gProfiler.writeCsv(gProfileCsv);
             }
         
         }
     }
 
     close();
+    if (!gRecorder.close())
+    {
+        printf("Failed to write replay %s.\n", gRecordPath);
+    }
+    gReplay.close();
+    delete gComputer;
 
     return 0;
 }
\ No newline at end of file